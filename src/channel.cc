@@ -0,0 +1,95 @@
+#include "channel.h"
+#include "iomanager.h"
+#include "log.h"
+
+namespace sylar
+{
+    static Logger::ptr g_logger = LOG_NAME("system");
+
+    ChannelWaiter::ChannelWaiter()
+    {
+        m_waiter.init(&m_sem);
+    }
+
+    ChannelWaiter::ChannelWaiter(std::function<void()> cb)
+    {
+        m_waiter.initCallback(std::move(cb));
+    }
+
+    ChannelWaiter::~ChannelWaiter()
+    {
+        // completed without parking
+        m_waiter.release();
+    }
+
+    int ChannelWaiter::wait(uint64_t timeout_ms)
+    {
+        Timer::ptr timer;
+        if (timeout_ms != ~0ull)
+        {
+            IOManager *iom = IOManager::GetThis();
+            if (iom)
+            {
+                std::weak_ptr<ChannelWaiter> weak(shared_from_this());
+                timer = iom->addTimer(timeout_ms, [weak]()
+                                      {
+                                          auto self = weak.lock();
+                                          if (self && self->claim(TIMEOUT))
+                                          {
+                                              self->wake();
+                                          } });
+            }
+            else
+            {
+                LOG_ERROR(g_logger) << "channel timeout needs an IOManager, waiting without one";
+            }
+        }
+        m_waiter.sleep();
+        if (timer)
+        {
+            timer->cancel();
+        }
+        return fired();
+    }
+
+    int ChannelSelect::wait(uint64_t timeout_ms)
+    {
+        // no allocation and no registration when a case is ready
+        int index = tryWait();
+        if (index != ChannelWaiter::TIMEOUT)
+        {
+            return index;
+        }
+
+        ChannelWaiter::ptr waiter(new ChannelWaiter);
+        int n = (int)m_cases.size();
+        bool parked = true;
+        for (int i = 0; i < n; ++i)
+        {
+            if (m_cases[i].start(waiter, i))
+            {
+                // fired by us now, or by a channel we registered on earlier that is waking us
+                parked = waiter->fired() != i;
+                break;
+            }
+        }
+        index = parked ? waiter->wait(timeout_ms) : waiter->fired();
+        for (auto &c : m_cases)
+        {
+            c.cancel(waiter);
+        }
+        return index;
+    }
+
+    int ChannelSelect::tryWait()
+    {
+        for (int i = 0; i < (int)m_cases.size(); ++i)
+        {
+            if (m_cases[i].start(nullptr, i))
+            {
+                return i;
+            }
+        }
+        return ChannelWaiter::TIMEOUT;
+    }
+}
@@ -6,21 +6,125 @@ namespace sylar
     // a:
     //   b: 10
 
-    static void ListAllMember(const std::string &prefix,
-                              const YAML::Node &node,
-                              std::list<std::pair<std::string, YAML::Node>> &out)
+    // content hash of a config key's subtree, size counts the records of the subtree itself included
+    struct NodeHash
     {
-        if (prefix.find_first_not_of("abcdefghijklmnopqrstuvwxyz._0123456789") != std::string::npos)
+        uint64_t hash;
+        size_t size;
+    };
+
+    static uint64_t Mix(uint64_t h, uint64_t v)
+    {
+        return h ^ (v + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2));
+    }
+
+    // hash of a value that is loaded as a whole
+    static uint64_t HashValue(const YAML::Node &node)
+    {
+        uint64_t h = node.Type();
+        if (node.IsScalar())
         {
-            LOG_ERROR(LOG_ROOT()) << "config invalid name: " << prefix << " : " << node;
-            return;
+            return Mix(h, std::hash<std::string>()(node.Scalar()));
         }
-        out.push_back(std::make_pair(prefix, node));
-        if (node.IsMap())
+        for (auto it = node.begin(); it != node.end(); ++it)
         {
-            for (auto it = node.begin(); it != node.end(); ++it)
+            if (node.IsMap())
+            {
+                h = Mix(h, HashValue(it->first));
+                h = Mix(h, HashValue(it->second));
+            }
+            else
             {
-                ListAllMember(prefix.empty() ? it->first.Scalar() : prefix + "." + it->first.Scalar(), it->second, out);
+                h = Mix(h, HashValue(*it));
+            }
+        }
+        return h;
+    }
+
+    // one record per config key in pre-order, every map level is a key
+    static uint64_t HashTree(const YAML::Node &node, std::vector<NodeHash> &out)
+    {
+        if (!node.IsMap())
+        {
+            uint64_t h = HashValue(node);
+            out.push_back(NodeHash{h, 1});
+            return h;
+        }
+        size_t index = out.size();
+        out.push_back(NodeHash{0, 0});
+        uint64_t h = node.Type();
+        for (auto it = node.begin(); it != node.end(); ++it)
+        {
+            h = Mix(h, HashValue(it->first));
+            h = Mix(h, HashTree(it->second, out));
+        }
+        out[index] = NodeHash{h, out.size() - index};
+        return h;
+    }
+
+    // key -> hash of the yaml it was last loaded from
+    static std::unordered_map<std::string, uint64_t> &GetHashes()
+    {
+        static std::unordered_map<std::string, uint64_t> s_hashes;
+        return s_hashes;
+    }
+
+    static Mutex &GetLoadMutex()
+    {
+        static Mutex s_mutex;
+        return s_mutex;
+    }
+
+    ConfigVarMap::ConfigVarMap()
+    {
+        m_slots.resize(64);
+    }
+
+    size_t ConfigVarMap::probe(const std::string &name, size_t hash) const
+    {
+        size_t mask = m_slots.size() - 1;
+        for (size_t i = hash & mask;; i = (i + 1) & mask)
+        {
+            const Slot &slot = m_slots[i];
+            if (!slot.var || (slot.hash == hash && slot.var->getName() == name))
+            {
+                return i;
+            }
+        }
+    }
+
+    ConfigVarBase::ptr ConfigVarMap::find(const std::string &name) const
+    {
+        const Slot &slot = m_slots[probe(name, std::hash<std::string>()(name))];
+        return slot.var;
+    }
+
+    void ConfigVarMap::insert(ConfigVarBase::ptr var)
+    {
+        // keep the load factor under 1/2 so probe chains stay short
+        if ((m_size + 1) * 2 > m_slots.size())
+        {
+            rehash(m_slots.size() * 2);
+        }
+        size_t hash = std::hash<std::string>()(var->getName());
+        Slot &slot = m_slots[probe(var->getName(), hash)];
+        if (!slot.var)
+        {
+            ++m_size;
+        }
+        slot.hash = hash;
+        slot.var = var;
+    }
+
+    void ConfigVarMap::rehash(size_t capacity)
+    {
+        std::vector<Slot> slots(capacity);
+        slots.swap(m_slots);
+        for (auto &slot : slots)
+        {
+            if (slot.var)
+            {
+                m_slots[probe(slot.var->getName(), slot.hash)] = std::move(slot);
             }
         }
     }
@@ -28,47 +132,111 @@ namespace sylar
     ConfigVarBase::ptr Config::LookupBase(const std::string &name)
     {
         RWMutexType::ReadLock lock(GetMutex());
-        auto it = GetDatas().find(name);
-        return it == GetDatas().end() ? nullptr : it->second;
+        return GetDatas().find(name);
     }
 
-    void Config::LoadFromYaml(const YAML::Node &node)
+    // walks the tree in the same order as HashTree, index is the record of node.
+    // false when a var in the subtree failed to convert. the hash of a subtree is only
+    // recorded once all of it applied, so a failed conversion is tried again next load
+    static bool Apply(const std::string &prefix, const YAML::Node &node, const std::vector<NodeHash> &hashes,
+                      size_t &index, bool full, size_t &applied)
     {
-        std::list<std::pair<std::string, YAML::Node>> all_nodes;
-        ListAllMember("", node, all_nodes);
-
-        for (auto &item : all_nodes)
+        const NodeHash &record = hashes[index];
+        size_t next = index + record.size;
+        if (prefix.find_first_not_of("abcdefghijklmnopqrstuvwxyz._0123456789") != std::string::npos)
         {
-            std::string key = item.first;
-            if (key.empty())
-                continue;
+            LOG_ERROR(LOG_ROOT()) << "config invalid name: " << prefix << " : " << node;
+            index = next;
+            return true;
+        }
 
-            std::transform(key.begin(), key.end(), key.begin(), ::tolower);
-            ConfigVarBase::ptr var = LookupBase(key);
+        auto &cache = GetHashes();
+        auto it = cache.find(prefix);
+        bool unchanged = it != cache.end() && it->second == record.hash;
+        if (unchanged && !full)
+        {
+            index = next;
+            return true;
+        }
+        uint64_t hash = record.hash;
+        ++index;
 
+        bool ok = true;
+        if (!prefix.empty())
+        {
+            ConfigVarBase::ptr var = Config::LookupBase(prefix);
             if (var)
             {
-                if (item.second.IsScalar())
+                if (var->fromYaml(node))
                 {
-                    var->fromString(item.second.Scalar());
+                    ++applied;
                 }
                 else
                 {
-                    std::stringstream ss;
-                    ss << item.second;
-                    var->fromString(ss.str());
+                    ok = false;
                 }
             }
         }
+        if (node.IsMap())
+        {
+            for (auto it = node.begin(); it != node.end(); ++it)
+            {
+                ok &= Apply(prefix.empty() ? it->first.Scalar() : prefix + "." + it->first.Scalar(), it->second, hashes, index, full, applied);
+            }
+        }
+        if (ok)
+        {
+            cache[prefix] = hash;
+        }
+        return ok;
     }
 
-    void Config::Visit(std::function<void(ConfigVarBase::ptr)> cb)
+    size_t Config::LoadFromYaml(const YAML::Node &node)
     {
-        RWMutexType::ReadLock lock(GetMutex());
-        ConfigVarMap &m = GetDatas();
-        for (auto it = m.begin(); it != m.end(); it++)
+        static uint64_t s_generation = 0;
+        Mutex::Lock lock(GetLoadMutex());
+
+        std::vector<NodeHash> hashes;
+        HashTree(node, hashes);
+
+        uint64_t generation;
         {
-            cb(it->second);
+            RWMutexType::ReadLock lock(GetMutex());
+            generation = GetGeneration();
         }
+        // a var registered since the last load may sit in a subtree that did not change
+        bool full = generation != s_generation;
+        s_generation = generation;
+
+        size_t index = 0;
+        size_t applied = 0;
+        Apply("", node, hashes, index, full, applied);
+        return applied;
+    }
+
+    YAML::Node Config::MergeYaml(const YAML::Node &base, const YAML::Node &over)
+    {
+        if (!over.IsDefined() || over.IsNull())
+        {
+            return YAML::Clone(base);
+        }
+        if (!base.IsMap() || !over.IsMap())
+        {
+            return YAML::Clone(over);
+        }
+        YAML::Node out = YAML::Clone(base);
+        for (auto it = over.begin(); it != over.end(); ++it)
+        {
+            const std::string &key = it->first.Scalar();
+            const YAML::Node &cur = const_cast<const YAML::Node &>(out)[key];
+            out[key] = cur.IsDefined() ? MergeYaml(cur, it->second) : YAML::Clone(it->second);
+        }
+        return out;
+    }
+
+    void Config::Visit(std::function<void(ConfigVarBase::ptr)> cb)
+    {
+        RWMutexType::ReadLock lock(GetMutex());
+        GetDatas().forEach(cb);
     }
 }
\ No newline at end of file
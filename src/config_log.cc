@@ -6,14 +6,26 @@ namespace sylar
 {
     struct LogAppenderDefine
     {
-        int type = 0; // 1: File, 2: STDOUT
+        int type = 0; // 1: File, 2: STDOUT, 3: Binary, 4: RollingFile, 5: Json, 6: Mmap
         LogLevel::Level level = LogLevel::UNKNOWN;
         std::string filename;
         std::string format;
 
+        // RollingFileLogAppender only
+        uint64_t max_size = 0;
+        std::string rotate;
+        uint32_t max_files = 0;
+        bool compress = true;
+
+        // JsonLogAppender only, json or logfmt
+        std::string encoding;
+
+        // MmapFileLogAppender only, 0: default
+        uint64_t window_size = 0;
+
         bool operator==(const LogAppenderDefine &other) const
         {
-            return type == other.type && level == other.level && format == other.format && filename == other.filename;
+            return type == other.type && level == other.level && format == other.format && filename == other.filename && max_size == other.max_size && rotate == other.rotate && max_files == other.max_files && compress == other.compress && encoding == other.encoding && window_size == other.window_size;
         }
     };
 
@@ -66,12 +78,23 @@ namespace sylar
                             ap.reset(new FileLogAppender(a.filename));
                         } else if (a.type == 2) {
                             ap.reset(new StdoutLogAppender);
+                        } else if (a.type == 3) {
+                            ap.reset(new BinaryLogAppender(a.filename));
+                        } else if (a.type == 4) {
+                            ap.reset(new RollingFileLogAppender(a.filename, a.max_size,
+                                                                RollingFileLogAppender::FromString(a.rotate),
+                                                                a.max_files, a.compress));
+                        } else if (a.type == 5) {
+                            ap.reset(new JsonLogAppender(a.filename, JsonLogAppender::FromString(a.encoding)));
+                        } else if (a.type == 6) {
+                            ap.reset(a.window_size ? new MmapFileLogAppender(a.filename, a.window_size)
+                                                   : new MmapFileLogAppender(a.filename));
                         } else {
                             continue;
                         }
                         ap->setLevel(a.level);
                         if (!a.format.empty()) {
-                            LogFormatter::ptr fmt(new LogFormatter(a.format));
+                            LogFormatter::ptr fmt = LogFormatter::Create(a.format);
                             if (!fmt->isError()) {
                                 ap->setFormatter(fmt);
                             }
@@ -100,14 +123,31 @@ namespace sylar
 
     static LogIniter __log_init;
 
+    // "1048576", "512K", "64M", "1G"
+    static uint64_t ParseSize(const std::string &str)
+    {
+        char *end = nullptr;
+        uint64_t v = strtoull(str.c_str(), &end, 10);
+        switch (end ? toupper(*end) : 0)
+        {
+        case 'K':
+            return v << 10;
+        case 'M':
+            return v << 20;
+        case 'G':
+            return v << 30;
+        default:
+            return v;
+        }
+    }
+
     template <>
-    class LexicalCast<std::string, LogDefine>
+    class YamlCast<LogDefine>
     {
     public:
-        LogDefine operator()(const std::string &v)
+        LogDefine operator()(const YAML::Node &node)
         {
             LogDefine log;
-            YAML::Node node = YAML::Load(v);
 
             if (!node["name"].IsDefined())
             {
@@ -148,6 +188,69 @@ namespace sylar
                     {
                         ap.type = 2;
                     }
+                    else if (type == "BinaryLogAppender")
+                    {
+                        if (!a["file"].IsDefined())
+                        {
+                            std::cout << "log config error: filename not found " << a << std::endl;
+                            continue;
+                        }
+                        ap.type = 3;
+                        ap.filename = a["file"].as<std::string>();
+                    }
+                    else if (type == "RollingFileLogAppender")
+                    {
+                        if (!a["file"].IsDefined())
+                        {
+                            std::cout << "log config error: filename not found " << a << std::endl;
+                            continue;
+                        }
+                        ap.type = 4;
+                        ap.filename = a["file"].as<std::string>();
+                        if (a["max_size"].IsDefined())
+                        {
+                            ap.max_size = ParseSize(a["max_size"].as<std::string>());
+                        }
+                        if (a["rotate"].IsDefined())
+                        {
+                            ap.rotate = a["rotate"].as<std::string>();
+                        }
+                        if (a["max_files"].IsDefined())
+                        {
+                            ap.max_files = a["max_files"].as<uint32_t>();
+                        }
+                        if (a["compress"].IsDefined())
+                        {
+                            ap.compress = a["compress"].as<bool>();
+                        }
+                    }
+                    else if (type == "JsonLogAppender")
+                    {
+                        // no file: stdout
+                        ap.type = 5;
+                        if (a["file"].IsDefined())
+                        {
+                            ap.filename = a["file"].as<std::string>();
+                        }
+                        if (a["encoding"].IsDefined())
+                        {
+                            ap.encoding = a["encoding"].as<std::string>();
+                        }
+                    }
+                    else if (type == "MmapFileLogAppender")
+                    {
+                        if (!a["file"].IsDefined())
+                        {
+                            std::cout << "log config error: filename not found " << a << std::endl;
+                            continue;
+                        }
+                        ap.type = 6;
+                        ap.filename = a["file"].as<std::string>();
+                        if (a["window_size"].IsDefined())
+                        {
+                            ap.window_size = ParseSize(a["window_size"].as<std::string>());
+                        }
+                    }
                     else
                     {
                         std::cout << "log config error: appender type unknown " << a << std::endl;
@@ -165,6 +268,16 @@ namespace sylar
         }
     };
 
+    template <>
+    class LexicalCast<std::string, LogDefine>
+    {
+    public:
+        LogDefine operator()(const std::string &v)
+        {
+            return YamlCast<LogDefine>()(YAML::Load(v));
+        }
+    };
+
     // template specification for serialization for LogDefine
     template <>
     class LexicalCast<LogDefine, std::string>
@@ -192,6 +305,41 @@ namespace sylar
                 {
                     node_appender["type"] = "StdoutLogAppender";
                 }
+                else if (appender.type == 3)
+                {
+                    node_appender["type"] = "BinaryLogAppender";
+                    node_appender["file"] = appender.filename;
+                }
+                else if (appender.type == 4)
+                {
+                    node_appender["type"] = "RollingFileLogAppender";
+                    node_appender["file"] = appender.filename;
+                    node_appender["max_size"] = appender.max_size;
+                    node_appender["rotate"] = appender.rotate;
+                    node_appender["max_files"] = appender.max_files;
+                    node_appender["compress"] = appender.compress;
+                }
+                else if (appender.type == 5)
+                {
+                    node_appender["type"] = "JsonLogAppender";
+                    if (!appender.filename.empty())
+                    {
+                        node_appender["file"] = appender.filename;
+                    }
+                    if (!appender.encoding.empty())
+                    {
+                        node_appender["encoding"] = appender.encoding;
+                    }
+                }
+                else if (appender.type == 6)
+                {
+                    node_appender["type"] = "MmapFileLogAppender";
+                    node_appender["file"] = appender.filename;
+                    if (appender.window_size)
+                    {
+                        node_appender["window_size"] = appender.window_size;
+                    }
+                }
                 if (appender.level != LogLevel::UNKNOWN)
                 {
                     node_appender["level"] = LogLevel::ToString(appender.level);
@@ -0,0 +1,258 @@
+#include "config_watcher.h"
+#include "config.h"
+#include "log.h"
+
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <string.h>
+#include <algorithm>
+
+namespace sylar
+{
+    static Logger::ptr g_logger = LOG_NAME("system");
+
+    static const uint32_t s_watch_mask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE | IN_DELETE;
+
+    static bool IsYaml(const std::string &name)
+    {
+        auto ends_with = [&name](const std::string &suffix)
+        {
+            return name.size() > suffix.size() && name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0;
+        };
+        return ends_with(".yml") || ends_with(".yaml");
+    }
+
+    ConfigWatcher::ConfigWatcher(IOManager *iom, Scheduler *worker, uint64_t debounce_ms)
+        : m_iom(iom), m_worker(worker ? worker : iom), m_debounceMs(debounce_ms)
+    {
+        m_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (m_fd < 0)
+        {
+            LOG_ERROR(g_logger) << "inotify_init1 failed: " << strerror(errno);
+        }
+    }
+
+    ConfigWatcher::~ConfigWatcher()
+    {
+        stop();
+        if (m_fd >= 0)
+        {
+            close(m_fd);
+        }
+    }
+
+    bool ConfigWatcher::addPath(const std::string &path)
+    {
+        if (m_fd < 0)
+        {
+            return false;
+        }
+
+        Watch watch;
+        struct stat st;
+        if (stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode))
+        {
+            watch.dir = path;
+        }
+        else
+        {
+            size_t pos = path.rfind('/');
+            watch.dir = pos == std::string::npos ? "." : (pos == 0 ? "/" : path.substr(0, pos));
+            watch.file = pos == std::string::npos ? path : path.substr(pos + 1);
+        }
+
+        int wd = inotify_add_watch(m_fd, watch.dir.c_str(), s_watch_mask);
+        if (wd < 0)
+        {
+            LOG_ERROR(g_logger) << "inotify_add_watch(" << watch.dir << ") failed: " << strerror(errno);
+            return false;
+        }
+        MutexType::Lock lock(m_mutex);
+        m_watches[wd].push_back(watch);
+        return true;
+    }
+
+    bool ConfigWatcher::start()
+    {
+        if (m_fd < 0)
+        {
+            return false;
+        }
+        {
+            MutexType::Lock lock(m_mutex);
+            if (!m_stopped)
+            {
+                return true;
+            }
+            m_stopped = false;
+        }
+        bool rt = reload();
+        watch();
+        return rt;
+    }
+
+    void ConfigWatcher::stop()
+    {
+        MutexType::Lock lock(m_mutex);
+        if (m_stopped)
+        {
+            return;
+        }
+        m_stopped = true;
+        if (m_timer)
+        {
+            m_timer->cancel();
+            m_timer = nullptr;
+        }
+        m_iom->delEvent(m_fd, IOManager::READ);
+    }
+
+    void ConfigWatcher::watch()
+    {
+        std::weak_ptr<ConfigWatcher> weak(shared_from_this());
+        m_iom->addEvent(m_fd, IOManager::READ, [weak]()
+                        {
+                            auto self = weak.lock();
+                            if (self)
+                            {
+                                self->onEvent();
+                            } });
+    }
+
+    void ConfigWatcher::onEvent()
+    {
+        MutexType::Lock lock(m_mutex);
+        if (m_stopped)
+        {
+            return;
+        }
+
+        bool changed = false;
+        alignas(struct inotify_event) char buf[4096];
+        ssize_t n;
+        while ((n = read(m_fd, buf, sizeof(buf))) > 0)
+        {
+            for (char *p = buf; p < buf + n;)
+            {
+                struct inotify_event *ev = (struct inotify_event *)p;
+                p += sizeof(struct inotify_event) + ev->len;
+                if (!ev->len)
+                {
+                    continue;
+                }
+                auto it = m_watches.find(ev->wd);
+                if (it == m_watches.end())
+                {
+                    continue;
+                }
+                std::string name(ev->name);
+                for (auto &watch : it->second)
+                {
+                    changed |= watch.file.empty() ? IsYaml(name) : name == watch.file;
+                }
+            }
+        }
+
+        // an editor save is a burst of events, reload once it has settled
+        if (changed && (!m_timer || !m_timer->reset(m_debounceMs, true)))
+        {
+            std::weak_ptr<ConfigWatcher> weak(shared_from_this());
+            m_timer = m_iom->addConditionalTimer(m_debounceMs, [this, weak]()
+                                                 {
+                                                     auto self = weak.lock();
+                                                     if (!self)
+                                                     {
+                                                         return;
+                                                     }
+                                                     {
+                                                         MutexType::Lock lock(m_mutex);
+                                                         m_timer = nullptr;
+                                                     }
+                                                     m_worker->schedule([self]()
+                                                                        { self->reload(); }); },
+                                                 weak);
+        }
+        watch();
+    }
+
+    bool ConfigWatcher::collectFiles(std::vector<std::string> &files)
+    {
+        MutexType::Lock lock(m_mutex);
+        for (auto &i : m_watches)
+        {
+            for (auto &watch : i.second)
+            {
+                if (!watch.file.empty())
+                {
+                    files.push_back(watch.dir + "/" + watch.file);
+                    continue;
+                }
+                DIR *dir = opendir(watch.dir.c_str());
+                if (!dir)
+                {
+                    LOG_ERROR(g_logger) << "opendir(" << watch.dir << ") failed: " << strerror(errno);
+                    continue;
+                }
+                std::vector<std::string> names;
+                struct dirent *ent;
+                while ((ent = readdir(dir)) != nullptr)
+                {
+                    if (IsYaml(ent->d_name))
+                    {
+                        names.push_back(ent->d_name);
+                    }
+                }
+                closedir(dir);
+                std::sort(names.begin(), names.end());
+                for (auto &name : names)
+                {
+                    files.push_back(watch.dir + "/" + name);
+                }
+            }
+        }
+        return !files.empty();
+    }
+
+    bool ConfigWatcher::reload()
+    {
+        MutexType::Lock lock(m_reloadMutex);
+        std::vector<std::string> files;
+        collectFiles(files);
+
+        // parse everything first, a half written file must not apply half a config
+        std::vector<YAML::Node> roots;
+        for (auto &file : files)
+        {
+            if (access(file.c_str(), F_OK) != 0)
+            {
+                continue;
+            }
+            try
+            {
+                roots.push_back(YAML::LoadFile(file));
+            }
+            catch (const std::exception &e)
+            {
+                LOG_ERROR(g_logger) << "config reload: load " << file << " failed: " << e.what();
+                return false;
+            }
+        }
+
+        // later files override earlier ones key by key. loaded as one document so a key set
+        // by several files never flips through the earlier values, and LoadFromYaml skips
+        // the subtrees that did not change since the last load
+        YAML::Node merged;
+        for (auto &root : roots)
+        {
+            merged = Config::MergeYaml(merged, root);
+        }
+        size_t applied = Config::LoadFromYaml(merged);
+        if (applied)
+        {
+            LOG_INFO(g_logger) << "config reload: " << roots.size() << " files, " << applied << " keys applied";
+        }
+        return true;
+    }
+}
@@ -0,0 +1,43 @@
+#include "coroutine.h"
+#include "log.h"
+
+namespace sylar
+{
+    static Logger::ptr g_logger = LOG_NAME("system");
+
+    void ResumeOn(Scheduler *scheduler, std::coroutine_handle<> h)
+    {
+        if (!scheduler)
+        {
+            h.resume();
+            return;
+        }
+        scheduler->schedule(std::function<void()>([h]()
+                                                  { h.resume(); }));
+    }
+
+    void Sleep::await_suspend(std::coroutine_handle<> h)
+    {
+        IOManager *iom = IOManager::GetThis();
+        if (!iom)
+        {
+            LOG_ERROR(g_logger) << "co_await Sleep needs an IOManager, not sleeping";
+            ResumeOn(Scheduler::GetThis(), h);
+            return;
+        }
+        iom->addTimer(ms, [h]()
+                      { h.resume(); });
+    }
+
+    bool WaitEvent::await_suspend(std::coroutine_handle<> h)
+    {
+        IOManager *iom = IOManager::GetThis();
+        if (!iom || iom->addEvent(fd, event, [h]()
+                                  { h.resume(); }))
+        {
+            ok = false;
+            return false;
+        }
+        return true;
+    }
+}
@@ -2,8 +2,12 @@
 #include "config.h"
 #include "log.h"
 #include "macro.h"
+#include "metrics.h"
 #include "scheduler.h"
+#include "util.h"
 #include <atomic>
+#include <linux/mempolicy.h>
+#include <sys/mman.h>
 
 namespace sylar
 {
@@ -11,6 +15,9 @@ namespace sylar
 
     static std::atomic<uint64_t> s_fiber_id{0};
     static std::atomic<uint64_t> s_fiber_count{0};
+    static Counter s_fibers_created("fiber.created");
+    static uint64_t s_total_gauge = Metrics::AddGauge("fiber.total", []()
+                                                      { return (int64_t)Fiber::TotalFibers(); });
 
     // main thread fiber
     static thread_local Fiber *t_fiber = nullptr;
@@ -34,7 +41,48 @@ namespace sylar
         }
     };
 
-    using StackAllocator = MallocStackAllocator;
+    // on a multi node machine the stacks of a pinned thread are bound to its node,
+    // so a fiber created by a worker keeps its stack local to that worker
+    class NumaStackAllocator
+    {
+    public:
+        static void *Alloc(size_t size)
+        {
+            if (!s_numa)
+            {
+                return MallocStackAllocator::Alloc(size);
+            }
+            void *vp = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (vp == MAP_FAILED)
+            {
+                return nullptr;
+            }
+            int node = GetThreadNumaNode();
+            if (node >= 0 && node < 64)
+            {
+                unsigned long mask = 1ul << node;
+                syscall(SYS_mbind, vp, size, MPOL_PREFERRED, &mask, sizeof(mask) * 8, 0);
+            }
+            return vp;
+        }
+
+        static void Dealloc(void *vp, size_t size)
+        {
+            if (!s_numa)
+            {
+                MallocStackAllocator::Dealloc(vp, size);
+                return;
+            }
+            munmap(vp, size);
+        }
+
+    private:
+        static const bool s_numa;
+    };
+
+    const bool NumaStackAllocator::s_numa = GetNumaNodeCount() > 1;
+
+    using StackAllocator = NumaStackAllocator;
 
     // default constructor only used by default fiber
     Fiber::Fiber()
@@ -59,6 +107,7 @@ namespace sylar
         m_stacksize = stacksize ? stacksize : g_fiber_stack_size->getValue();
 
         m_stack = StackAllocator::Alloc(m_stacksize);
+        s_fibers_created.inc();
         if (getcontext(&m_ctx) != 0)
         {
             _ASSERT2(false, "getcontext");
@@ -81,6 +130,7 @@ namespace sylar
 
     Fiber::~Fiber()
     {
+        clearLocals();
         if (m_stack)
         {
             _ASSERT(m_state == TERM || m_state == INIT || m_state == EXCEPT);
@@ -106,6 +156,7 @@ namespace sylar
     {
         _ASSERT(m_stack);
         _ASSERT(m_state == TERM || m_state == INIT || m_state == EXCEPT);
+        clearLocals();
 
         m_cb = cb;
         m_ctx = ucontext_t();
@@ -172,25 +223,35 @@ namespace sylar
     {
         if (t_fiber)
         {
-            return t_fiber->shared_from_this();
+            return Fiber::ptr(t_fiber);
         }
         Fiber::ptr main_fiber(new Fiber);
         _ASSERT(t_fiber == main_fiber.get());
         t_threadFiber = main_fiber;
-        return t_fiber->shared_from_this();
+        return main_fiber;
+    }
+
+    Fiber *Fiber::GetThisRaw()
+    {
+        return t_fiber;
     }
 
+    // the yields borrow t_fiber: the scheduler keeps the fiber alive until it is switched out
     void Fiber::YieldToReady()
     {
-        Fiber::ptr cur = GetThis();
-        cur->m_state = READY;
+        Fiber *cur = t_fiber ? t_fiber : GetThis().get();
+        cur->m_state.store(READY, std::memory_order_release);
         cur->swapOut();
     }
 
     void Fiber::YieldToHold()
     {
-        Fiber::ptr cur = GetThis();
-        cur->m_state = HOLD;
+        Fiber *cur = t_fiber ? t_fiber : GetThis().get();
+        // stays EXEC until Scheduler::run marks it HOLD, the scheduler skips EXEC fibers
+        if (!Scheduler::GetThis())
+        {
+            cur->m_state.store(HOLD, std::memory_order_release);
+        }
         cur->swapOut();
     }
 
@@ -199,9 +260,50 @@ namespace sylar
         return s_fiber_count;
     }
 
+    static std::atomic<size_t> s_local_keys{0};
+    static void (*s_local_deleters[Fiber::MAX_LOCALS])(void *) = {};
+
+    size_t Fiber::AllocLocalKey(void (*deleter)(void *))
+    {
+        size_t key = s_local_keys++;
+        if (key >= MAX_LOCALS)
+        {
+            throw std::logic_error("too many FiberLocal objects, raise Fiber::MAX_LOCALS");
+        }
+        s_local_deleters[key] = deleter;
+        return key;
+    }
+
+    void *&Fiber::GetLocalSlot(size_t key)
+    {
+        Fiber *cur = t_fiber ? t_fiber : GetThis().get();
+        cur->m_hasLocals = true;
+        return cur->m_locals[key];
+    }
+
+    void Fiber::clearLocals()
+    {
+        // a destructor may touch another FiberLocal and create it again, a few rounds
+        // like pthread keys then give up
+        for (int round = 0; round < 4 && m_hasLocals; ++round)
+        {
+            m_hasLocals = false;
+            for (size_t i = 0; i < MAX_LOCALS; ++i)
+            {
+                if (m_locals[i])
+                {
+                    void *v = m_locals[i];
+                    m_locals[i] = nullptr;
+                    s_local_deleters[i](v);
+                }
+            }
+        }
+    }
+
     void Fiber::MainFunc()
     {
-        Fiber::ptr cur = Fiber::GetThis();
+        // borrowed, holding a reference here would keep a finished fiber alive forever
+        Fiber *cur = t_fiber;
         _ASSERT(cur);
         try
         {
@@ -224,16 +326,17 @@ namespace sylar
                                 << sylar::BacktraceToString(20);
         }
 
-        auto raw_ptr = cur.get();
-        cur.reset();
-        raw_ptr->swapOut();
+        // destructors of fiber locals still run on this fiber
+        cur->clearLocals();
+        cur->swapOut();
 
-        _ASSERT2(false, "never reach, fiber=" + std::to_string(raw_ptr->GetFiberId()));
+        _ASSERT2(false, "never reach, fiber=" + std::to_string(cur->GetFiberId()));
     }
 
     void Fiber::CallerMainFunc()
     {
-        Fiber::ptr cur = Fiber::GetThis();
+        // borrowed, holding a reference here would keep a finished fiber alive forever
+        Fiber *cur = t_fiber;
         _ASSERT(cur);
         try
         {
@@ -256,11 +359,11 @@ namespace sylar
                                 << sylar::BacktraceToString(20);
         }
 
-        auto raw_ptr = cur.get();
-        cur.reset();
-        raw_ptr->back();
+        // destructors of fiber locals still run on this fiber
+        cur->clearLocals();
+        cur->back();
 
-        _ASSERT2(false, "never reach, fiber=" + std::to_string(raw_ptr->GetFiberId()));
+        _ASSERT2(false, "never reach, fiber=" + std::to_string(cur->GetFiberId()));
     }
 
     uint64_t Fiber::GetFiberId()
@@ -0,0 +1,204 @@
+#include "fiber_sync.h"
+#include "scheduler.h"
+
+namespace sylar
+{
+    void FiberWaiter::init(Semaphore *s)
+    {
+        Scheduler *cur_scheduler = Scheduler::GetThis();
+        Fiber *cur = Fiber::GetThisRaw();
+        if (cur_scheduler && cur && !cur->isThreadMain() && cur != Scheduler::GetMainFiber())
+        {
+            scheduler = cur_scheduler;
+            fiber = Fiber::ptr(cur);
+            ++scheduler->m_parkedFibers;
+        }
+        else
+        {
+            sem = s;
+        }
+    }
+
+    void FiberWaiter::initCallback(std::function<void()> f)
+    {
+        cb = std::move(f);
+        scheduler = Scheduler::GetThis();
+        if (scheduler)
+        {
+            ++scheduler->m_parkedFibers;
+        }
+    }
+
+    void FiberWaiter::release()
+    {
+        if (fiber)
+        {
+            fiber.reset();
+            --scheduler->m_parkedFibers;
+        }
+        else if (cb && scheduler)
+        {
+            cb = nullptr;
+            --scheduler->m_parkedFibers;
+        }
+    }
+
+    void FiberWaiter::sleep()
+    {
+        if (sem)
+        {
+            sem->wait();
+        }
+        else
+        {
+            Fiber::YieldToHold();
+        }
+    }
+
+    void FiberWaiter::wake()
+    {
+        if (cb)
+        {
+            Scheduler *target = scheduler;
+            std::function<void()> f;
+            f.swap(cb);
+            f();
+            if (target)
+            {
+                --target->m_parkedFibers;
+            }
+        }
+        else if (sem)
+        {
+            sem->notify();
+        }
+        else
+        {
+            // may still be switching out on its thread, the scheduler skips it until it has
+            // back at the priority it blocked at
+            Scheduler *target = scheduler;
+            Scheduler::Priority priority = (Scheduler::Priority)fiber->getPriority();
+            target->schedule(&fiber, -1, priority);
+            --target->m_parkedFibers;
+        }
+    }
+
+    void FiberWaiter::Park(std::list<FiberWaiter> &q, MutexType::Lock &lock)
+    {
+        // sem_post is safe against the waiter destroying sem right after it wakes
+        Semaphore sem;
+        FiberWaiter waiter;
+        waiter.init(&sem);
+        q.push_back(std::move(waiter));
+        lock.unlock();
+        waiter.sleep();
+    }
+
+    void FiberMutex::lockSlow()
+    {
+        FiberWaiter::MutexType::Lock lock(m_mutex);
+        uint32_t c = m_state.load(std::memory_order_relaxed);
+        while (true)
+        {
+            if (c == 0)
+            {
+                if (m_state.compare_exchange_weak(c, 1, std::memory_order_acquire, std::memory_order_relaxed))
+                {
+                    return;
+                }
+                continue;
+            }
+            // from now on unlock has to take m_mutex and look at the queue
+            if (c == 2 || m_state.compare_exchange_weak(c, 2, std::memory_order_relaxed, std::memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        // unlockSlow handed the lock over before waking us
+        FiberWaiter::Park(m_waiters, lock);
+        std::atomic_thread_fence(std::memory_order_acquire);
+    }
+
+    void FiberMutex::unlockSlow()
+    {
+        FiberWaiter::MutexType::Lock lock(m_mutex);
+        FiberWaiter waiter = std::move(m_waiters.front());
+        m_waiters.pop_front();
+        // the lock stays held, it now belongs to waiter
+        m_state.store(m_waiters.empty() ? 1 : 2, std::memory_order_release);
+        lock.unlock();
+        waiter.wake();
+    }
+
+    void FiberConditionVariable::wait(FiberMutex &mutex)
+    {
+        FiberWaiter::MutexType::Lock lock(m_mutex);
+        m_waiting.fetch_add(1, std::memory_order_seq_cst);
+        // queued before the mutex is released, a notify after that finds us
+        mutex.unlock();
+        FiberWaiter::Park(m_waiters, lock);
+        mutex.lock();
+    }
+
+    void FiberConditionVariable::wait(FiberMutex::Lock &lock)
+    {
+        FiberWaiter::MutexType::Lock guard(m_mutex);
+        m_waiting.fetch_add(1, std::memory_order_seq_cst);
+        lock.unlock();
+        FiberWaiter::Park(m_waiters, guard);
+        lock.lock();
+    }
+
+    void FiberConditionVariable::notifySlow(bool all)
+    {
+        std::list<FiberWaiter> waiters;
+        {
+            FiberWaiter::MutexType::Lock lock(m_mutex);
+            if (m_waiters.empty())
+            {
+                return;
+            }
+            if (all)
+            {
+                waiters.swap(m_waiters);
+            }
+            else
+            {
+                waiters.splice(waiters.end(), m_waiters, m_waiters.begin());
+            }
+            m_waiting.fetch_sub(waiters.size(), std::memory_order_relaxed);
+        }
+        for (auto &i : waiters)
+        {
+            i.wake();
+        }
+    }
+
+    void FiberSemaphore::waitSlow()
+    {
+        FiberWaiter::MutexType::Lock lock(m_mutex);
+        m_waiting.fetch_add(1, std::memory_order_seq_cst);
+        // a notify that missed m_waiting left its count behind
+        if (tryWait())
+        {
+            m_waiting.fetch_sub(1, std::memory_order_relaxed);
+            return;
+        }
+        // notifySlow took a count for us before waking us
+        FiberWaiter::Park(m_waiters, lock);
+    }
+
+    void FiberSemaphore::notifySlow()
+    {
+        FiberWaiter::MutexType::Lock lock(m_mutex);
+        if (m_waiters.empty() || !tryWait())
+        {
+            return;
+        }
+        FiberWaiter waiter = std::move(m_waiters.front());
+        m_waiters.pop_front();
+        m_waiting.fetch_sub(1, std::memory_order_relaxed);
+        lock.unlock();
+        waiter.wake();
+    }
+}
@@ -0,0 +1,207 @@
+#include "future.h"
+#include "log.h"
+
+namespace sylar
+{
+    static Logger::ptr g_logger = LOG_NAME("system");
+
+    bool FutureStateBase::wait(uint64_t timeout_ms)
+    {
+        if (isReady())
+        {
+            return true;
+        }
+        ChannelWaiter::ptr waiter(new ChannelWaiter);
+        {
+            MutexType::Lock lock(m_mutex);
+            if (isReady())
+            {
+                return true;
+            }
+            m_waiters.push_back(waiter);
+        }
+        if (waiter->wait(timeout_ms) == 0)
+        {
+            return true;
+        }
+        MutexType::Lock lock(m_mutex);
+        m_waiters.remove(waiter);
+        return isReady();
+    }
+
+    void FutureStateBase::setException(std::exception_ptr e)
+    {
+        MutexType::Lock lock(m_mutex);
+        checkUnset(lock);
+        m_error = e;
+        finish(lock);
+    }
+
+    void FutureStateBase::checkUnset(MutexType::Lock &lock)
+    {
+        if (isReady())
+        {
+            lock.unlock();
+            throw std::logic_error("promise already satisfied");
+        }
+    }
+
+    bool FutureStateBase::park(const ChannelWaiter::ptr &waiter)
+    {
+        MutexType::Lock lock(m_mutex);
+        if (isReady())
+        {
+            return false;
+        }
+        m_waiters.push_back(waiter);
+        return true;
+    }
+
+    void FutureStateBase::finish(MutexType::Lock &lock)
+    {
+        std::list<ChannelWaiter::ptr> waiters;
+        waiters.swap(m_waiters);
+        m_ready.store(true, std::memory_order_release);
+        lock.unlock();
+        for (auto &i : waiters)
+        {
+            if (i->claim(0))
+            {
+                i->wake();
+            }
+        }
+    }
+
+    TaskGroup::TaskGroup(Scheduler *scheduler, TaskGroup *parent)
+        : m_scheduler(scheduler ? scheduler : Scheduler::GetThis()), m_parent(parent)
+    {
+        if (m_parent)
+        {
+            FiberMutex::Lock lock(m_parent->m_mutex);
+            m_parent->m_children.push_back(this);
+            m_cancelled = m_parent->isCancelled();
+        }
+    }
+
+    TaskGroup::~TaskGroup()
+    {
+        try
+        {
+            join();
+        }
+        catch (const std::exception &e)
+        {
+            LOG_ERROR(g_logger) << "TaskGroup dropped task exception: " << e.what();
+        }
+        catch (...)
+        {
+            LOG_ERROR(g_logger) << "TaskGroup dropped task exception";
+        }
+        if (m_parent)
+        {
+            FiberMutex::Lock lock(m_parent->m_mutex);
+            m_parent->m_children.remove(this);
+        }
+    }
+
+    void TaskGroup::spawn(std::function<void()> cb)
+    {
+        if (isCancelled())
+        {
+            return;
+        }
+        {
+            FiberMutex::Lock lock(m_mutex);
+            ++m_pending;
+        }
+        m_scheduler->schedule(std::function<void()>([this, cb]()
+                                                    {
+                                                        std::exception_ptr error;
+                                                        if (!isCancelled())
+                                                        {
+                                                            try
+                                                            {
+                                                                cb();
+                                                            }
+                                                            catch (...)
+                                                            {
+                                                                error = std::current_exception();
+                                                            }
+                                                        }
+                                                        taskDone(error); }));
+    }
+
+    void TaskGroup::taskDone(std::exception_ptr error)
+    {
+        if (error)
+        {
+            {
+                FiberMutex::Lock lock(m_mutex);
+                if (!m_error)
+                {
+                    m_error = error;
+                }
+            }
+            cancel();
+        }
+        FiberMutex::Lock lock(m_mutex);
+        if (--m_pending == 0)
+        {
+            m_cond.notifyAll();
+        }
+    }
+
+    void TaskGroup::join()
+    {
+        FiberMutex::Lock lock(m_mutex);
+        m_cond.wait(lock, [this]()
+                    { return m_pending == 0; });
+        if (m_error)
+        {
+            std::exception_ptr error;
+            error.swap(m_error);
+            lock.unlock();
+            std::rethrow_exception(error);
+        }
+    }
+
+    void TaskGroup::cancel()
+    {
+        std::list<std::function<void()>> cbs;
+        {
+            FiberMutex::Lock lock(m_mutex);
+            if (m_cancelled.exchange(true))
+            {
+                return;
+            }
+            cbs.swap(m_cancelCbs);
+            // children unregister under m_mutex, they stay alive while it is held
+            for (auto child : m_children)
+            {
+                child->cancel();
+            }
+        }
+        for (auto &cb : cbs)
+        {
+            cb();
+        }
+    }
+
+    bool TaskGroup::isCancelled() const
+    {
+        return m_cancelled.load(std::memory_order_acquire);
+    }
+
+    void TaskGroup::onCancel(std::function<void()> cb)
+    {
+        {
+            FiberMutex::Lock lock(m_mutex);
+            if (!isCancelled())
+            {
+                m_cancelCbs.push_back(std::move(cb));
+                return;
+            }
+        }
+        cb();
+    }
+}
@@ -149,8 +149,8 @@ retry:
         if (rt)
         {
             // timer add failed
-            LOG_ERROR(g_logger) << hook_fun_name << " addEvent("
-                                << fd << ", " << event << ")";
+            LOG_ERROR_PER_SEC(g_logger, 10) << hook_fun_name << " addEvent("
+                                            << fd << ", " << event << ")";
             if (timer)
             {
                 timer->cancel();
@@ -196,8 +196,10 @@ extern "C"
         sylar::Fiber::ptr fiber = sylar::Fiber::GetThis();
         sylar::IOManager *iom = sylar::IOManager::GetThis();
         // iom->addTimer(seconds * 1000, std::bind(&sylar::IOManager::schedule, iom, fiber));
-        iom->addTimer(seconds * 1000, [iom, fiber]()
-                      { iom->schedule(fiber); });
+        // the sleeper wakes at the priority it was running at
+        sylar::Scheduler::Priority priority = (sylar::Scheduler::Priority)fiber->getPriority();
+        iom->addTimer(seconds * 1000, [iom, fiber, priority]() mutable
+                      { iom->schedule(&fiber, -1, priority); });
         sylar::Fiber::YieldToHold();
         return 0;
     }
@@ -211,8 +213,9 @@ extern "C"
         sylar::Fiber::ptr fiber = sylar::Fiber::GetThis();
         sylar::IOManager *iom = sylar::IOManager::GetThis();
         // iom->addTimer(seconds / 1000, std::bind(&sylar::IOManager::schedule, iom, fiber));
-        iom->addTimer(usec / 1000, [iom, fiber]()
-                      { iom->schedule(fiber); });
+        sylar::Scheduler::Priority priority = (sylar::Scheduler::Priority)fiber->getPriority();
+        iom->addTimer(usec / 1000, [iom, fiber, priority]() mutable
+                      { iom->schedule(&fiber, -1, priority); });
         sylar::Fiber::YieldToHold();
         return 0;
     }
@@ -228,8 +231,9 @@ extern "C"
         sylar::Fiber::ptr fiber = sylar::Fiber::GetThis();
         sylar::IOManager *iom = sylar::IOManager::GetThis();
 
-        iom->addTimer(timeout_ms, [iom, fiber]()
-                      { iom->schedule(fiber); });
+        sylar::Scheduler::Priority priority = (sylar::Scheduler::Priority)fiber->getPriority();
+        iom->addTimer(timeout_ms, [iom, fiber, priority]() mutable
+                      { iom->schedule(&fiber, -1, priority); });
         sylar::Fiber::YieldToHold();
         return 0;
     }
@@ -0,0 +1,345 @@
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <list>
+#include <memory>
+#include <vector>
+#include "fiber_sync.h"
+#include "mutex.h"
+#include "timer.h"
+
+namespace sylar
+{
+    template <class T>
+    class ChannelPopAwaiter;
+    template <class T>
+    class ChannelPushAwaiter;
+
+    // one blocked push/pop/select. the first channel (or the timeout) that claims it
+    // completes the operation for it and wakes it, every other registration is stale
+    class ChannelWaiter : public std::enable_shared_from_this<ChannelWaiter>, eve::Noncopyable
+    {
+    public:
+        typedef std::shared_ptr<ChannelWaiter> ptr;
+
+        // captures the calling fiber
+        ChannelWaiter();
+        // wake() runs cb instead, wait() must not be used
+        ChannelWaiter(std::function<void()> cb);
+        ~ChannelWaiter();
+
+        bool claim(int index)
+        {
+            int expected = NONE;
+            return m_fired.compare_exchange_strong(expected, index, std::memory_order_acq_rel);
+        }
+
+        int fired() const { return m_fired.load(std::memory_order_acquire); }
+
+        void wake() { m_waiter.wake(); }
+
+        // parks until claimed, returns the claimed index or TIMEOUT.
+        // timeouts are timers on the current IOManager, ~0ull waits forever
+        int wait(uint64_t timeout_ms);
+
+    public:
+        static const int NONE = -2;
+        static const int TIMEOUT = -1;
+
+    private:
+        std::atomic<int> m_fired{NONE};
+        FiberWaiter m_waiter;
+        Semaphore m_sem;
+    };
+
+    // typed fifo between fibers. push parks while a bounded channel is full, pop parks while it is empty.
+    // capacity 0 means unbounded. once closed, push fails and pop drains what is left and then fails.
+    // a value is handed straight to a parked receiver without going through the queue
+    template <class T>
+    class Channel : eve::Noncopyable
+    {
+    public:
+        typedef std::shared_ptr<Channel> ptr;
+        typedef DefaultMutex MutexType;
+
+        Channel(size_t capacity = 0) : m_capacity(capacity) {}
+
+        ~Channel()
+        {
+            close();
+        }
+
+        // false when the channel is closed, or after timeout_ms
+        bool push(T v, uint64_t timeout_ms = ~0ull)
+        {
+            bool ok = false;
+            if (startPush(v, ok, nullptr, 0))
+            {
+                return ok;
+            }
+            ChannelWaiter::ptr waiter(new ChannelWaiter);
+            if (!startPush(v, ok, waiter, 0) && waiter->wait(timeout_ms) != 0)
+            {
+                cancel(waiter);
+                return false;
+            }
+            return ok;
+        }
+
+        bool tryPush(T v)
+        {
+            bool ok = false;
+            return startPush(v, ok, nullptr, 0) && ok;
+        }
+
+        // false when the channel is closed and drained, or after timeout_ms
+        bool pop(T &v, uint64_t timeout_ms = ~0ull)
+        {
+            bool ok = false;
+            if (startPop(v, ok, nullptr, 0))
+            {
+                return ok;
+            }
+            ChannelWaiter::ptr waiter(new ChannelWaiter);
+            if (!startPop(v, ok, waiter, 0) && waiter->wait(timeout_ms) != 0)
+            {
+                cancel(waiter);
+                return false;
+            }
+            return ok;
+        }
+
+        bool tryPop(T &v)
+        {
+            bool ok = false;
+            return startPop(v, ok, nullptr, 0) && ok;
+        }
+
+        // wakes every parked fiber, their push/pop return false
+        void close()
+        {
+            std::list<Entry> entries;
+            {
+                MutexType::Lock lock(m_mutex);
+                if (m_closed)
+                {
+                    return;
+                }
+                m_closed = true;
+                entries.swap(m_recvq);
+                entries.splice(entries.end(), m_sendq);
+            }
+            for (auto &e : entries)
+            {
+                if (e.waiter->claim(e.index))
+                {
+                    *e.ok = false;
+                    e.waiter->wake();
+                }
+            }
+        }
+
+        bool isClosed()
+        {
+            MutexType::Lock lock(m_mutex);
+            return m_closed;
+        }
+
+        size_t size()
+        {
+            MutexType::Lock lock(m_mutex);
+            return m_queue.size();
+        }
+
+        size_t capacity() const { return m_capacity; }
+
+    private:
+        friend class ChannelSelect;
+        template <class U>
+        friend class ChannelPopAwaiter;
+        template <class U>
+        friend class ChannelPushAwaiter;
+
+        // a parked push (slot is the value to send) or pop (slot receives the value)
+        struct Entry
+        {
+            ChannelWaiter::ptr waiter;
+            int index;
+            T *slot;
+            bool *ok;
+        };
+
+        // completes the push now and returns true, or queues waiter as case index and returns false.
+        // without a waiter nothing is queued. when waiter was already claimed by another case nothing is done
+        bool startPush(T &v, bool &ok, const ChannelWaiter::ptr &waiter, int index)
+        {
+            Entry receiver{nullptr, 0, nullptr, nullptr};
+            {
+                MutexType::Lock lock(m_mutex);
+                if (!m_closed && m_capacity && m_queue.size() >= m_capacity)
+                {
+                    if (waiter)
+                    {
+                        m_sendq.push_back(Entry{waiter, index, &v, &ok});
+                    }
+                    return false;
+                }
+                if (waiter && !waiter->claim(index))
+                {
+                    return true;
+                }
+                if (m_closed)
+                {
+                    ok = false;
+                    return true;
+                }
+                ok = true;
+                // receivers only wait on an empty queue
+                while (!m_recvq.empty())
+                {
+                    Entry e = std::move(m_recvq.front());
+                    m_recvq.pop_front();
+                    if (e.waiter->claim(e.index))
+                    {
+                        receiver = std::move(e);
+                        break;
+                    }
+                }
+                if (!receiver.waiter)
+                {
+                    m_queue.push_back(std::move(v));
+                    return true;
+                }
+            }
+            *receiver.slot = std::move(v);
+            *receiver.ok = true;
+            receiver.waiter->wake();
+            return true;
+        }
+
+        bool startPop(T &v, bool &ok, const ChannelWaiter::ptr &waiter, int index)
+        {
+            Entry sender{nullptr, 0, nullptr, nullptr};
+            {
+                MutexType::Lock lock(m_mutex);
+                if (m_queue.empty() && !m_closed)
+                {
+                    if (waiter)
+                    {
+                        m_recvq.push_back(Entry{waiter, index, &v, &ok});
+                    }
+                    return false;
+                }
+                if (waiter && !waiter->claim(index))
+                {
+                    return true;
+                }
+                if (m_queue.empty())
+                {
+                    ok = false;
+                    return true;
+                }
+                v = std::move(m_queue.front());
+                m_queue.pop_front();
+                ok = true;
+                // senders only wait on a full queue, move the first one in
+                while (!m_sendq.empty())
+                {
+                    Entry e = std::move(m_sendq.front());
+                    m_sendq.pop_front();
+                    if (e.waiter->claim(e.index))
+                    {
+                        m_queue.push_back(std::move(*e.slot));
+                        *e.ok = true;
+                        sender = std::move(e);
+                        break;
+                    }
+                }
+            }
+            if (sender.waiter)
+            {
+                sender.waiter->wake();
+            }
+            return true;
+        }
+
+        // drops the registrations of a waiter that finished elsewhere
+        void cancel(const ChannelWaiter::ptr &waiter)
+        {
+            MutexType::Lock lock(m_mutex);
+            auto pred = [&waiter](const Entry &e)
+            { return e.waiter == waiter; };
+            m_recvq.remove_if(pred);
+            m_sendq.remove_if(pred);
+        }
+
+    private:
+        size_t m_capacity;
+        bool m_closed{false};
+        MutexType m_mutex;
+        std::deque<T> m_queue;
+        std::list<Entry> m_recvq;
+        std::list<Entry> m_sendq;
+    };
+
+    // waits on several channel operations at once, like go's select.
+    // exactly one case fires, cases are tried in the order they were added. a select is used once
+    //   ChannelSelect sel;
+    //   sel.recv(a, x).recv(b, y);
+    //   int i = sel.wait(100);  // 0, 1 or ChannelWaiter::TIMEOUT
+    class ChannelSelect : eve::Noncopyable
+    {
+    public:
+        template <class T>
+        ChannelSelect &recv(Channel<T> &ch, T &v)
+        {
+            bool *ok = addOk();
+            m_cases.push_back(Case{[&ch, &v, ok](const ChannelWaiter::ptr &waiter, int index)
+                                   { return ch.startPop(v, *ok, waiter, index); },
+                                   [&ch](const ChannelWaiter::ptr &waiter)
+                                   { ch.cancel(waiter); }});
+            return *this;
+        }
+
+        template <class T>
+        ChannelSelect &send(Channel<T> &ch, T v)
+        {
+            bool *ok = addOk();
+            std::shared_ptr<T> value(new T(std::move(v)));
+            m_cases.push_back(Case{[&ch, value, ok](const ChannelWaiter::ptr &waiter, int index)
+                                   { return ch.startPush(*value, *ok, waiter, index); },
+                                   [&ch](const ChannelWaiter::ptr &waiter)
+                                   { ch.cancel(waiter); }});
+            return *this;
+        }
+
+        // index of the case that fired, TIMEOUT after timeout_ms
+        int wait(uint64_t timeout_ms = ~0ull);
+
+        // index of a case that could fire right away, TIMEOUT when none can
+        int tryWait();
+
+        // whether the fired case transferred a value, false when its channel was closed
+        bool ok(int index) const { return m_oks[index]; }
+
+    private:
+        struct Case
+        {
+            std::function<bool(const ChannelWaiter::ptr &, int)> start;
+            std::function<void(const ChannelWaiter::ptr &)> cancel;
+        };
+
+        bool *addOk()
+        {
+            m_oks.push_back(false);
+            return &m_oks.back();
+        }
+
+    private:
+        std::vector<Case> m_cases;
+        // deque keeps the addresses handed to the cases stable
+        std::deque<bool> m_oks;
+    };
+}
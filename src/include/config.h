@@ -12,6 +12,7 @@
 #include <yaml-cpp/yaml.h>
 #include "log.h"
 #include "mutex.h"
+#include "rcu.h"
 
 namespace sylar
 {
@@ -36,11 +37,69 @@ namespace sylar
 
         virtual bool fromString(const std::string &val) = 0;
 
+        // set from a parsed node, the default prints the node and goes through fromString
+        virtual bool fromYaml(const YAML::Node &node)
+        {
+            if (node.IsScalar())
+            {
+                return fromString(node.Scalar());
+            }
+            std::stringstream ss;
+            ss << node;
+            return fromString(ss.str());
+        }
+
         virtual std::string getTypeName() const = 0;
 
+        // identifies the value type without rtti, see ConfigVar<T>::TypeTag
+        const void *getTypeTag() const { return m_typeTag; }
+
     protected:
         std::string m_name;
         std::string m_description;
+        const void *m_typeTag = nullptr;
+    };
+
+    // open addressing hash table of config vars keyed by name.
+    // the name is not copied, slots point at the var that owns it
+    class ConfigVarMap
+    {
+    public:
+        ConfigVarMap();
+
+        ConfigVarBase::ptr find(const std::string &name) const;
+
+        // replaces a var with the same name
+        void insert(ConfigVarBase::ptr var);
+
+        size_t size() const { return m_size; }
+
+        template <class F>
+        void forEach(F &&cb) const
+        {
+            for (auto &slot : m_slots)
+            {
+                if (slot.var)
+                {
+                    cb(slot.var);
+                }
+            }
+        }
+
+    private:
+        struct Slot
+        {
+            size_t hash = 0;
+            ConfigVarBase::ptr var;
+        };
+
+        // slot holding name, or the empty slot where it belongs
+        size_t probe(const std::string &name, size_t hash) const;
+        void rehash(size_t capacity);
+
+    private:
+        std::vector<Slot> m_slots;
+        size_t m_size = 0;
     };
 
     // F: from type, T: to type
@@ -287,6 +346,115 @@ namespace sylar
         }
     };
 
+    // converts a yaml node straight to T, used by Config::LoadFromYaml.
+    // scalars and types without a specialization go through LexicalCast,
+    // containers convert element by element without printing and re-parsing yaml
+    template <class T>
+    class YamlCast
+    {
+    public:
+        T operator()(const YAML::Node &node)
+        {
+            if (node.IsScalar())
+            {
+                return LexicalCast<std::string, T>()(node.Scalar());
+            }
+            std::stringstream ss;
+            ss << node;
+            return LexicalCast<std::string, T>()(ss.str());
+        }
+    };
+
+    template <class T>
+    class YamlCast<std::vector<T>>
+    {
+    public:
+        std::vector<T> operator()(const YAML::Node &node)
+        {
+            std::vector<T> vec;
+            for (size_t i = 0; i < node.size(); ++i)
+            {
+                vec.push_back(YamlCast<T>()(node[i]));
+            }
+            return vec;
+        }
+    };
+
+    template <class T>
+    class YamlCast<std::list<T>>
+    {
+    public:
+        std::list<T> operator()(const YAML::Node &node)
+        {
+            std::list<T> vec;
+            for (size_t i = 0; i < node.size(); ++i)
+            {
+                vec.push_back(YamlCast<T>()(node[i]));
+            }
+            return vec;
+        }
+    };
+
+    template <class T>
+    class YamlCast<std::set<T>>
+    {
+    public:
+        std::set<T> operator()(const YAML::Node &node)
+        {
+            std::set<T> vec;
+            for (size_t i = 0; i < node.size(); ++i)
+            {
+                vec.insert(YamlCast<T>()(node[i]));
+            }
+            return vec;
+        }
+    };
+
+    template <class T>
+    class YamlCast<std::unordered_set<T>>
+    {
+    public:
+        std::unordered_set<T> operator()(const YAML::Node &node)
+        {
+            std::unordered_set<T> vec;
+            for (size_t i = 0; i < node.size(); ++i)
+            {
+                vec.insert(YamlCast<T>()(node[i]));
+            }
+            return vec;
+        }
+    };
+
+    template <class T>
+    class YamlCast<std::map<std::string, T>>
+    {
+    public:
+        std::map<std::string, T> operator()(const YAML::Node &node)
+        {
+            std::map<std::string, T> m;
+            for (auto it = node.begin(); it != node.end(); ++it)
+            {
+                m.insert(std::make_pair(it->first.Scalar(), YamlCast<T>()(it->second)));
+            }
+            return m;
+        }
+    };
+
+    template <class T>
+    class YamlCast<std::unordered_map<std::string, T>>
+    {
+    public:
+        std::unordered_map<std::string, T> operator()(const YAML::Node &node)
+        {
+            std::unordered_map<std::string, T> m;
+            for (auto it = node.begin(); it != node.end(); ++it)
+            {
+                m.insert(std::make_pair(it->first.Scalar(), YamlCast<T>()(it->second)));
+            }
+            return m;
+        }
+    };
+
     // FromStr : T operator(const std::string &)
     // ToStr : std::string operator() (const T&)
     template <class T,
@@ -299,21 +467,43 @@ namespace sylar
         typedef std::function<void(const T &old_value, const T &new_value)> on_change_cb;
         typedef RWMutex RWMutexType;
 
+        // borrowed view of the current value, no copy and no lock.
+        // keep it short lived: it holds a Rcu read section, so it must not outlive a fiber switch
+        class Handle : Rcu::ReadLock
+        {
+        public:
+            Handle(const ConfigVar &var) : m_val(var.m_val.get()) {}
+            const T &operator*() const { return *m_val; }
+            const T *operator->() const { return m_val; }
+
+        private:
+            const T *m_val;
+        };
+
         ConfigVar(const std::string &name, const T &default_value, const std::string &description = "")
-            : ConfigVarBase(name, description), m_val(default_value) {}
+            : ConfigVarBase(name, description), m_val(new T(default_value))
+        {
+            m_typeTag = TypeTag();
+        }
+
+        // one address per T, compared instead of dynamic_pointer_cast
+        static const void *TypeTag()
+        {
+            static const char s_tag = 0;
+            return &s_tag;
+        }
 
         std::string toString() override
         {
             try
             {
                 // return boost::lexical_cast<std::string>(m_val);
-                RWMutexType::ReadLock lock(m_mutex);
-                return ToStr()(m_val);
+                return ToStr()(*read());
             }
             catch (const std::exception &e)
             {
                 LOG_ERROR(LOG_ROOT()) << "ConfigVar::toString exception" << e.what()
-                                      << " convert: " << typeid(m_val).name() << " to string";
+                                      << " convert: " << typeid(T).name() << " to string";
             }
 
             return "";
@@ -324,34 +514,68 @@ namespace sylar
             {
                 // m_val = boost::lexical_cast<T>(val);
                 setValue(FromStr()(val));
+                return true;
             }
             catch (std::exception &e)
             {
                 LOG_ERROR(LOG_ROOT()) << "ConfigVar::fromString exception" << e.what()
-                                      << " convert string to" << typeid(m_val).name();
+                                      << " convert string to" << typeid(T).name();
             }
             return false;
         }
 
-        const T getValue()
+        bool fromYaml(const YAML::Node &node) override
         {
-            RWMutexType::ReadLock lock(m_mutex);
-            return m_val;
+            // a custom FromStr only understands strings
+            if constexpr (!std::is_same<FromStr, LexicalCast<std::string, T>>::value)
+            {
+                return ConfigVarBase::fromYaml(node);
+            }
+            else
+            {
+                try
+                {
+                    setValue(YamlCast<T>()(node));
+                    return true;
+                }
+                catch (std::exception &e)
+                {
+                    LOG_ERROR(LOG_ROOT()) << "ConfigVar::fromYaml exception" << e.what()
+                                          << " convert yaml to" << typeid(T).name();
+                }
+                return false;
+            }
         }
+
+        // copy of the current value, lock free
+        const T getValue() const
+        {
+            return *read();
+        }
+
+        // the current value without copying it, see Handle
+        Handle read() const { return Handle(*this); }
+
+        // writers are serialized, readers see either the old or the new value.
+        // listeners run before the new value is published, without m_mutex held so
+        // they may add or remove listeners of this variable
         void setValue(const T &val)
         {
+            Mutex::Lock write_lock(m_writeMutex);
+            const T &old_val = *m_val.get();
+            if (val == old_val)
+                return;
+
+            std::map<uint64_t, on_change_cb> cbs;
             {
                 RWMutexType::ReadLock lock(m_mutex);
-                if (val == m_val)
-                    return;
-
-                for (auto &f : m_cbs)
-                {
-                    f.second(m_val, val);
-                }
+                cbs = m_cbs;
             }
-            RWMutexType::WriteLock lock(m_mutex);
-            m_val = val;
+            for (auto &f : cbs)
+            {
+                f.second(old_val, val);
+            }
+            m_val.publish(new T(val));
         }
         std::string getTypeName() const override { return typeid(T).name(); }
 
@@ -384,37 +608,41 @@ namespace sylar
         }
 
     private:
-        T m_val;
+        // immutable snapshot, replaced as a whole by setValue
+        RcuPtr<T> m_val;
 
         // callback functions when value changes.
         std::map<uint64_t, on_change_cb> m_cbs;
+        // guards m_cbs
         RWMutexType m_mutex;
+        // serializes writers, held while the listeners run
+        Mutex m_writeMutex;
     };
 
     class Config
     {
 
     public:
-        typedef std::map<std::string, ConfigVarBase::ptr> ConfigVarMap;
         typedef RWMutex RWMutexType;
 
-        template <class T>
-        static typename ConfigVar<T>::ptr Lookup(const std::string &name, const T &default_value, const std::string &desc = "")
+        // FromStr and ToStr as for ConfigVar, a var is found again only with the same ones
+        template <class T, class FromStr = LexicalCast<std::string, T>, class ToStr = LexicalCast<T, std::string>>
+        static typename ConfigVar<T, FromStr, ToStr>::ptr Lookup(const std::string &name, const T &default_value, const std::string &desc = "")
         {
+            typedef ConfigVar<T, FromStr, ToStr> VarType;
             RWMutexType::WriteLock lock(GetMutex());
             auto &data_map = GetDatas();
-            auto it = data_map.find(name);
-            if (it != data_map.end())
+            ConfigVarBase::ptr var = data_map.find(name);
+            if (var)
             {
-                auto tmp = std::dynamic_pointer_cast<ConfigVar<T>>(it->second);
-                if (tmp)
+                if (var->getTypeTag() == VarType::TypeTag())
                 {
                     LOG_INFO(LOG_ROOT()) << "Lookup name " << name << " exists";
-                    return tmp;
+                    return std::static_pointer_cast<VarType>(var);
                 }
                 // if value exists but not the same type, report issue
                 LOG_ERROR(LOG_ROOT()) << "Lookup name " << name << " exists but type not " << typeid(T).name()
-                                      << " real_type=" << it->second->getTypeName();
+                                      << " real_type=" << var->getTypeName();
             }
 
             // create new entry
@@ -424,27 +652,35 @@ namespace sylar
                 throw std::invalid_argument(name);
             }
 
-            typename ConfigVar<T>::ptr v(new ConfigVar<T>(name, default_value, desc));
-            data_map[name] = v;
+            typename VarType::ptr v(new VarType(name, default_value, desc));
+            data_map.insert(v);
+            ++GetGeneration();
             return v;
         }
 
-        template <class T>
-        static typename ConfigVar<T>::ptr Lookup(const std::string &name)
+        template <class T, class FromStr = LexicalCast<std::string, T>, class ToStr = LexicalCast<T, std::string>>
+        static typename ConfigVar<T, FromStr, ToStr>::ptr Lookup(const std::string &name)
         {
+            typedef ConfigVar<T, FromStr, ToStr> VarType;
             RWMutexType::ReadLock lock(GetMutex());
-            auto &data_map = GetDatas();
-            auto it = data_map.find(name);
-            if (it == data_map.end())
+            ConfigVarBase::ptr var = GetDatas().find(name);
+            if (!var || var->getTypeTag() != VarType::TypeTag())
             {
-
                 return nullptr;
             }
 
-            return std::dynamic_pointer_cast<ConfigVar<T>>(it->second);
+            return std::static_pointer_cast<VarType>(var);
         }
 
-        static void LoadFromYaml(const YAML::Node &root);
+        // applies every key whose yaml changed since the last load, returns the number of vars set.
+        // unchanged subtrees are skipped by content hash until a new var is registered,
+        // so a value changed with setValue stays until its key changes in the yaml.
+        // the hashes describe the last document loaded: merge several files with MergeYaml
+        // and load the result once, loading them one by one re-applies each file every time
+        static size_t LoadFromYaml(const YAML::Node &root);
+
+        // over laid on base: maps are merged key by key, anything else in over replaces base
+        static YAML::Node MergeYaml(const YAML::Node &base, const YAML::Node &over);
 
         static ConfigVarBase::ptr LookupBase(const std::string &name);
 
@@ -462,5 +698,12 @@ namespace sylar
             static RWMutexType s_mutex;
             return s_mutex;
         }
+
+        // bumped whenever a var is registered, guarded by GetMutex
+        static uint64_t &GetGeneration()
+        {
+            static uint64_t s_generation = 0;
+            return s_generation;
+        }
     };
 }
\ No newline at end of file
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <map>
+#include "iomanager.h"
+#include "mutex.h"
+
+namespace sylar
+{
+    // reloads config yaml files when they change on disk.
+    // inotify is read through the IOManager, changes are debounced with a timer and Config::LoadFromYaml
+    // only applies the keys whose yaml changed since the last load. keys removed from the files keep their value.
+    // the reload itself, including every ConfigVar listener, runs as a task on the worker scheduler
+    class ConfigWatcher : public std::enable_shared_from_this<ConfigWatcher>
+    {
+    public:
+        typedef std::shared_ptr<ConfigWatcher> ptr;
+        typedef Mutex MutexType;
+
+        // worker: where reloads run, the IOManager itself when null
+        ConfigWatcher(IOManager *iom, Scheduler *worker = nullptr, uint64_t debounce_ms = 200);
+        ~ConfigWatcher();
+
+        // a .yml/.yaml file, or a directory whose .yml/.yaml files are merged in name order,
+        // a later file overriding the keys it shares with an earlier one.
+        // files are watched through their directory so editors that replace the file are seen
+        bool addPath(const std::string &path);
+
+        // load every path once and start watching
+        bool start();
+        void stop();
+
+        // load now and apply the changed keys, false if a file failed to parse
+        bool reload();
+
+    private:
+        struct Watch
+        {
+            std::string dir;
+            // empty: every yaml file in dir
+            std::string file;
+        };
+
+        void watch();
+        void onEvent();
+        bool collectFiles(std::vector<std::string> &files);
+
+    private:
+        IOManager *m_iom;
+        Scheduler *m_worker;
+        uint64_t m_debounceMs;
+        int m_fd{-1};
+        bool m_stopped{true};
+        std::map<int, std::vector<Watch>> m_watches;
+        Timer::ptr m_timer;
+        MutexType m_mutex;
+        MutexType m_reloadMutex;
+    };
+}
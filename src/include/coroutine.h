@@ -0,0 +1,342 @@
+#pragma once
+
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <utility>
+#include "channel.h"
+#include "future.h"
+#include "iomanager.h"
+#include "scheduler.h"
+
+// stackless c++20 coroutines on the same Scheduler threads as fibers.
+// a suspended Task only keeps its frame (a few hundred bytes) instead of a fiber stack.
+// a coroutine is resumed as a scheduled callback, awaitables capture the scheduler the
+// coroutine runs on and resume it there. fibers wait on coroutines through the Future
+// returned by CoSpawn, coroutines co_await Futures and Channels fed by fibers
+namespace sylar
+{
+    // resumes h on scheduler as a callback task, inline when scheduler is null
+    void ResumeOn(Scheduler *scheduler, std::coroutine_handle<> h);
+
+    template <class T>
+    class Task;
+
+    class TaskPromiseBase
+    {
+    public:
+        // resumes whoever co_awaited the task
+        struct FinalAwaiter
+        {
+            bool await_ready() noexcept { return false; }
+
+            template <class P>
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<P> h) noexcept
+            {
+                std::coroutine_handle<> next = h.promise().m_continuation;
+                return next ? next : std::noop_coroutine();
+            }
+
+            void await_resume() noexcept {}
+        };
+
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        FinalAwaiter final_suspend() noexcept { return {}; }
+
+        void unhandled_exception() { m_error = std::current_exception(); }
+
+        void setContinuation(std::coroutine_handle<> h) { m_continuation = h; }
+
+    protected:
+        std::coroutine_handle<> m_continuation;
+        std::exception_ptr m_error;
+    };
+
+    template <class T>
+    class TaskPromise : public TaskPromiseBase
+    {
+    public:
+        Task<T> get_return_object();
+
+        template <class U>
+        void return_value(U &&v)
+        {
+            m_value.emplace(std::forward<U>(v));
+        }
+
+        T result()
+        {
+            if (m_error)
+            {
+                std::rethrow_exception(m_error);
+            }
+            return std::move(*m_value);
+        }
+
+    private:
+        std::optional<T> m_value;
+    };
+
+    template <>
+    class TaskPromise<void> : public TaskPromiseBase
+    {
+    public:
+        Task<void> get_return_object();
+
+        void return_void() {}
+
+        void result()
+        {
+            if (m_error)
+            {
+                std::rethrow_exception(m_error);
+            }
+        }
+    };
+
+    // lazy coroutine returning T. it starts when co_awaited (running inline on the awaiting
+    // coroutine's thread) or when handed to CoSpawn
+    template <class T = void>
+    class Task
+    {
+    public:
+        typedef TaskPromise<T> promise_type;
+        typedef std::coroutine_handle<promise_type> handle_type;
+
+        Task() {}
+        explicit Task(handle_type h) : m_handle(h) {}
+        Task(Task &&o) : m_handle(std::exchange(o.m_handle, nullptr)) {}
+        Task &operator=(Task &&o)
+        {
+            if (this != &o)
+            {
+                reset();
+                m_handle = std::exchange(o.m_handle, nullptr);
+            }
+            return *this;
+        }
+        Task(const Task &) = delete;
+        Task &operator=(const Task &) = delete;
+
+        ~Task() { reset(); }
+
+        bool valid() const { return !!m_handle; }
+
+        auto operator co_await() &&
+        {
+            struct Awaiter
+            {
+                handle_type h;
+
+                bool await_ready() { return false; }
+
+                std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller)
+                {
+                    h.promise().setContinuation(caller);
+                    return h;
+                }
+
+                T await_resume() { return h.promise().result(); }
+            };
+            return Awaiter{m_handle};
+        }
+
+    private:
+        void reset()
+        {
+            if (m_handle)
+            {
+                m_handle.destroy();
+                m_handle = nullptr;
+            }
+        }
+
+    private:
+        handle_type m_handle;
+    };
+
+    template <class T>
+    Task<T> TaskPromise<T>::get_return_object()
+    {
+        return Task<T>(std::coroutine_handle<TaskPromise<T>>::from_promise(*this));
+    }
+
+    inline Task<void> TaskPromise<void>::get_return_object()
+    {
+        return Task<void>(std::coroutine_handle<TaskPromise<void>>::from_promise(*this));
+    }
+
+    // fire and forget coroutine that frees itself when done, used by CoSpawn
+    struct DetachedTask
+    {
+        struct promise_type
+        {
+            DetachedTask get_return_object() { return DetachedTask{std::coroutine_handle<promise_type>::from_promise(*this)}; }
+            std::suspend_always initial_suspend() noexcept { return {}; }
+            std::suspend_never final_suspend() noexcept { return {}; }
+            void return_void() {}
+            void unhandled_exception() { std::terminate(); }
+        };
+
+        std::coroutine_handle<promise_type> handle;
+    };
+
+    template <class T>
+    DetachedTask RunDetached(Task<T> task, Promise<T> promise)
+    {
+        try
+        {
+            if constexpr (std::is_void<T>::value)
+            {
+                co_await std::move(task);
+                promise.setValue();
+            }
+            else
+            {
+                promise.setValue(co_await std::move(task));
+            }
+        }
+        catch (...)
+        {
+            promise.setException(std::current_exception());
+        }
+    }
+
+    // starts task on scheduler (the current one when null). fibers get() the result,
+    // coroutines co_await it
+    template <class T>
+    Future<T> CoSpawn(Task<T> task, Scheduler *scheduler = nullptr)
+    {
+        Promise<T> promise;
+        Future<T> future = promise.getFuture();
+        DetachedTask d = RunDetached(std::move(task), promise);
+        ResumeOn(scheduler ? scheduler : Scheduler::GetThis(), d.handle);
+        return future;
+    }
+
+    // co_await Yield(): requeue on the current scheduler
+    struct Yield
+    {
+        bool await_ready() { return false; }
+        void await_suspend(std::coroutine_handle<> h) { ResumeOn(Scheduler::GetThis(), h); }
+        void await_resume() {}
+    };
+
+    // co_await ScheduleOn(s): continue on another scheduler
+    struct ScheduleOn
+    {
+        Scheduler *scheduler;
+
+        bool await_ready() { return scheduler == Scheduler::GetThis(); }
+        void await_suspend(std::coroutine_handle<> h) { ResumeOn(scheduler, h); }
+        void await_resume() {}
+    };
+
+    // co_await Sleep(ms): a timer on the current IOManager
+    struct Sleep
+    {
+        uint64_t ms;
+
+        bool await_ready() { return false; }
+        void await_suspend(std::coroutine_handle<> h);
+        void await_resume() {}
+    };
+
+    // co_await WaitEvent(fd, IOManager::READ): readiness through the current IOManager.
+    // false when the event could not be added
+    struct WaitEvent
+    {
+        int fd;
+        IOManager::Event event;
+        bool ok = true;
+
+        bool await_ready() { return false; }
+        bool await_suspend(std::coroutine_handle<> h);
+        bool await_resume() { return ok; }
+    };
+
+    // co_await future: resumes on the awaiting coroutine's scheduler once the result is set
+    template <class T>
+    auto operator co_await(Future<T> future)
+    {
+        struct Awaiter
+        {
+            Future<T> future;
+
+            bool await_ready() { return future.isReady(); }
+
+            bool await_suspend(std::coroutine_handle<> h)
+            {
+                Scheduler *scheduler = Scheduler::GetThis();
+                ChannelWaiter::ptr waiter(new ChannelWaiter([scheduler, h]()
+                                                            { ResumeOn(scheduler, h); }));
+                return future.park(waiter);
+            }
+
+            decltype(auto) await_resume() { return future.get(); }
+        };
+        return Awaiter{std::move(future)};
+    }
+
+    // co_await ChannelPopAwaiter<T>(ch, v): false when the channel is closed and drained
+    template <class T>
+    class ChannelPopAwaiter
+    {
+    public:
+        ChannelPopAwaiter(Channel<T> &ch, T &v) : m_ch(ch), m_v(v) {}
+
+        bool await_ready() { return m_ch.startPop(m_v, m_ok, nullptr, 0); }
+
+        bool await_suspend(std::coroutine_handle<> h)
+        {
+            Scheduler *scheduler = Scheduler::GetThis();
+            ChannelWaiter::ptr waiter(new ChannelWaiter([scheduler, h]()
+                                                        { ResumeOn(scheduler, h); }));
+            return !m_ch.startPop(m_v, m_ok, waiter, 0);
+        }
+
+        bool await_resume() { return m_ok; }
+
+    private:
+        Channel<T> &m_ch;
+        T &m_v;
+        bool m_ok = false;
+    };
+
+    // co_await ChannelPushAwaiter<T>(ch, v): false when the channel is closed
+    template <class T>
+    class ChannelPushAwaiter
+    {
+    public:
+        ChannelPushAwaiter(Channel<T> &ch, T v) : m_ch(ch), m_v(std::move(v)) {}
+
+        bool await_ready() { return m_ch.startPush(m_v, m_ok, nullptr, 0); }
+
+        bool await_suspend(std::coroutine_handle<> h)
+        {
+            Scheduler *scheduler = Scheduler::GetThis();
+            ChannelWaiter::ptr waiter(new ChannelWaiter([scheduler, h]()
+                                                        { ResumeOn(scheduler, h); }));
+            return !m_ch.startPush(m_v, m_ok, waiter, 0);
+        }
+
+        bool await_resume() { return m_ok; }
+
+    private:
+        Channel<T> &m_ch;
+        T m_v;
+        bool m_ok = false;
+    };
+
+    template <class T>
+    ChannelPopAwaiter<T> CoPop(Channel<T> &ch, T &v)
+    {
+        return ChannelPopAwaiter<T>(ch, v);
+    }
+
+    template <class T>
+    ChannelPushAwaiter<T> CoPush(Channel<T> &ch, T v)
+    {
+        return ChannelPushAwaiter<T>(ch, std::move(v));
+    }
+}
@@ -1,21 +1,23 @@
 #pragma once
 
 #include <ucontext.h>
+#include <atomic>
 #include <functional>
 #include <memory>
 #include "thread.h"
 #include "mutex.h"
+#include "ref_counted.h"
 
 namespace sylar
 {
     class Scheduler;
 
-    class Fiber : public std::enable_shared_from_this<Fiber>
+    class Fiber : public RefCounted<Fiber>
     {
         friend class Scheduler;
 
     public:
-        typedef std::shared_ptr<Fiber> ptr;
+        typedef RefPtr<Fiber> ptr;
         enum State
         {
             INIT,
@@ -45,18 +47,30 @@ namespace sylar
 
         uint64_t getId() const { return m_id; }
 
-        State getState() const { return m_state; }
+        // acquire: pairs with the release store of HOLD/READY made once the context is saved
+        State getState() const { return m_state.load(std::memory_order_acquire); }
+
+        // the fiber a thread started on, it has no stack of its own
+        bool isThreadMain() const { return !m_stack; }
+
+        // the Scheduler::Priority it was last dequeued at, wakeups after blocking requeue it there
+        int getPriority() const { return m_priority; }
 
     public:
         // set current fiber
         static void SetThis(Fiber *f);
         // return current fiber, if fiber does not exist for current thread, main fiber will becreated and return
         static Fiber::ptr GetThis();
+        // current fiber without taking a reference, null before GetThis() ran on this thread.
+        // valid while the fiber runs, whoever scheduled it holds the owning handle
+        static Fiber *GetThisRaw();
 
         // fiber switch to background and set to READY
         static void YieldToReady();
 
-        // fiber switch to background and set to HOLD
+        // fiber switch to background and set to HOLD.
+        // the scheduler sets HOLD once the context is saved, so a wakeup
+        // scheduled from another thread is not resumed before that
         static void YieldToHold();
 
         // total num of fibers
@@ -68,16 +82,32 @@ namespace sylar
 
         static uint64_t GetFiberId();
 
+        // FiberLocal support: a key per FiberLocal object, deleter destroys its values
+        static const size_t MAX_LOCALS = 16;
+        static size_t AllocLocalKey(void (*deleter)(void *));
+        // the current fiber's slot for key, a plain thread uses its main fiber
+        static void *&GetLocalSlot(size_t key);
+
+    private:
+        // destroys the FiberLocal values, on termination, reset and destruction
+        void clearLocals();
+
     private:
         // default constructor only used by main thread fiber
         Fiber();
 
         uint64_t m_id{0};
-        State m_state{INIT};
+        // written by the worker after the fiber is switched out and read by other workers
+        // before they resume it, so the saved context is published through it
+        std::atomic<State> m_state{INIT};
         uint32_t m_stacksize{0};
+        // set by Scheduler::run before each switch in, NORMAL until then
+        int m_priority{1};
 
         ucontext_t m_ctx;
         void *m_stack = nullptr;
         std::function<void()> m_cb;
+        void *m_locals[MAX_LOCALS] = {};
+        bool m_hasLocals = false;
     };
 }
\ No newline at end of file
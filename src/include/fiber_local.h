@@ -0,0 +1,54 @@
+#pragma once
+
+#include "fiber.h"
+#include "noncopyable.h"
+
+namespace sylar
+{
+    // like thread_local, but one T per Fiber. the value is constructed on first access
+    // from a fiber and destroyed when that fiber terminates, is reset() for another task
+    // by the scheduler, or is destroyed. access indexes a slot array inside the current
+    // Fiber: no lookup table, no lock. outside any fiber the thread's main fiber is used.
+    // there are Fiber::MAX_LOCALS keys, which are never given back: make FiberLocal
+    // objects static or global
+    template <class T>
+    class FiberLocal : eve::Noncopyable
+    {
+    public:
+        FiberLocal() : m_key(Fiber::AllocLocalKey(&Delete)) {}
+
+        T &get()
+        {
+            void *&slot = Fiber::GetLocalSlot(m_key);
+            if (!slot)
+            {
+                slot = new T();
+            }
+            return *static_cast<T *>(slot);
+        }
+
+        T &operator*() { return get(); }
+        T *operator->() { return &get(); }
+
+        // whether the current fiber has a value yet
+        bool has() { return Fiber::GetLocalSlot(m_key) != nullptr; }
+
+        // destroys the current fiber's value, the next get() makes a new one
+        void reset()
+        {
+            void *&slot = Fiber::GetLocalSlot(m_key);
+            if (slot)
+            {
+                void *v = slot;
+                slot = nullptr;
+                Delete(v);
+            }
+        }
+
+    private:
+        static void Delete(void *v) { delete static_cast<T *>(v); }
+
+    private:
+        size_t m_key;
+    };
+}
@@ -0,0 +1,173 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <list>
+#include "fiber.h"
+#include "mutex.h"
+#include "noncopyable.h"
+
+namespace sylar
+{
+    class Scheduler;
+
+    // a parked fiber, or a plain thread blocked on a semaphore when it is not running
+    // inside a scheduler, or a callback (a suspended coroutine). wake() hands it back
+    // to the scheduler it was parked on
+    struct FiberWaiter
+    {
+        typedef SpinLock MutexType;
+
+        Scheduler *scheduler = nullptr;
+        Fiber::ptr fiber;
+        Semaphore *sem = nullptr;
+        std::function<void()> cb;
+
+        // the calling fiber, or sem when the caller is not a scheduler fiber.
+        // the fiber counts as parked on its scheduler until wake() or release()
+        void init(Semaphore *s);
+        // wake() runs cb, which resumes the caller somewhere. counts as parked like a fiber
+        void initCallback(std::function<void()> f);
+        // gives up a waiter that will never be woken
+        void release();
+        // blocks the caller until wake(), still valid after the waiter was moved from
+        void sleep();
+        void wake();
+
+        // queues the caller on q, releases lock and sleeps until wake() is called
+        static void Park(std::list<FiberWaiter> &q, MutexType::Lock &lock);
+    };
+
+    // mutex that parks the fiber instead of blocking the worker thread.
+    // lock/unlock are one atomic each when uncontended, unlock hands the lock
+    // straight to the first waiter so the wakeup cannot be stolen
+    class FiberMutex : eve::Noncopyable
+    {
+    public:
+        typedef ScopedLockImpl<FiberMutex> Lock;
+
+        void lock()
+        {
+            uint32_t c = 0;
+            if (!m_state.compare_exchange_strong(c, 1, std::memory_order_acquire, std::memory_order_relaxed))
+            {
+                lockSlow();
+            }
+        }
+
+        bool tryLock()
+        {
+            uint32_t c = 0;
+            return m_state.compare_exchange_strong(c, 1, std::memory_order_acquire, std::memory_order_relaxed);
+        }
+
+        void unlock()
+        {
+            uint32_t c = 1;
+            if (!m_state.compare_exchange_strong(c, 0, std::memory_order_release, std::memory_order_relaxed))
+            {
+                unlockSlow();
+            }
+        }
+
+    private:
+        void lockSlow();
+        void unlockSlow();
+
+    private:
+        // 0 free, 1 locked, 2 locked with waiters queued
+        std::atomic<uint32_t> m_state{0};
+        FiberWaiter::MutexType m_mutex;
+        std::list<FiberWaiter> m_waiters;
+    };
+
+    // condition variable for FiberMutex, waiting parks the fiber
+    class FiberConditionVariable : eve::Noncopyable
+    {
+    public:
+        // mutex must be locked, it is locked again when wait returns
+        void wait(FiberMutex &mutex);
+        void wait(FiberMutex::Lock &lock);
+
+        template <class Pred>
+        void wait(FiberMutex::Lock &lock, Pred pred)
+        {
+            while (!pred())
+            {
+                wait(lock);
+            }
+        }
+
+        void notifyOne()
+        {
+            if (m_waiting.load(std::memory_order_seq_cst))
+            {
+                notifySlow(false);
+            }
+        }
+
+        void notifyAll()
+        {
+            if (m_waiting.load(std::memory_order_seq_cst))
+            {
+                notifySlow(true);
+            }
+        }
+
+    private:
+        void notifySlow(bool all);
+
+    private:
+        std::atomic<uint32_t> m_waiting{0};
+        FiberWaiter::MutexType m_mutex;
+        std::list<FiberWaiter> m_waiters;
+    };
+
+    // counting semaphore that parks the fiber, notify() hands the count to the
+    // first waiter. no scheduler work at all while the count stays positive
+    class FiberSemaphore : eve::Noncopyable
+    {
+    public:
+        FiberSemaphore(uint32_t count = 0) : m_count(count) {}
+
+        void wait()
+        {
+            if (!tryWait())
+            {
+                waitSlow();
+            }
+        }
+
+        bool tryWait()
+        {
+            int64_t c = m_count.load(std::memory_order_relaxed);
+            while (c > 0)
+            {
+                if (m_count.compare_exchange_weak(c, c - 1, std::memory_order_acquire, std::memory_order_relaxed))
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void notify()
+        {
+            m_count.fetch_add(1, std::memory_order_seq_cst);
+            if (m_waiting.load(std::memory_order_seq_cst))
+            {
+                notifySlow();
+            }
+        }
+
+    private:
+        void waitSlow();
+        void notifySlow();
+
+    private:
+        std::atomic<int64_t> m_count;
+        std::atomic<uint32_t> m_waiting{0};
+        FiberWaiter::MutexType m_mutex;
+        std::list<FiberWaiter> m_waiters;
+    };
+}
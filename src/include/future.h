@@ -0,0 +1,230 @@
+#pragma once
+
+#include <exception>
+#include <functional>
+#include <list>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <type_traits>
+#include "channel.h"
+#include "fiber_sync.h"
+#include "scheduler.h"
+
+namespace sylar
+{
+    // ready flag, exception and parked waiters shared by a Promise and its Futures
+    class FutureStateBase : eve::Noncopyable
+    {
+    public:
+        typedef SpinLock MutexType;
+
+        bool isReady() const { return m_ready.load(std::memory_order_acquire); }
+
+        // parks the calling fiber until ready, false after timeout_ms
+        bool wait(uint64_t timeout_ms = ~0ull);
+
+        void setException(std::exception_ptr e);
+
+        // queues waiter to be claimed and woken once ready, false when already ready
+        bool park(const ChannelWaiter::ptr &waiter);
+
+        // rethrows the stored exception, must be ready
+        void check() const
+        {
+            if (m_error)
+            {
+                std::rethrow_exception(m_error);
+            }
+        }
+
+    protected:
+        // lock must hold m_mutex, throws when the state was already set
+        void checkUnset(MutexType::Lock &lock);
+        // marks ready, releases lock and wakes every waiter
+        void finish(MutexType::Lock &lock);
+
+    protected:
+        MutexType m_mutex;
+        std::atomic<bool> m_ready{false};
+        std::exception_ptr m_error;
+        std::list<ChannelWaiter::ptr> m_waiters;
+    };
+
+    template <class T>
+    class FutureState : public FutureStateBase
+    {
+    public:
+        typedef std::shared_ptr<FutureState> ptr;
+
+        void setValue(T v)
+        {
+            MutexType::Lock lock(m_mutex);
+            checkUnset(lock);
+            m_value.emplace(std::move(v));
+            finish(lock);
+        }
+
+        const T &get()
+        {
+            wait();
+            check();
+            return *m_value;
+        }
+
+    private:
+        std::optional<T> m_value;
+    };
+
+    template <>
+    class FutureState<void> : public FutureStateBase
+    {
+    public:
+        typedef std::shared_ptr<FutureState> ptr;
+
+        void setValue()
+        {
+            MutexType::Lock lock(m_mutex);
+            checkUnset(lock);
+            finish(lock);
+        }
+
+        void get()
+        {
+            wait();
+            check();
+        }
+    };
+
+    // read side of a result produced by another fiber or thread. copies share the result.
+    // get() parks the calling fiber, never the worker thread, while the result is not there
+    template <class T>
+    class Future
+    {
+    public:
+        Future() {}
+        Future(typename FutureState<T>::ptr state) : m_state(std::move(state)) {}
+
+        bool valid() const { return !!m_state; }
+        bool isReady() const { return m_state->isReady(); }
+
+        void wait() const { m_state->wait(); }
+        // false when the result is still missing after timeout_ms
+        bool wait(uint64_t timeout_ms) const { return m_state->wait(timeout_ms); }
+
+        // the value, or the exception the producer failed with
+        decltype(auto) get() const { return m_state->get(); }
+
+        // waiter is claimed and woken once ready, false when it already is
+        bool park(const ChannelWaiter::ptr &waiter) const { return m_state->park(waiter); }
+
+    private:
+        typename FutureState<T>::ptr m_state;
+    };
+
+    // write side, setting the value or the exception a second time throws std::logic_error.
+    // copies share the state so a promise can be captured by a std::function
+    template <class T>
+    class Promise
+    {
+    public:
+        Promise() : m_state(new FutureState<T>) {}
+
+        Future<T> getFuture() const { return Future<T>(m_state); }
+
+        template <class... Args>
+        void setValue(Args &&...args) const
+        {
+            m_state->setValue(std::forward<Args>(args)...);
+        }
+
+        void setException(std::exception_ptr e) const { m_state->setException(e); }
+
+    private:
+        typename FutureState<T>::ptr m_state;
+    };
+
+    // runs fn(promise) and turns an exception into the promise's exception
+    template <class R, class F>
+    void FulfillPromise(const Promise<R> &promise, F &fn)
+    {
+        try
+        {
+            if constexpr (std::is_void<R>::value)
+            {
+                fn();
+                promise.setValue();
+            }
+            else
+            {
+                promise.setValue(fn());
+            }
+        }
+        catch (...)
+        {
+            promise.setException(std::current_exception());
+        }
+    }
+
+    // runs fn as a fiber on scheduler (the current one when null) and returns its result
+    template <class F, class R = typename std::invoke_result<F>::type>
+    Future<R> Async(F fn, Scheduler *scheduler = nullptr)
+    {
+        Promise<R> promise;
+        Future<R> future = promise.getFuture();
+        scheduler = scheduler ? scheduler : Scheduler::GetThis();
+        scheduler->schedule(std::function<void()>([promise, fn]() mutable
+                                                  { FulfillPromise(promise, fn); }));
+        return future;
+    }
+
+    // fibers spawned together and joined together. join() parks until every task has finished
+    // and rethrows the first exception; a failing task cancels the group.
+    // cancellation is cooperative: tasks poll isCancelled() or react to onCancel callbacks,
+    // tasks not started yet are skipped. cancelling a group cancels the groups created under it.
+    // the destructor joins, a task never outlives its group
+    class TaskGroup : eve::Noncopyable
+    {
+    public:
+        typedef std::shared_ptr<TaskGroup> ptr;
+
+        // scheduler: where tasks run, the current one when null
+        TaskGroup(Scheduler *scheduler = nullptr, TaskGroup *parent = nullptr);
+        ~TaskGroup();
+
+        void spawn(std::function<void()> cb);
+
+        // spawn returning the task's result
+        template <class F, class R = typename std::invoke_result<F>::type>
+        Future<R> run(F fn)
+        {
+            Promise<R> promise;
+            Future<R> future = promise.getFuture();
+            spawn([promise, fn]() mutable
+                  { FulfillPromise(promise, fn); });
+            return future;
+        }
+
+        void join();
+
+        void cancel();
+        bool isCancelled() const;
+
+        // cb runs once when the group is cancelled, right away if it already is
+        void onCancel(std::function<void()> cb);
+
+    private:
+        void taskDone(std::exception_ptr error);
+
+    private:
+        Scheduler *m_scheduler;
+        TaskGroup *m_parent;
+        std::atomic<bool> m_cancelled{false};
+        FiberMutex m_mutex;
+        FiberConditionVariable m_cond;
+        size_t m_pending{0};
+        std::exception_ptr m_error;
+        std::list<TaskGroup *> m_children;
+        std::list<std::function<void()>> m_cancelCbs;
+    };
+}
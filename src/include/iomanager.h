@@ -23,7 +23,7 @@ namespace sylar
     private:
         struct FdContext
         {
-            typedef Mutex MutexType;
+            typedef DefaultMutex MutexType;
             struct EventContext
             {
                 Scheduler *scheduler = nullptr;
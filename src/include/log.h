@@ -9,15 +9,19 @@
 #include <iostream>
 #include <vector>
 #include <map>
+#include <string_view>
+#include <functional>
 
 #include "util.h"
 #include "singleton.h"
 #include "mutex.h"
 #include "thread.h"
+#include "log_binary.h"
+#include "rcu.h"
 
 #define LOG_LEVEL(logger, level)     \
     if (logger->getLevel() <= level) \
-    sylar::LogEventWrap(sylar::LogEvent::ptr(new sylar::LogEvent(logger, level, __FILE__, __LINE__, 0, sylar::GetThreadId(), sylar::Thread::GetName(), sylar::GetFiberId(), time(0), ""))).getSS()
+    sylar::LogEventWrap(sylar::LogEvent::ptr(new sylar::LogEvent(logger, level, __FILE__, __LINE__, 0, sylar::GetThreadId(), sylar::Thread::GetName(), sylar::GetFiberId(), sylar::GetCurrentUS(), ""))).getSS()
 
 #define LOG_DEBUG(logger) LOG_LEVEL(logger, sylar::LogLevel::DEBUG)
 #define LOG_INFO(logger) LOG_LEVEL(logger, sylar::LogLevel::INFO)
@@ -27,7 +31,7 @@
 
 #define LOG_FMT_LEVEL(logger, level, fmt, ...) \
     if (logger->getLevel() <= level)           \
-    sylar::LogEventWrap(LogEvent::ptr(new sylar::LogEvent(logger, level, __FILE__, __LINE__, 0, sylar::GetThreadId(), sylar::Thread::GetName(), sylar::GetFiberId(), time(0), fmt))).getEvent()->format(fmt, __VA_ARGS__)
+    sylar::LogEventWrap(LogEvent::ptr(new sylar::LogEvent(logger, level, __FILE__, __LINE__, 0, sylar::GetThreadId(), sylar::Thread::GetName(), sylar::GetFiberId(), sylar::GetCurrentUS(), fmt))).getEvent()->format(fmt, __VA_ARGS__)
 
 #define LOG_FMT_DEBUG(logger, fmt, ...) LOG_FMT_LEVEL(logger, sylar::LogLevel::DEBUG, fmt, __VA_ARGS__)
 #define LOG_FMT_INFO(logger, fmt, ...) LOG_FMT_LEVEL(logger, sylar::LogLevel::INFO, fmt, __VA_ARGS__)
@@ -35,6 +39,55 @@
 #define LOG_FMT_ERROR(logger, fmt, ...) LOG_FMT_LEVEL(logger, sylar::LogLevel::ERROR, fmt, __VA_ARGS__)
 #define LOG_FMT_FATAL(logger, fmt, ...) LOG_FMT_LEVEL(logger, sylar::LogLevel::FATAL, fmt, __VA_ARGS__)
 
+// binary logging: only the site id and the raw arguments are recorded, text is rendered on demand
+// fmt must be a string literal, the call site is interned the first time the statement runs
+#define LOG_BIN_LEVEL(logger, level, fmt, ...)                                                                                                                                        \
+    if (logger->getLevel() <= level)                                                                                                                                                  \
+    sylar::LogEventWrap(sylar::LogEvent::ptr(new sylar::LogEvent(logger, level, __FILE__, __LINE__, 0, sylar::GetThreadId(), sylar::Thread::GetName(), sylar::GetFiberId(), sylar::GetCurrentUS(), ""))) \
+        .getEvent()                                                                                                                                                                   \
+        ->encode([]() { static const uint32_t s_site = sylar::LogSiteRegistry::Register(__FILE__, __LINE__, fmt); return s_site; }(), ##__VA_ARGS__)
+
+#define LOG_BIN_DEBUG(logger, fmt, ...) LOG_BIN_LEVEL(logger, sylar::LogLevel::DEBUG, fmt, ##__VA_ARGS__)
+#define LOG_BIN_INFO(logger, fmt, ...) LOG_BIN_LEVEL(logger, sylar::LogLevel::INFO, fmt, ##__VA_ARGS__)
+#define LOG_BIN_WARN(logger, fmt, ...) LOG_BIN_LEVEL(logger, sylar::LogLevel::WARN, fmt, ##__VA_ARGS__)
+#define LOG_BIN_ERROR(logger, fmt, ...) LOG_BIN_LEVEL(logger, sylar::LogLevel::ERROR, fmt, ##__VA_ARGS__)
+#define LOG_BIN_FATAL(logger, fmt, ...) LOG_BIN_LEVEL(logger, sylar::LogLevel::FATAL, fmt, ##__VA_ARGS__)
+
+// per call site sampling and rate limiting, the limiter lives in a function local static.
+// suppressed calls cost a coarse clock read and two relaxed atomics and never build an event.
+// a "suppressed K messages" line is logged once the site's one second window has passed,
+// or by the flusher thread when the site has gone quiet
+#define LOG_LIMIT_LEVEL(logger, level, mode, n)                                                                                                  \
+    if (logger->getLevel() <= level && [&]() -> sylar::LogLimiter & { static sylar::LogLimiter s_limiter(logger, level, __FILE__, __LINE__, mode, n); return s_limiter; }().allow()) \
+    sylar::LogEventWrap(sylar::LogEvent::ptr(new sylar::LogEvent(logger, level, __FILE__, __LINE__, 0, sylar::GetThreadId(), sylar::Thread::GetName(), sylar::GetFiberId(), sylar::GetCurrentUS(), ""))).getSS()
+
+// first of every n calls
+#define LOG_EVERY_N(logger, level, n) LOG_LIMIT_LEVEL(logger, level, sylar::LogLimiter::EVERY_N, n)
+// at most n calls per second
+#define LOG_PER_SEC(logger, level, n) LOG_LIMIT_LEVEL(logger, level, sylar::LogLimiter::PER_SECOND, n)
+
+#define LOG_DEBUG_EVERY_N(logger, n) LOG_EVERY_N(logger, sylar::LogLevel::DEBUG, n)
+#define LOG_INFO_EVERY_N(logger, n) LOG_EVERY_N(logger, sylar::LogLevel::INFO, n)
+#define LOG_WARN_EVERY_N(logger, n) LOG_EVERY_N(logger, sylar::LogLevel::WARN, n)
+#define LOG_ERROR_EVERY_N(logger, n) LOG_EVERY_N(logger, sylar::LogLevel::ERROR, n)
+
+#define LOG_DEBUG_PER_SEC(logger, n) LOG_PER_SEC(logger, sylar::LogLevel::DEBUG, n)
+#define LOG_INFO_PER_SEC(logger, n) LOG_PER_SEC(logger, sylar::LogLevel::INFO, n)
+#define LOG_WARN_PER_SEC(logger, n) LOG_PER_SEC(logger, sylar::LogLevel::WARN, n)
+#define LOG_ERROR_PER_SEC(logger, n) LOG_PER_SEC(logger, sylar::LogLevel::ERROR, n)
+
+// structured logging, fields are kept typed and emitted by JsonLogAppender:
+// LOG_KV_WARN(logger).kv("fd", fd).kv("cost_ms", 1.5) << "connect timeout";
+#define LOG_KV_LEVEL(logger, level)  \
+    if (logger->getLevel() <= level) \
+    sylar::LogEventWrap(sylar::LogEvent::ptr(new sylar::LogEvent(logger, level, __FILE__, __LINE__, 0, sylar::GetThreadId(), sylar::Thread::GetName(), sylar::GetFiberId(), sylar::GetCurrentUS(), "")))
+
+#define LOG_KV_DEBUG(logger) LOG_KV_LEVEL(logger, sylar::LogLevel::DEBUG)
+#define LOG_KV_INFO(logger) LOG_KV_LEVEL(logger, sylar::LogLevel::INFO)
+#define LOG_KV_WARN(logger) LOG_KV_LEVEL(logger, sylar::LogLevel::WARN)
+#define LOG_KV_ERROR(logger) LOG_KV_LEVEL(logger, sylar::LogLevel::ERROR)
+#define LOG_KV_FATAL(logger) LOG_KV_LEVEL(logger, sylar::LogLevel::FATAL)
+
 #define LOG_ROOT() sylar::LoggerMgr::GetInstance().getRoot()
 #define LOG_NAME(name) sylar::LoggerMgr::GetInstance().getLogger(name)
 
@@ -66,7 +119,7 @@ namespace sylar
     public:
         typedef std::shared_ptr<LogEvent> ptr;
         LogEvent(std::shared_ptr<Logger> logger, LogLevel::Level level, const char *file, int32_t m_line, uint32_t elapse,
-                 int32_t threadId, std::string threadName, uint32_t fiberId, uint64_t time, const std::string &content);
+                 int32_t threadId, std::string threadName, uint32_t fiberId, uint64_t time_us, const std::string &content);
         ~LogEvent();
         const char *getFile() const { return m_file; }
         int32_t getLine() const { return m_line; }
@@ -74,15 +127,40 @@ namespace sylar
         int32_t getThreadId() const { return m_threadId; }
         const std::string &getThreadName() const { return m_threadName; }
         uint32_t getFiberId() const { return m_fiberId; }
-        uint64_t getTime() const { return m_time; }
-        std::string getContent() const { return m_content.str(); }
+        // seconds since epoch
+        uint64_t getTime() const { return m_time / 1000000; }
+        // microseconds since epoch
+        uint64_t getTimeUs() const { return m_time; }
+        std::string getContent() const;
         std::stringstream &getSS() { return m_content; }
-        std::shared_ptr<Logger> getLogger() const { return m_logger; }
+        const std::shared_ptr<Logger> &getLogger() const { return m_logger; }
         LogLevel::Level getLevel() const { return m_level; }
+        uint32_t getSite() const { return m_site; }
+        const std::string &getArgs() const { return m_args; }
 
         void format(const char *fmt, ...);
         void format(const char *fmt, va_list al);
 
+        // record raw arguments of a LOG_BIN_* site instead of formatting them
+        template <class... Args>
+        void encode(uint32_t site, const Args &...args)
+        {
+            m_site = site;
+            binlog::Encode(m_args, args...);
+        }
+
+        // attach a key/value field, values keep their type (see binlog::EncodeArg)
+        template <class T>
+        LogEvent &kv(std::string_view key, const T &value)
+        {
+            binlog::PutString(m_fields, key.data(), key.size());
+            binlog::EncodeArg(m_fields, value);
+            return *this;
+        }
+
+        // pairs of encoded key and value, walk with binlog::NextArg
+        const std::string &getFields() const { return m_fields; }
+
     private:
         LogLevel::Level m_level;
         const char *m_file = nullptr;
@@ -95,6 +173,10 @@ namespace sylar
         std::stringstream m_content;
         std::string m_threadName;
 
+        uint32_t m_site = 0;
+        std::string m_args;
+        std::string m_fields;
+
         std::shared_ptr<Logger> m_logger;
     };
 
@@ -107,18 +189,75 @@ namespace sylar
         std::stringstream &getSS() { return m_event->getSS(); }
         LogEvent::ptr getEvent() { return m_event; }
 
+        template <class T>
+        LogEventWrap &kv(std::string_view key, const T &value)
+        {
+            m_event->kv(key, value);
+            return *this;
+        }
+
+        template <class T>
+        std::stringstream &operator<<(const T &v)
+        {
+            m_event->getSS() << v;
+            return m_event->getSS();
+        }
+
     private:
         LogEvent::ptr m_event;
     };
 
+    // state of one LOG_EVERY_N / LOG_PER_SEC site, shared by all threads
+    class LogLimiter : eve::Noncopyable
+    {
+    public:
+        enum Mode
+        {
+            EVERY_N = 1,
+            PER_SECOND = 2
+        };
+
+        LogLimiter(std::shared_ptr<Logger> logger, LogLevel::Level level, const char *file, int32_t line, Mode mode, uint32_t n);
+        ~LogLimiter();
+
+        // true if this call may log
+        bool allow();
+
+        // log the summary of every site whose window has passed but saw no call since.
+        // a background thread started with the first site runs it every log.limiter_flush_ms
+        static void FlushAll();
+
+    private:
+        void roll(uint64_t now);
+
+    private:
+        std::shared_ptr<Logger> m_logger;
+        LogLevel::Level m_level;
+        const char *m_file;
+        int32_t m_line;
+        Mode m_mode;
+        uint32_t m_n;
+        std::atomic<uint64_t> m_windowStart;
+        std::atomic<uint64_t> m_calls{0};
+        std::atomic<uint64_t> m_passed{0};
+        std::atomic<uint64_t> m_suppressed{0};
+    };
+
     class LogFormatter
     {
     public:
         typedef std::shared_ptr<LogFormatter> ptr;
         LogFormatter(const std::string pattern);
+        virtual ~LogFormatter() = default;
+
+        // the StaticLogFormatter registered for exactly this pattern if any, otherwise a runtime parsed one
+        static LogFormatter::ptr Create(const std::string &pattern);
+
+        // used by LOG_STATIC_PATTERN
+        static void RegisterStatic(const std::string &pattern, std::function<LogFormatter::ptr()> factory);
 
         // %t     %thread_id
-        virtual std::string format(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event);
+        virtual std::string format(Logger *logger, LogLevel::Level level, const LogEvent::ptr &event);
 
         void init();
 
@@ -133,9 +272,19 @@ namespace sylar
             typedef std::shared_ptr<FormatItem> ptr;
             FormatItem(const std::string &str = "") {}
             virtual ~FormatItem() {}
-            virtual void format(std::ostream &os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) = 0;
+            virtual void format(std::string &out, Logger *logger, LogLevel::Level level, const LogEvent::ptr &event) = 0;
         };
 
+        // item for %name{fmt}, nullptr if name is unknown
+        static FormatItem::ptr CreateItem(const std::string &name, const std::string &fmt);
+
+    protected:
+        struct NoParse
+        {
+        };
+        // for formatters that do not use the runtime items
+        LogFormatter(const std::string &pattern, NoParse) : m_pattern(pattern) {}
+
     private:
         std::string m_pattern;
         std::vector<FormatItem::ptr> m_items;
@@ -148,10 +297,11 @@ namespace sylar
 
     public:
         typedef std::shared_ptr<LogAppender> ptr;
-        typedef Mutex MutexType;
+        typedef DefaultMutex MutexType;
         virtual ~LogAppender() = default;
 
-        virtual void log(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) = 0;
+        // logger is borrowed for the call, Logger::log does not take a reference per message
+        virtual void log(Logger *logger, LogLevel::Level level, const LogEvent::ptr &event) = 0;
         void setFormatter(LogFormatter::ptr formatter);
         LogFormatter::ptr getFormatter();
 
@@ -161,7 +311,7 @@ namespace sylar
         virtual std::string toYamlString() = 0;
 
     protected:
-        LogLevel::Level m_level;
+        LogLevel::Level m_level{LogLevel::UNKNOWN};
         MutexType m_mutex;
         LogFormatter::ptr m_formatter;
     };
@@ -171,16 +321,18 @@ namespace sylar
     public:
         friend class LoggerManager;
         typedef std::shared_ptr<Logger> ptr;
-        typedef Mutex MutexType;
+        typedef DefaultMutex MutexType;
+        // immutable snapshot read by log(), replaced as a whole by writers
+        typedef std::vector<LogAppender::ptr> AppenderList;
 
         Logger(const std::string &name = "root");
 
-        void log(LogLevel::Level level, LogEvent::ptr event);
-        void debug(LogEvent::ptr event);
-        void info(LogEvent::ptr event);
-        void warn(LogEvent::ptr event);
-        void error(LogEvent::ptr event);
-        void fatal(LogEvent::ptr event);
+        void log(LogLevel::Level level, const LogEvent::ptr &event);
+        void debug(const LogEvent::ptr &event);
+        void info(const LogEvent::ptr &event);
+        void warn(const LogEvent::ptr &event);
+        void error(const LogEvent::ptr &event);
+        void fatal(const LogEvent::ptr &event);
 
         void addAppender(LogAppender::ptr appender);
 
@@ -188,9 +340,9 @@ namespace sylar
 
         void clearAppenders();
 
-        LogLevel::Level getLevel() const;
+        LogLevel::Level getLevel() const { return m_level.load(std::memory_order_relaxed); }
 
-        void setLevel(LogLevel::Level level);
+        void setLevel(LogLevel::Level level) { m_level.store(level, std::memory_order_relaxed); }
 
         const std::string &getName() const { return m_name; }
 
@@ -203,9 +355,10 @@ namespace sylar
 
     private:
         std::string m_name;
-        LogLevel::Level m_level{LogLevel::UNKNOWN};
+        std::atomic<LogLevel::Level> m_level{LogLevel::UNKNOWN};
+        // serializes writers only, readers go through the rcu snapshot
         MutexType m_mutex;
-        std::list<LogAppender::ptr> m_appender;
+        RcuPtr<AppenderList> m_appenders;
         LogFormatter::ptr m_formatter;
         Logger::ptr m_root;
     };
@@ -215,7 +368,7 @@ namespace sylar
     {
     public:
         typedef std::shared_ptr<StdoutLogAppender> ptr;
-        void log(Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event) override;
+        void log(Logger *logger, LogLevel::Level level, const LogEvent::ptr &event) override;
 
         std::string toYamlString() override;
 
@@ -229,7 +382,68 @@ namespace sylar
         typedef std::shared_ptr<FileLogAppender> ptr;
         FileLogAppender(const std::string &filename);
 
-        void log(Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event) override;
+        void log(Logger *logger, LogLevel::Level level, const LogEvent::ptr &event) override;
+
+        bool reopen();
+
+        std::string toYamlString() override;
+
+    private:
+        std::string m_filename;
+        std::ofstream m_filestream;
+    };
+
+    // log appender for file rotated by size and/or by hour/day.
+    // rotated files are renamed to <file>.<YYYYmmdd-HHMMSS>, compressed and pruned on a background thread
+    class RollingFileLogAppender : public LogAppender
+    {
+    public:
+        typedef std::shared_ptr<RollingFileLogAppender> ptr;
+        enum Interval
+        {
+            NONE = 0,
+            HOUR = 1,
+            DAY = 2
+        };
+
+        // max_size 0: no size limit, max_files 0: keep all rotated files
+        RollingFileLogAppender(const std::string &filename, uint64_t max_size = 0, Interval interval = NONE,
+                               uint32_t max_files = 0, bool compress = true);
+
+        void log(Logger *logger, LogLevel::Level level, const LogEvent::ptr &event) override;
+
+        std::string toYamlString() override;
+
+        static const char *ToString(Interval interval);
+        static Interval FromString(const std::string &str);
+
+    private:
+        bool open();
+        void rotate(uint64_t now);
+        uint64_t nextRollTime(uint64_t now) const;
+
+    private:
+        std::string m_filename;
+        uint64_t m_maxSize;
+        Interval m_interval;
+        uint32_t m_maxFiles;
+        bool m_compress;
+
+        std::ofstream m_filestream;
+        uint64_t m_size{0};
+        uint64_t m_nextRollTime{0};
+        uint64_t m_lastRotateTime{0};
+        uint32_t m_rotateSeq{0};
+    };
+
+    // log appender for compact binary records, see tools/log_decode
+    class BinaryLogAppender : public LogAppender
+    {
+    public:
+        typedef std::shared_ptr<BinaryLogAppender> ptr;
+        BinaryLogAppender(const std::string &filename);
+
+        void log(Logger *logger, LogLevel::Level level, const LogEvent::ptr &event) override;
 
         bool reopen();
 
@@ -238,7 +452,98 @@ namespace sylar
     private:
         std::string m_filename;
         std::ofstream m_filestream;
-        uint64_t m_lastOpenTime{0};
+        BinaryLogEncoder m_encoder;
+        std::string m_buffer;
+    };
+
+    // log appender writing into shared mappings of the file, no syscall on the log path.
+    // writers reserve space with one fetch_add and copy the record into the mapped window(s);
+    // a background thread preallocates and maps windows ahead and unmaps filled ones.
+    // the page cache owns the data as soon as it is copied, so it survives a process crash.
+    // the file is trimmed to its real size on close; after a crash the zero filled tail is
+    // skipped when the file is opened again
+    class MmapFileLogAppender : public LogAppender
+    {
+    public:
+        typedef std::shared_ptr<MmapFileLogAppender> ptr;
+
+        // window_size is rounded up to the page size, records longer than a window are truncated
+        MmapFileLogAppender(const std::string &filename, uint64_t window_size = 4 << 20);
+        ~MmapFileLogAppender();
+
+        void log(Logger *logger, LogLevel::Level level, const LogEvent::ptr &event) override;
+
+        std::string toYamlString() override;
+
+    private:
+        struct Window
+        {
+            std::atomic<uint64_t> index{~0ull};
+            char *addr = nullptr;
+            std::atomic<uint64_t> committed{0};
+        };
+        static const size_t WINDOWS = 4;
+
+        bool open();
+        void close();
+        bool map(Window &window, uint64_t index);
+        void write(const char *data, size_t len);
+        void run();
+
+    private:
+        std::string m_filename;
+        uint64_t m_windowSize;
+        int m_fd{-1};
+        std::atomic<uint64_t> m_offset{0};
+        std::atomic<bool> m_error{false};
+        std::atomic<bool> m_stop{false};
+        Window m_windows[WINDOWS];
+        DefaultSemaphore m_sem;
+        Thread::ptr m_thread;
+    };
+
+    // one json object or logfmt line per event, fields added with kv() follow the standard ones.
+    // events are serialized straight into a reused buffer, the formatter is not used
+    class JsonLogAppender : public LogAppender
+    {
+    public:
+        typedef std::shared_ptr<JsonLogAppender> ptr;
+        enum Encoding
+        {
+            JSON = 0,
+            LOGFMT = 1
+        };
+
+        // empty filename writes to stdout
+        JsonLogAppender(const std::string &filename = "", Encoding encoding = JSON);
+
+        void log(Logger *logger, LogLevel::Level level, const LogEvent::ptr &event) override;
+
+        bool reopen();
+
+        std::string toYamlString() override;
+
+        static const char *ToString(Encoding encoding);
+        static Encoding FromString(const std::string &str);
+
+    private:
+        void appendTime(uint64_t us);
+        void appendKey(const char *key, size_t len);
+        void appendString(const char *str, size_t len);
+        void appendString(const std::string &str) { appendString(str.data(), str.size()); }
+        void appendValue(const binlog::ArgView &v);
+        template <class T>
+        void appendInt(T v);
+
+    private:
+        std::string m_filename;
+        Encoding m_encoding;
+        std::ofstream m_filestream;
+        std::string m_buffer;
+        // "2006-01-02T15:04:05" of the last second seen, and the utc offset
+        time_t m_lastSec{-1};
+        std::string m_timeText;
+        std::string m_zoneText;
     };
 
     class LoggerManager
@@ -0,0 +1,211 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <iostream>
+#include <type_traits>
+
+namespace sylar
+{
+    class LogEvent;
+
+    // call site of a LOG_BIN_* statement, interned once per site
+    struct LogSite
+    {
+        uint32_t id = 0;
+        const char *file = nullptr;
+        int32_t line = 0;
+        const char *fmt = nullptr;
+    };
+
+    class LogSiteRegistry
+    {
+    public:
+        // register a LOG_BIN_* site, the macro caches the id in a function local static
+        static uint32_t Register(const char *file, int32_t line, const char *fmt);
+
+        // site for a plain text event, looked up by file and line on every call
+        static uint32_t Intern(const char *file, int32_t line);
+
+        static bool Get(uint32_t id, LogSite &site);
+    };
+
+    namespace binlog
+    {
+        // record layout (host byte order):
+        //   'H' magic[4] version:u16                               stream start, resets all ids
+        //   'S' id:u32 line:i32 file:str16 fmt:str32               site definition
+        //   'L' id:u32 name:str16                                  logger definition
+        //   'T' tid:i32 name:str16                                 thread name
+        //   'E' site:u32 logger:u32 level:u8 time_us:u64 tid:i32 fiber:u32 elapse:u32 args:str32
+        // args is a sequence of tagged values, see ArgType
+        static const char kMagic[4] = {'S', 'Y', 'L', 'B'};
+        static const uint16_t kVersion = 2;
+
+        enum ArgType : uint8_t
+        {
+            ARG_INT = 1,
+            ARG_UINT = 2,
+            ARG_DOUBLE = 3,
+            ARG_STRING = 4,
+            ARG_POINTER = 5,
+        };
+
+        template <class T>
+        inline void PutPod(std::string &buf, const T &v)
+        {
+            buf.append((const char *)&v, sizeof(v));
+        }
+
+        inline void PutString(std::string &buf, const char *str, uint32_t len)
+        {
+            buf.push_back((char)ARG_STRING);
+            PutPod(buf, len);
+            buf.append(str, len);
+        }
+
+        template <class T>
+        struct UnsupportedArg : std::false_type
+        {
+        };
+
+        template <class T>
+        inline void EncodeArg(std::string &buf, const T &v)
+        {
+            typedef typename std::decay<T>::type D;
+            if constexpr (std::is_same<D, std::string>::value)
+            {
+                PutString(buf, v.data(), v.size());
+            }
+            else if constexpr (std::is_same<D, char *>::value || std::is_same<D, const char *>::value)
+            {
+                const char *s = v ? (const char *)v : "(null)";
+                PutString(buf, s, strlen(s));
+            }
+            else if constexpr (std::is_floating_point<D>::value)
+            {
+                buf.push_back((char)ARG_DOUBLE);
+                PutPod(buf, (double)v);
+            }
+            else if constexpr (std::is_enum<D>::value)
+            {
+                buf.push_back((char)ARG_INT);
+                PutPod(buf, (int64_t)v);
+            }
+            else if constexpr (std::is_integral<D>::value && std::is_signed<D>::value)
+            {
+                buf.push_back((char)ARG_INT);
+                PutPod(buf, (int64_t)v);
+            }
+            else if constexpr (std::is_integral<D>::value)
+            {
+                buf.push_back((char)ARG_UINT);
+                PutPod(buf, (uint64_t)v);
+            }
+            else if constexpr (std::is_pointer<D>::value)
+            {
+                buf.push_back((char)ARG_POINTER);
+                PutPod(buf, (uint64_t)(uintptr_t)v);
+            }
+            else
+            {
+                static_assert(UnsupportedArg<D>::value, "unsupported binary log argument type");
+            }
+        }
+
+        template <class... Args>
+        inline void Encode(std::string &buf, const Args &...args)
+        {
+            (EncodeArg(buf, args), ...);
+        }
+
+        // one encoded value, str points into the encoded buffer
+        struct ArgView
+        {
+            ArgType type = ARG_INT;
+            int64_t i = 0;
+            uint64_t u = 0;
+            double d = 0;
+            const char *str = nullptr;
+            uint32_t len = 0;
+        };
+
+        // decode the value at pos and advance past it, false at the end or on corrupt input
+        bool NextArg(const std::string &buf, size_t &pos, ArgView &v);
+
+        // printf style rendering of encoded args, used by text appenders and the decoder
+        std::string Render(const char *fmt, const std::string &args);
+    }
+
+    // interns sites, loggers and threads for one output stream
+    class BinaryLogEncoder
+    {
+    public:
+        // start a new stream, every definition is emitted again
+        void reset(std::string &out);
+
+        void encode(std::string &out, const LogEvent &event);
+
+    private:
+        uint32_t loggerId(std::string &out, const LogEvent &event);
+
+    private:
+        std::vector<bool> m_sites;
+        std::unordered_map<const void *, std::pair<uint32_t, std::string>> m_loggers;
+        // ids are never reused within a stream, a re-bound logger gets a fresh one
+        uint32_t m_nextLoggerId = 0;
+        std::unordered_map<int32_t, std::string> m_threads;
+    };
+
+    struct BinaryLogRecord
+    {
+        std::string file;
+        int32_t line = 0;
+        std::string logger;
+        uint8_t level = 0;
+        uint64_t timeUs = 0;
+        int32_t threadId = 0;
+        std::string threadName;
+        uint32_t fiberId = 0;
+        uint32_t elapse = 0;
+        std::string message;
+    };
+
+    class BinaryLogReader
+    {
+    public:
+        BinaryLogReader(std::istream &is) : m_is(is) {}
+
+        // read the next event, false on end of stream or corrupt input
+        bool next(BinaryLogRecord &record);
+
+        bool isError() const { return m_error; }
+
+    private:
+        struct Site
+        {
+            int32_t line = 0;
+            std::string file;
+            std::string fmt;
+        };
+
+        bool readString16(std::string &str);
+        bool readString32(std::string &str);
+
+        template <class T>
+        bool read(T &v)
+        {
+            return (bool)m_is.read((char *)&v, sizeof(v));
+        }
+
+    private:
+        std::istream &m_is;
+        bool m_error = false;
+        std::unordered_map<uint32_t, Site> m_sites;
+        std::unordered_map<uint32_t, std::string> m_loggers;
+        std::unordered_map<int32_t, std::string> m_threads;
+    };
+}
@@ -0,0 +1,294 @@
+#pragma once
+
+#include <array>
+#include <charconv>
+#include <string_view>
+#include <utility>
+
+#include "log.h"
+
+// defines a compile time parsed formatter for pattern and registers it, so LogFormatter::Create
+// (and every formatter read from yaml) uses it whenever the exact same pattern is asked for.
+// must be used at namespace scope, pattern must be a string literal
+#define LOG_STATIC_PATTERN(name, pattern)  \
+    static constexpr char name[] = pattern; \
+    static const bool name##_registered = (sylar::LogFormatter::RegisterStatic(name, []() { return sylar::LogFormatter::ptr(new sylar::StaticLogFormatter<name>); }), true)
+
+namespace sylar
+{
+    namespace logfmt
+    {
+        enum ItemType
+        {
+            ITEM_STRING = 0,
+            ITEM_MESSAGE,
+            ITEM_LEVEL,
+            ITEM_ELAPSE,
+            ITEM_NAME,
+            ITEM_THREAD_ID,
+            ITEM_NEWLINE,
+            ITEM_DATETIME,
+            ITEM_FILENAME,
+            ITEM_LINE,
+            ITEM_FIBER_ID,
+            ITEM_TAB,
+            ITEM_THREAD_NAME,
+            ITEM_ERROR
+        };
+
+        // literal text, or a directive with its {arg}. begin/len point into the pattern
+        struct Item
+        {
+            ItemType type = ITEM_STRING;
+            size_t begin = 0;
+            size_t len = 0;
+        };
+
+        constexpr ItemType TypeOf(std::string_view key)
+        {
+            if (key.size() != 1)
+            {
+                return ITEM_ERROR;
+            }
+            switch (key[0])
+            {
+            case 'm':
+                return ITEM_MESSAGE;
+            case 'p':
+                return ITEM_LEVEL;
+            case 'r':
+                return ITEM_ELAPSE;
+            case 'c':
+                return ITEM_NAME;
+            case 't':
+                return ITEM_THREAD_ID;
+            case 'n':
+                return ITEM_NEWLINE;
+            case 'd':
+                return ITEM_DATETIME;
+            case 'f':
+                return ITEM_FILENAME;
+            case 'l':
+                return ITEM_LINE;
+            case 'F':
+                return ITEM_FIBER_ID;
+            case 'T':
+                return ITEM_TAB;
+            case 'N':
+                return ITEM_THREAD_NAME;
+            default:
+                return ITEM_ERROR;
+            }
+        }
+
+        constexpr bool IsAlpha(char c)
+        {
+            return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+        }
+
+        // same grammar as LogFormatter::init: %x %x{arg} %%.
+        // cb is called for every item, returns false on a malformed pattern
+        template <class F>
+        constexpr bool Parse(std::string_view p, F &&cb)
+        {
+            size_t text = 0;
+            size_t i = 0;
+            while (i < p.size())
+            {
+                if (p[i] != '%')
+                {
+                    ++i;
+                    continue;
+                }
+                if (i + 1 < p.size() && p[i + 1] == '%')
+                {
+                    cb(Item{ITEM_STRING, text, i + 1 - text});
+                    i += 2;
+                    text = i;
+                    continue;
+                }
+                if (i > text)
+                {
+                    cb(Item{ITEM_STRING, text, i - text});
+                }
+
+                size_t k = i + 1;
+                while (k < p.size() && IsAlpha(p[k]))
+                {
+                    ++k;
+                }
+                ItemType type = TypeOf(p.substr(i + 1, k - i - 1));
+                size_t arg = k;
+                size_t arg_len = 0;
+                if (k < p.size() && p[k] == '{')
+                {
+                    size_t end = p.find('}', k + 1);
+                    if (end == std::string_view::npos)
+                    {
+                        return false;
+                    }
+                    arg = k + 1;
+                    arg_len = end - k - 1;
+                    k = end + 1;
+                }
+                if (type == ITEM_ERROR)
+                {
+                    return false;
+                }
+                cb(Item{type, arg, arg_len});
+                i = k;
+                text = k;
+            }
+            if (text < p.size())
+            {
+                cb(Item{ITEM_STRING, text, p.size() - text});
+            }
+            return true;
+        }
+
+        constexpr bool Valid(std::string_view p)
+        {
+            return Parse(p, [](const Item &) {});
+        }
+
+        constexpr size_t Count(std::string_view p)
+        {
+            size_t n = 0;
+            Parse(p, [&n](const Item &)
+                  { ++n; });
+            return n;
+        }
+
+        template <size_t N>
+        constexpr std::array<Item, N> Items(std::string_view p)
+        {
+            std::array<Item, N> items{};
+            size_t n = 0;
+            Parse(p, [&items, &n](const Item &item)
+                  { items[n++] = item; });
+            return items;
+        }
+
+        template <class T>
+        inline void AppendInt(std::string &out, T v)
+        {
+            char buf[24];
+            auto rt = std::to_chars(buf, buf + sizeof(buf), v);
+            out.append(buf, rt.ptr - buf);
+        }
+    }
+
+    // formatter whose pattern is parsed by the compiler, format() is one straight line of appends.
+    // only %d keeps a runtime item for its per thread date cache
+    template <const char *Pattern>
+    class StaticLogFormatter : public LogFormatter
+    {
+    public:
+        typedef std::shared_ptr<StaticLogFormatter> ptr;
+
+        StaticLogFormatter()
+            : LogFormatter(Pattern, NoParse())
+        {
+            for (auto &item : kItems)
+            {
+                if (item.type == logfmt::ITEM_DATETIME)
+                {
+                    m_dates.push_back(CreateItem("d", std::string(Pattern + item.begin, item.len)));
+                }
+            }
+        }
+
+        std::string format(Logger *logger, LogLevel::Level level, const LogEvent::ptr &event) override
+        {
+            std::string out;
+            out.reserve(128);
+            append(out, logger, level, event, std::make_index_sequence<kCount>());
+            return out;
+        }
+
+    private:
+        static constexpr std::string_view kPattern{Pattern};
+        static_assert(logfmt::Valid(kPattern), "invalid log pattern");
+        static constexpr size_t kCount = logfmt::Count(kPattern);
+        static constexpr std::array<logfmt::Item, kCount> kItems = logfmt::Items<kCount>(kPattern);
+
+        // index of item I among the %d items
+        static constexpr size_t DateIndex(size_t index)
+        {
+            size_t n = 0;
+            for (size_t i = 0; i < index; ++i)
+            {
+                n += kItems[i].type == logfmt::ITEM_DATETIME;
+            }
+            return n;
+        }
+
+        template <size_t... I>
+        void append(std::string &out, Logger *logger, LogLevel::Level level, const LogEvent::ptr &event,
+                    std::index_sequence<I...>)
+        {
+            (appendItem<I>(out, logger, level, event), ...);
+        }
+
+        template <size_t I>
+        void appendItem(std::string &out, Logger *logger, LogLevel::Level level, const LogEvent::ptr &event)
+        {
+            constexpr logfmt::Item item = kItems[I];
+            if constexpr (item.type == logfmt::ITEM_STRING)
+            {
+                out.append(Pattern + item.begin, item.len);
+            }
+            else if constexpr (item.type == logfmt::ITEM_MESSAGE)
+            {
+                out += event->getContent();
+            }
+            else if constexpr (item.type == logfmt::ITEM_LEVEL)
+            {
+                out += LogLevel::ToString(level);
+            }
+            else if constexpr (item.type == logfmt::ITEM_ELAPSE)
+            {
+                logfmt::AppendInt(out, event->getElapse());
+            }
+            else if constexpr (item.type == logfmt::ITEM_NAME)
+            {
+                out += event->getLogger()->getName();
+            }
+            else if constexpr (item.type == logfmt::ITEM_THREAD_ID)
+            {
+                logfmt::AppendInt(out, event->getThreadId());
+            }
+            else if constexpr (item.type == logfmt::ITEM_NEWLINE)
+            {
+                out.push_back('\n');
+            }
+            else if constexpr (item.type == logfmt::ITEM_DATETIME)
+            {
+                m_dates[DateIndex(I)]->format(out, logger, level, event);
+            }
+            else if constexpr (item.type == logfmt::ITEM_FILENAME)
+            {
+                out += event->getFile();
+            }
+            else if constexpr (item.type == logfmt::ITEM_LINE)
+            {
+                logfmt::AppendInt(out, event->getLine());
+            }
+            else if constexpr (item.type == logfmt::ITEM_FIBER_ID)
+            {
+                logfmt::AppendInt(out, event->getFiberId());
+            }
+            else if constexpr (item.type == logfmt::ITEM_TAB)
+            {
+                out.push_back('\t');
+            }
+            else if constexpr (item.type == logfmt::ITEM_THREAD_NAME)
+            {
+                out += event->getThreadName();
+            }
+        }
+
+    private:
+        std::vector<FormatItem::ptr> m_dates;
+    };
+}
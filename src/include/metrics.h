@@ -0,0 +1,79 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <string>
+#include "noncopyable.h"
+
+// runtime counters and gauges of the scheduler, io manager, timers and fibers.
+// a Counter keeps one slot per thread: inc() is a relaxed load and store on the calling
+// thread's slot, no lock and no shared cache line. reads add up the slots of every thread.
+// a gauge is a callback that reads a current value (queue depth, pending events) when a
+// snapshot is taken. config metrics.dump_interval_ms > 0 logs a snapshot to the "metrics"
+// logger periodically
+namespace sylar
+{
+    class Metrics
+    {
+    public:
+        static const size_t MAX_COUNTERS = 64;
+        typedef std::function<int64_t()> Gauge;
+
+        // the counters of one thread. kept after the thread exits, handed to a later thread
+        struct Block
+        {
+            std::atomic<uint64_t> values[MAX_COUNTERS];
+        };
+
+        static Block *GetThreadBlock()
+        {
+            // initial-exec: a plain fs-relative load even from outside the library
+            static thread_local Block *t_block __attribute__((tls_model("initial-exec"))) = nullptr;
+            if (!t_block)
+            {
+                t_block = AcquireBlock();
+            }
+            return t_block;
+        }
+
+        // index of the counter called name, registered on first use
+        static size_t Register(const std::string &name);
+        // sum of counter index over all threads
+        static uint64_t Sum(size_t index);
+
+        // name -> gauge, key for DelGauge
+        static uint64_t AddGauge(const std::string &name, Gauge gauge);
+        // once it returns the gauge is not running and will not be called again
+        static void DelGauge(uint64_t key);
+
+        // every counter and gauge by name
+        static std::map<std::string, int64_t> GetSnapshot();
+        static std::string ToString(const std::map<std::string, int64_t> &snapshot);
+
+        static void StartDump(uint32_t interval_ms);
+        static void StopDump();
+
+    private:
+        static Block *AcquireBlock();
+    };
+
+    class Counter : eve::Noncopyable
+    {
+    public:
+        Counter(const std::string &name) : m_name(name), m_index(Metrics::Register(name)) {}
+
+        void inc(uint64_t n = 1)
+        {
+            std::atomic<uint64_t> &v = Metrics::GetThreadBlock()->values[m_index];
+            v.store(v.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+        }
+
+        uint64_t value() const { return Metrics::Sum(m_index); }
+        const std::string &getName() const { return m_name; }
+
+    private:
+        std::string m_name;
+        size_t m_index;
+    };
+}
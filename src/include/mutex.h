@@ -1,12 +1,23 @@
 #pragma once
 #include <pthread.h>
 #include <semaphore.h>
+#include <sched.h>
 #include <stdint.h>
 #include <atomic>
 #include "noncopyable.h"
 
 namespace sylar
 {
+    // tells the cpu we are busy waiting
+    inline void CpuRelax()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#elif defined(__aarch64__)
+        asm volatile("yield" ::: "memory");
+#endif
+    }
+
     class Semaphore : eve::Noncopyable
     {
     public:
@@ -25,6 +36,41 @@ namespace sylar
         sem_t m_semaphore;
     };
 
+    // counting semaphore on a futex. wait() spins a little before sleeping,
+    // notify() only enters the kernel when somebody sleeps
+    class FutexSemaphore : eve::Noncopyable
+    {
+    public:
+        FutexSemaphore(uint32_t count = 0) : m_count(count) {}
+
+        void wait()
+        {
+            int32_t c = m_count.load(std::memory_order_relaxed);
+            if (c > 0 && m_count.compare_exchange_strong(c, c - 1, std::memory_order_acquire, std::memory_order_relaxed))
+            {
+                return;
+            }
+            waitSlow();
+        }
+
+        void notify()
+        {
+            m_count.fetch_add(1, std::memory_order_seq_cst);
+            if (m_waiters.load(std::memory_order_seq_cst) > 0)
+            {
+                wake();
+            }
+        }
+
+    private:
+        void waitSlow();
+        void wake();
+
+    private:
+        std::atomic<int32_t> m_count;
+        std::atomic<uint32_t> m_waiters{0};
+    };
+
     template <class T>
     struct ScopedLockImpl
     {
@@ -164,6 +210,45 @@ namespace sylar
         pthread_mutex_t m_mutex;
     };
 
+    // mutex on a futex: 0 free, 1 locked, 2 locked with sleepers.
+    // an uncontended lock/unlock is one atomic each, a contended lock spins with
+    // exponential backoff while the owner is likely to release soon, then sleeps
+    class FutexMutex : eve::Noncopyable
+    {
+    public:
+        typedef ScopedLockImpl<FutexMutex> Lock;
+
+        void lock()
+        {
+            uint32_t c = 0;
+            if (!m_state.compare_exchange_strong(c, 1, std::memory_order_acquire, std::memory_order_relaxed))
+            {
+                lockSlow();
+            }
+        }
+
+        bool tryLock()
+        {
+            uint32_t c = 0;
+            return m_state.compare_exchange_strong(c, 1, std::memory_order_acquire, std::memory_order_relaxed);
+        }
+
+        void unlock()
+        {
+            if (m_state.exchange(0, std::memory_order_release) == 2)
+            {
+                wake();
+            }
+        }
+
+    private:
+        void lockSlow();
+        void wake();
+
+    private:
+        std::atomic<uint32_t> m_state{0};
+    };
+
     class NullMutex
     {
     public:
@@ -250,27 +335,52 @@ namespace sylar
         pthread_spinlock_t m_lock;
     };
 
+    // test and test-and-set: waiters spin on a plain load so the cache line stays shared,
+    // with exponential backoff and a yield once the backoff is maxed out
     class CASLock : eve::Noncopyable
     {
     public:
         typedef ScopedLockImpl<CASLock> Lock;
-        CASLock()
-        {
-            m_mutex.clear();
-        }
+        CASLock() {}
         ~CASLock() {}
 
         void lock()
         {
-            while (std::atomic_flag_test_and_set_explicit(&m_mutex, std::memory_order_acquire))
-                ;
+            uint32_t backoff = 1;
+            while (m_locked.exchange(true, std::memory_order_acquire))
+            {
+                while (m_locked.load(std::memory_order_relaxed))
+                {
+                    if (backoff < 1024)
+                    {
+                        for (uint32_t i = 0; i < backoff; ++i)
+                        {
+                            CpuRelax();
+                        }
+                        backoff <<= 1;
+                    }
+                    else
+                    {
+                        sched_yield();
+                    }
+                }
+            }
         }
         void unlock()
         {
-            std::atomic_flag_clear_explicit(&m_mutex, std::memory_order_release);
+            m_locked.store(false, std::memory_order_release);
         }
 
     private:
-        volatile std::atomic_flag m_mutex;
+        std::atomic<bool> m_locked{false};
     };
+
+    // the lock used by the scheduler, iomanager and loggers, see SYLAR_USE_FUTEX in CMakeLists.txt
+#ifdef SYLAR_USE_FUTEX
+    typedef FutexMutex DefaultMutex;
+    typedef FutexSemaphore DefaultSemaphore;
+#else
+    typedef Mutex DefaultMutex;
+    typedef Semaphore DefaultSemaphore;
+#endif
 }
\ No newline at end of file
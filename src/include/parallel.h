@@ -0,0 +1,97 @@
+#pragma once
+
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <vector>
+#include "scheduler.h"
+
+// data parallel loops on the Scheduler's worker threads instead of extra std::threads.
+// [begin, end) is cut into chunks of grain indexes that workers and the calling fiber
+// claim one at a time, so a slow chunk does not hold back the others. the caller parks
+// (fiber) or blocks (plain thread) until every chunk is done, which also makes nested
+// loops safe: an inner loop's caller never holds a worker thread while it waits.
+// the first exception thrown by a chunk skips the remaining chunks and is rethrown
+namespace sylar
+{
+    // runs fn(chunk, b, e) for every chunk of [begin, end). grain 0 picks about 8 chunks
+    // per worker. runs on scheduler, the current one when null, inline without either
+    void ParallelChunks(size_t begin, size_t end, size_t grain,
+                        const std::function<void(size_t chunk, size_t b, size_t e)> &fn,
+                        Scheduler *scheduler = nullptr);
+
+    // the grain ParallelChunks would use for [begin, end) right now. grain 0 depends on the
+    // worker count, which may change between two calls: resolve it once and pass the result
+    size_t ParallelGrain(size_t begin, size_t end, size_t grain, Scheduler *scheduler = nullptr);
+
+    // fn(i) for every i in [begin, end)
+    template <class F>
+    void ParallelFor(size_t begin, size_t end, F fn, size_t grain = 0, Scheduler *scheduler = nullptr)
+    {
+        ParallelChunks(begin, end, grain, [&fn](size_t, size_t b, size_t e)
+                       {
+                           for (size_t i = b; i < e; ++i)
+                           {
+                               fn(i);
+                           } },
+                       scheduler);
+    }
+
+    // acc = fn(b, e, identity) for every chunk, the partial results are combined with
+    // join in index order, join only has to be associative
+    template <class T, class F, class J>
+    T ParallelReduce(size_t begin, size_t end, T identity, F fn, J join, size_t grain = 0, Scheduler *scheduler = nullptr)
+    {
+        if (end <= begin)
+        {
+            return identity;
+        }
+        grain = ParallelGrain(begin, end, grain, scheduler);
+        std::vector<T> partial((end - begin + grain - 1) / grain, identity);
+        ParallelChunks(begin, end, grain, [&](size_t chunk, size_t b, size_t e)
+                       { partial[chunk] = fn(b, e, identity); },
+                       scheduler);
+        T result = identity;
+        for (auto &i : partial)
+        {
+            result = join(result, i);
+        }
+        return result;
+    }
+
+    // sorts one run per worker in parallel, then merges neighbouring runs in parallel rounds.
+    // more runs would balance better but every doubling costs another merge pass
+    template <class RandomIt, class Compare>
+    void ParallelSort(RandomIt first, RandomIt last, Compare comp, Scheduler *scheduler = nullptr)
+    {
+        size_t n = std::distance(first, last);
+        scheduler = scheduler ? scheduler : Scheduler::GetThis();
+        size_t runs = scheduler ? scheduler->getThreadCount() : 1;
+        if (n < 4096 || runs < 2)
+        {
+            std::sort(first, last, comp);
+            return;
+        }
+        size_t run = (n + runs - 1) / runs;
+        ParallelChunks(0, n, run, [&](size_t, size_t b, size_t e)
+                       { std::sort(first + b, first + e, comp); },
+                       scheduler);
+        for (; run < n; run *= 2)
+        {
+            size_t pairs = (n + 2 * run - 1) / (2 * run);
+            ParallelChunks(0, pairs, 1, [&](size_t, size_t b, size_t)
+                           {
+                               size_t lo = b * 2 * run;
+                               size_t mid = std::min(lo + run, n);
+                               size_t hi = std::min(lo + 2 * run, n);
+                               std::inplace_merge(first + lo, first + mid, first + hi, comp); },
+                           scheduler);
+        }
+    }
+
+    template <class RandomIt>
+    void ParallelSort(RandomIt first, RandomIt last, Scheduler *scheduler = nullptr)
+    {
+        ParallelSort(first, last, std::less<>(), scheduler);
+    }
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include "noncopyable.h"
+
+namespace sylar
+{
+    // minimal read-copy-update.
+    // readers only bump a counter owned by their thread, writers publish a new pointer
+    // and retire the old one, which is freed after every reader that could still see it has left.
+    // read sections must be short and must not switch fibers.
+    class Rcu
+    {
+    public:
+        class ReadLock : eve::Noncopyable
+        {
+        public:
+            ReadLock() { Rcu::ReadLockEnter(); }
+            ~ReadLock() { Rcu::ReadLockLeave(); }
+        };
+
+        // read sections nest
+        static void ReadLockEnter();
+        static void ReadLockLeave();
+
+        static bool InReadSection();
+
+        // wait until every read section that started before the call has finished.
+        // must not be called inside a read section
+        static void Synchronize();
+
+        // run cb once no reader can see the retired data.
+        // called inside a read section the callback is deferred to the next Retire.
+        static void Retire(std::function<void()> cb);
+    };
+
+    // immutable value published through Rcu
+    template <class T>
+    class RcuPtr : eve::Noncopyable
+    {
+    public:
+        RcuPtr(T *v = nullptr) : m_ptr(v) {}
+        ~RcuPtr() { delete m_ptr.load(std::memory_order_relaxed); }
+
+        // only valid inside a Rcu::ReadLock
+        const T *get() const { return m_ptr.load(std::memory_order_acquire); }
+
+        // writers must be serialized by the caller
+        void publish(T *v)
+        {
+            T *old = m_ptr.exchange(v, std::memory_order_acq_rel);
+            if (old)
+            {
+                Rcu::Retire([old]()
+                            { delete old; });
+            }
+        }
+
+    private:
+        std::atomic<T *> m_ptr;
+    };
+}
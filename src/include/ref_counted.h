@@ -0,0 +1,114 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+namespace sylar
+{
+#ifdef SYLAR_REF_STATS
+    // refcount increments and decrements made by this thread, read by bench_fiber_ref
+    inline thread_local uint64_t t_ref_ops = 0;
+#define SYLAR_REF_OP() ++sylar::t_ref_ops
+#else
+#define SYLAR_REF_OP()
+#endif
+
+    // intrusive reference count for objects handed around by RefPtr.
+    // the count lives in the object, so a raw pointer to a live object can always be
+    // turned back into an owning RefPtr, and code that only borrows never touches it
+    template <class T>
+    class RefCounted
+    {
+    public:
+        void ref() const
+        {
+            SYLAR_REF_OP();
+            m_refs.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        void unref() const
+        {
+            SYLAR_REF_OP();
+            if (m_refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            {
+                delete static_cast<const T *>(this);
+            }
+        }
+
+        uint32_t getRefCount() const { return m_refs.load(std::memory_order_relaxed); }
+
+    protected:
+        RefCounted() {}
+        ~RefCounted() {}
+
+        RefCounted(const RefCounted &) = delete;
+        RefCounted &operator=(const RefCounted &) = delete;
+
+    private:
+        mutable std::atomic<uint32_t> m_refs{0};
+    };
+
+    // owning handle for a RefCounted object, the shared_ptr subset the scheduler uses.
+    // copies cost one atomic add, moves and raw get() cost none
+    template <class T>
+    class RefPtr
+    {
+    public:
+        RefPtr() {}
+        RefPtr(std::nullptr_t) {}
+        explicit RefPtr(T *p) : m_ptr(p)
+        {
+            if (m_ptr)
+            {
+                m_ptr->ref();
+            }
+        }
+        RefPtr(const RefPtr &o) : RefPtr(o.m_ptr) {}
+        RefPtr(RefPtr &&o) : m_ptr(std::exchange(o.m_ptr, nullptr)) {}
+
+        ~RefPtr()
+        {
+            if (m_ptr)
+            {
+                m_ptr->unref();
+            }
+        }
+
+        RefPtr &operator=(const RefPtr &o)
+        {
+            RefPtr(o).swap(*this);
+            return *this;
+        }
+
+        RefPtr &operator=(RefPtr &&o)
+        {
+            RefPtr(std::move(o)).swap(*this);
+            return *this;
+        }
+
+        RefPtr &operator=(std::nullptr_t)
+        {
+            reset();
+            return *this;
+        }
+
+        void reset() { RefPtr().swap(*this); }
+        void reset(T *p) { RefPtr(p).swap(*this); }
+
+        void swap(RefPtr &o) { std::swap(m_ptr, o.m_ptr); }
+
+        T *get() const { return m_ptr; }
+        T &operator*() const { return *m_ptr; }
+        T *operator->() const { return m_ptr; }
+        explicit operator bool() const { return m_ptr != nullptr; }
+
+        bool operator==(const RefPtr &o) const { return m_ptr == o.m_ptr; }
+        bool operator==(std::nullptr_t) const { return m_ptr == nullptr; }
+        bool operator<(const RefPtr &o) const { return m_ptr < o.m_ptr; }
+
+    private:
+        T *m_ptr = nullptr;
+    };
+}
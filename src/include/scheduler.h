@@ -5,6 +5,8 @@
 #include <memory>
 #include <vector>
 #include <list>
+#include <algorithm>
+#include <array>
 namespace sylar
 {
 
@@ -13,14 +15,49 @@ namespace sylar
     // 2. schedule fiber execution to thread
     class Scheduler
     {
+        friend struct FiberWaiter;
+
     public:
         typedef std::shared_ptr<Scheduler> ptr;
-        typedef Mutex MutexType;
+        typedef DefaultMutex MutexType;
+
+        // io completions and timers run at HIGH, new work at NORMAL. a fiber woken from a
+        // sleep or a fiber_sync wait goes back at the priority it was running at
+        enum Priority
+        {
+            HIGH = 0,
+            NORMAL = 1,
+            LOW = 2,
+        };
+        static const int PRIORITY_COUNT = 3;
 
         Scheduler(size_t threadCount = 1, bool use_caller = true, const std::string &name = "");
         virtual ~Scheduler();
 
         const std::string &getName() const { return m_name; }
+        size_t getThreadCount() const { return m_threadCount; }
+
+        // all zero (the default): strict, a task only runs when no higher priority task is
+        // queued. otherwise weighted: out of high + normal + low dequeues in a row, each level
+        // gets its weight while it has work, so bulk LOW work is never starved
+        void setPriorityWeights(uint32_t high, uint32_t normal, uint32_t low);
+
+        // worker i is pinned to cpus[i % cpus.size()], running workers move before their
+        // next task. empty keeps the current placement. the default comes from
+        // scheduler.cpu_affinity, the use_caller thread is never pinned
+        void setCpuAffinity(const std::vector<int> &cpus);
+        std::vector<int> getCpuAffinity();
+
+        // grows or shrinks the workers of a running scheduler. a surplus worker retires
+        // when it runs out of work, tasks pinned to its thread then run on any worker.
+        // retired threads are joined by the next resize. to follow a ConfigVar, call it
+        // from a listener
+        void setThreadCount(size_t count);
+
+        // adds a worker when tasks queue up with no idle worker and removes one once
+        // more than half the workers have been idle for a second, within [min, max].
+        // max 0 (the default) turns it off
+        void setAutoScale(size_t min, size_t max);
 
         // get the schduler instance
         static Scheduler *GetThis();
@@ -32,12 +69,12 @@ namespace sylar
         void stop();
 
         template <class FiberOrCb>
-        void schedule(FiberOrCb fc, int thread = -1)
+        void schedule(FiberOrCb fc, int thread = -1, Priority priority = NORMAL)
         {
             bool need_tickle = false;
             {
                 MutexType::Lock lock(m_mutex);
-                need_tickle = scheduleNoLock(fc, thread);
+                need_tickle = scheduleNoLock(std::move(fc), thread, priority);
             }
             if (need_tickle)
             {
@@ -46,14 +83,14 @@ namespace sylar
         }
 
         template <class InputIterator>
-        void schedule(InputIterator begin, InputIterator end)
+        void schedule(InputIterator begin, InputIterator end, Priority priority = NORMAL)
         {
             bool need_tickle = false;
             {
                 MutexType::Lock lock(m_mutex);
                 while (begin != end)
                 {
-                    need_tickle |= scheduleNoLock(&*begin, -1); // swap the content
+                    need_tickle |= scheduleNoLock(&*begin, -1, priority); // swap the content
                     ++begin;
                 }
             }
@@ -64,6 +101,11 @@ namespace sylar
         }
 
     protected:
+        // gauge "<prefix>.<name>" of this scheduler, removed with it
+        void addGauge(const std::string &prefix, const std::string &name, std::function<int64_t()> gauge);
+        // a subclass removes them before its members go away
+        void delGauges();
+
         virtual void tickle();
 
         void run();
@@ -76,15 +118,32 @@ namespace sylar
 
         bool hasIdleThreads() { return m_idleThreads > 0; }
 
+        // the calling worker was removed by setThreadCount and may leave its idle loop
+        bool retiring();
+
+        // a removed worker still waits in its idle loop. tickles that woke another idle
+        // worker are passed on until it is the one woken
+        bool hasIdleRetired();
+
+        // idle loops wake up at least every second so autoScale can shrink the pool
+        bool isAutoScaling() const { return m_autoMax > 0; }
+
     private:
         template <class FiberOrCb>
-        bool scheduleNoLock(FiberOrCb fc, int thread)
+        bool scheduleNoLock(FiberOrCb fc, int thread, Priority priority)
         {
-            bool need_tickle = m_fibers.empty();
-            FiberAndThread ft(fc, thread);
+            bool need_tickle = m_queued == 0;
+            // a pin to a worker that is gone, retired by setThreadCount, would never run
+            if (thread != -1 && std::find(m_threadIds.begin(), m_threadIds.end(), thread) == m_threadIds.end())
+            {
+                thread = -1;
+            }
+            FiberAndThread ft(std::move(fc), thread);
             if (ft.fiber || ft.cb)
             {
-                m_fibers.push_back(ft);
+                ft.priority = priority;
+                m_fibers[priority].push_back(std::move(ft));
+                ++m_queued;
             }
             return need_tickle;
         }
@@ -95,9 +154,10 @@ namespace sylar
             Fiber::ptr fiber;
             std::function<void()> cb;
             int thread;
+            Priority priority = NORMAL;
 
             FiberAndThread(Fiber::ptr fiber, int thr)
-                : fiber(fiber), thread(thr) {};
+                : fiber(std::move(fiber)), thread(thr) {};
             FiberAndThread(Fiber::ptr *f, int thr)
                 : thread(thr)
             {
@@ -105,7 +165,7 @@ namespace sylar
             }
 
             FiberAndThread(std::function<void()> cb, int thr)
-                : cb(cb), thread(thr) {}
+                : cb(std::move(cb)), thread(thr) {}
 
             FiberAndThread(std::function<void()> *c, int thr)
                 : thread(thr)
@@ -120,14 +180,31 @@ namespace sylar
                 fiber = nullptr;
                 cb = nullptr;
                 thread = -1;
+                priority = NORMAL;
             }
         };
 
+        // moves the next task this thread may run into ft. tickle is set when tasks
+        // are left for other threads
+        bool takeNoLock(FiberAndThread &ft, bool &tickle);
+        // pins a worker thread when the affinity changed since pinned
+        void applyAffinity(uint32_t &pinned);
+        // m_mutex held
+        void startWorkerNoLock();
+        // one setAutoScale decision, at most every 100ms. idle: the calling worker found no task
+        void autoScale(bool idle);
+        // joins the retired workers that have left run()
+        void reapRetired();
+        // a retiring worker leaving run(): its pins are dropped, reapRetired may join it
+        void retireWorker();
+
     protected:
         std::vector<int> m_threadIds{};
-        size_t m_threadCount{0};
+        std::atomic<size_t> m_threadCount{0};
         std::atomic<size_t> m_activeThreads{0};
         std::atomic<size_t> m_idleThreads{0};
+        // fibers parked on a FiberMutex, Channel.. that will be scheduled here when woken
+        std::atomic<size_t> m_parkedFibers{0};
 
         bool m_stopping{true};
         bool m_autoStop{false};
@@ -137,7 +214,33 @@ namespace sylar
     private:
         MutexType m_mutex;
         std::vector<Thread::ptr> m_threads;
-        std::list<FiberAndThread> m_fibers;
+        // flags of the worker at the same index in m_threads, shared with its thread
+        struct WorkerFlags
+        {
+            // set by setThreadCount, the worker leaves once idle
+            std::atomic<bool> retire{false};
+            // set by the worker as it leaves run(), joining it no longer blocks
+            std::atomic<bool> exited{false};
+            // the worker is in its idle fiber
+            std::atomic<bool> idle{false};
+        };
+        std::vector<std::shared_ptr<WorkerFlags>> m_workers;
+        // removed workers not joined yet, by reapRetired or stop()
+        std::list<std::pair<Thread::ptr, std::shared_ptr<WorkerFlags>>> m_retired;
+        size_t m_autoMin{0};
+        size_t m_autoMax{0};
+        std::atomic<uint64_t> m_lastScale{0};
+        // Metrics gauges, removed by the destructor
+        std::vector<uint64_t> m_gauges;
+        // since when more than half the workers are idle, 0 when not
+        uint64_t m_idleSince{0};
+        std::vector<int> m_cpus;
+        std::atomic<uint32_t> m_affinityVersion{0};
+        std::list<FiberAndThread> m_fibers[PRIORITY_COUNT];
+        size_t m_queued{0};
+        std::array<uint32_t, PRIORITY_COUNT> m_weights{};
+        // dequeues left for each level in the current weighted round
+        std::array<uint32_t, PRIORITY_COUNT> m_credits{};
         std::string m_name;
         Fiber::ptr m_rootFiber;
     };
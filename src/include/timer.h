@@ -3,18 +3,19 @@
 #include <functional>
 #include <set>
 #include "mutex.h"
+#include "ref_counted.h"
 
 namespace sylar
 {
 
     class TimerManager;
 
-    class Timer : public std::enable_shared_from_this<Timer>
+    class Timer : public RefCounted<Timer>
     {
         friend class TimerManager;
 
     public:
-        typedef std::shared_ptr<Timer> ptr;
+        typedef RefPtr<Timer> ptr;
 
         bool cancel();
         bool refresh();
@@ -60,6 +61,7 @@ namespace sylar
         void listExpiredCb(std::vector<std::function<void()>> &cbs);
 
         bool hasTimer();
+        size_t getTimerCount();
 
     protected:
         virtual void onTimerInsertedAtFront() = 0;
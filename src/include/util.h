@@ -18,9 +18,26 @@ namespace sylar
     void Backtrace(std::vector<std::string> &bt, int size, int skip = 1);
 
     std::string BacktraceToString(int size, int skip = 2, const std::string &prefix = "");
+    // frames captured earlier by ::backtrace, possibly on another thread
+    std::string BacktraceToString(void *const *frames, int size, int skip = 0, const std::string &prefix = "");
 
     // time
     uint64_t GetCurrentMS();
     uint64_t GetCurrentUS();
 
+    // cpu topology
+    // cpus this process may run on
+    std::vector<int> GetOnlineCpus();
+    // the first cpu of every physical core, hyperthread siblings skipped
+    std::vector<int> GetPhysicalCoreCpus();
+    // numa node of cpu, 0 without numa
+    int GetCpuNode(int cpu);
+    int GetNumaNodeCount();
+    // "0,2,4-7" or "physical", empty on a parse error
+    std::vector<int> ParseCpuList(const std::string &str);
+    // pins the calling thread to cpu
+    bool SetThreadAffinity(int cpu);
+    // numa node the calling thread was pinned to by SetThreadAffinity, -1 when not pinned
+    int GetThreadNumaNode();
+
 } // namespace sylar
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdint.h>
+
+// a fiber that never yields holds its worker thread, everything queued behind it waits.
+// Scheduler::run stamps when each fiber is switched in. the watchdog thread (config
+// fiber.watchdog) looks at the stamps and logs the backtrace of every fiber that has been
+// running for longer than fiber.run_budget_ms, once per run. long loops can call
+// MaybeYield() to give the worker back once they are over the same budget
+namespace sylar
+{
+    class Watchdog
+    {
+    public:
+        static void Start();
+        static void Stop();
+
+        // called by Scheduler::run on worker threads
+        static void RegisterThread();
+        static void UnregisterThread();
+        static void RunBegin(uint64_t fiber_id);
+        static void RunEnd();
+
+        // microseconds the current fiber has been running, 0 outside a scheduler
+        static uint64_t GetRunTime();
+    };
+
+    // yields the current scheduler fiber when it has run for longer than fiber.run_budget_ms,
+    // true when it did. cheap enough for the inside of a loop
+    bool MaybeYield();
+}
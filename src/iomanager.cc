@@ -1,6 +1,7 @@
 #include "iomanager.h"
 #include "macro.h"
 #include "log.h"
+#include "metrics.h"
 
 #include <errno.h>
 #include <fcntl.h>
@@ -13,6 +14,10 @@ namespace sylar
 
     static Logger::ptr g_logger = LOG_NAME("system");
 
+    static Counter s_tickles("iomanager.tickles");
+    static Counter s_wakeups("iomanager.epoll_wakeups");
+    static Counter s_events("iomanager.events");
+
     IOManager::FdContext::EventContext &IOManager::FdContext::getContext(Event event)
     {
         switch (event)
@@ -40,13 +45,14 @@ namespace sylar
         events = (Event)(events & ~event);
         EventContext &ctx = getContext(event);
 
+        // the waiter already holds resources, finish it before new work
         if (ctx.cb)
         {
-            ctx.scheduler->schedule(&ctx.cb);
+            ctx.scheduler->schedule(&ctx.cb, -1, Scheduler::HIGH);
         }
         else
         {
-            ctx.scheduler->schedule(&ctx.fiber);
+            ctx.scheduler->schedule(&ctx.fiber, -1, Scheduler::HIGH);
         }
         ctx.scheduler = nullptr;
     }
@@ -74,12 +80,18 @@ namespace sylar
 
         contextResize(32);
 
+        addGauge("iomanager", "pending_events", [this]()
+                 { return (int64_t)m_pendingEventCount; });
+        addGauge("iomanager", "timers", [this]()
+                 { return (int64_t)getTimerCount(); });
+
         start();
     }
 
     IOManager::~IOManager()
     {
         stop();
+        delGauges();
         close(m_epfd);
         close(m_tickleFds[0]);
         close(m_tickleFds[1]);
@@ -139,10 +151,10 @@ namespace sylar
         int rt = epoll_ctl(m_epfd, op, fd, &epevent);
         if (rt != 0)
         {
-            LOG_ERROR(g_logger) << "epoll_ctl(" << m_epfd << ", "
-                                << op << ", " << fd << ", " << (EPOLL_EVENTS)epevent.events << "):"
-                                << rt << " (" << errno << ") (" << strerror(errno) << ") fd_ctx->events="
-                                << (EPOLL_EVENTS)fd_ctx->events;
+            LOG_ERROR_PER_SEC(g_logger, 10) << "epoll_ctl(" << m_epfd << ", "
+                                            << op << ", " << fd << ", " << (EPOLL_EVENTS)epevent.events << "):"
+                                            << rt << " (" << errno << ") (" << strerror(errno) << ") fd_ctx->events="
+                                            << (EPOLL_EVENTS)fd_ctx->events;
             return -1;
         }
 
@@ -299,6 +311,7 @@ namespace sylar
         {
             return;
         }
+        s_tickles.inc();
         // write to trigger event
         int rt = write(m_tickleFds[1], "T", 1);
         _ASSERT(rt == 1);
@@ -328,11 +341,16 @@ namespace sylar
                 LOG_INFO(g_logger) << "name=" << getName() << " idle stopping exits.";
                 break;
             }
+            if (retiring())
+            {
+                LOG_INFO(g_logger) << "name=" << getName() << " idle worker retired.";
+                break;
+            }
             int rt = 0;
             do
             {
                 static const uint64_t MAX_TIMEOUT = 3000;
-                uint64_t next_timeout = std::min(MAX_TIMEOUT, getNextTimer());
+                uint64_t next_timeout = std::min(isAutoScaling() ? 1000 : MAX_TIMEOUT, getNextTimer());
 
                 rt = epoll_wait(m_epfd, events, 64, (int)next_timeout);
 
@@ -342,6 +360,7 @@ namespace sylar
                 }
                 break;
             } while (true);
+            s_wakeups.inc();
 
             // execute the timer events
             std::vector<std::function<void()>> cbs;
@@ -349,7 +368,7 @@ namespace sylar
             if (!cbs.empty())
             {
                 // LOG_DEBUG(g_logger) << "on timer cbs.size=" << cbs.size();
-                schedule(cbs.begin(), cbs.end());
+                schedule(cbs.begin(), cbs.end(), HIGH);
                 cbs.clear();
             }
 
@@ -365,6 +384,11 @@ namespace sylar
                     // use ET mode, so read all the data
                     while (read(m_tickleFds[0], dummy, sizeof(dummy)) > 0)
                         ;
+                    // one wakeup drains every tickle, the retired worker may still be waiting
+                    if (!retiring() && hasIdleRetired())
+                    {
+                        tickle();
+                    }
                     continue;
                 }
 
@@ -408,11 +432,13 @@ namespace sylar
                 {
                     fd_ctx->triggerEvent(READ);
                     --m_pendingEventCount;
+                    s_events.inc();
                 }
                 if (real_events & WRITE)
                 {
                     fd_ctx->triggerEvent(WRITE);
                     --m_pendingEventCount;
+                    s_events.inc();
                 }
             }
 
@@ -1,21 +1,47 @@
 #include "log.h"
+#include "log_static.h"
 
 #include <map>
 #include <functional>
 #include <stdarg.h>
 #include <algorithm>
 #include <cctype>
+#include <cmath>
+#include <charconv>
+#include <string.h>
+#include <atomic>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sched.h>
+#include <time.h>
+#include <zlib.h>
 #include "config.h"
 
 namespace sylar
 {
     LogEvent::LogEvent(std::shared_ptr<Logger> logger, LogLevel::Level level, const char *file, int32_t line, uint32_t elapse,
-                       int32_t threadId, std::string threadName, uint32_t fiberId, uint64_t time, const std::string &content)
+                       int32_t threadId, std::string threadName, uint32_t fiberId, uint64_t time_us, const std::string &content)
         : m_logger(logger), m_level(level), m_file(file), m_line(line), m_elapse(elapse), m_threadId(threadId),
-          m_threadName(std::move(threadName)), m_fiberId(fiberId), m_time(time), m_content(content) {};
+          m_threadName(std::move(threadName)), m_fiberId(fiberId), m_time(time_us), m_content(content) {};
 
     LogEvent::~LogEvent() {}
 
+    std::string LogEvent::getContent() const
+    {
+        if (m_site)
+        {
+            LogSite site;
+            if (LogSiteRegistry::Get(m_site, site))
+            {
+                return binlog::Render(site.fmt, m_args);
+            }
+        }
+        return m_content.str();
+    }
+
     void LogEvent::format(const char *fmt, va_list al)
     {
         char *buf = nullptr;
@@ -47,6 +73,136 @@ namespace sylar
 
     ////////////////////////////////////////////////////////////////
 
+    static ConfigVar<uint32_t>::ptr GetLimiterFlushVar()
+    {
+        static ConfigVar<uint32_t>::ptr s_var = Config::Lookup<uint32_t>("log.limiter_flush_ms", 1000,
+                                                                          "how often quiet rate limited log sites report what they suppressed, 0 is off");
+        return s_var;
+    }
+
+    // registered up front so a config file sees it before the first site exists
+    static ConfigVar<uint32_t>::ptr g_limiter_flush = GetLimiterFlushVar();
+
+    namespace
+    {
+        // every live site, plus the thread flushing them. never freed, the flusher may
+        // still be running while statics are destroyed at exit
+        struct LimiterState
+        {
+            Mutex mutex;
+            std::vector<LogLimiter *> sites;
+            Thread::ptr flusher;
+        };
+
+        LimiterState &GetLimiterState()
+        {
+            static LimiterState *s_state = new LimiterState;
+            return *s_state;
+        }
+
+        void FlushMain()
+        {
+            ConfigVar<uint32_t>::ptr interval = GetLimiterFlushVar();
+            while (true)
+            {
+                uint32_t ms = interval->getValue();
+                // when off, look again every second in case it is turned on
+                usleep((ms ? ms : 1000) * 1000ull);
+                if (ms)
+                {
+                    LogLimiter::FlushAll();
+                }
+            }
+        }
+    }
+
+    // a few ms of resolution is enough for one second windows and costs no syscall
+    static uint64_t GetCoarseMS()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+        return ts.tv_sec * 1000ul + ts.tv_nsec / 1000000;
+    }
+
+    LogLimiter::LogLimiter(std::shared_ptr<Logger> logger, LogLevel::Level level, const char *file, int32_t line, Mode mode, uint32_t n)
+        : m_logger(logger), m_level(level), m_file(file), m_line(line), m_mode(mode), m_n(n ? n : 1), m_windowStart(GetCoarseMS())
+    {
+        LimiterState &st = GetLimiterState();
+        Mutex::Lock lock(st.mutex);
+        st.sites.push_back(this);
+        if (!st.flusher)
+        {
+            st.flusher.reset(new Thread(&FlushMain, "log_limiter"));
+        }
+    }
+
+    LogLimiter::~LogLimiter()
+    {
+        LimiterState &st = GetLimiterState();
+        Mutex::Lock lock(st.mutex);
+        st.sites.erase(std::remove(st.sites.begin(), st.sites.end(), this), st.sites.end());
+    }
+
+    bool LogLimiter::allow()
+    {
+        uint64_t now = GetCoarseMS();
+        if (now - m_windowStart.load(std::memory_order_relaxed) >= 1000)
+        {
+            roll(now);
+        }
+
+        bool ok;
+        if (m_mode == EVERY_N)
+        {
+            ok = m_calls.fetch_add(1, std::memory_order_relaxed) % m_n == 0;
+        }
+        else
+        {
+            // plain load first so a saturated site does not keep bumping the counter
+            ok = m_passed.load(std::memory_order_relaxed) < m_n && m_passed.fetch_add(1, std::memory_order_relaxed) < m_n;
+        }
+        if (!ok)
+        {
+            m_suppressed.fetch_add(1, std::memory_order_relaxed);
+        }
+        return ok;
+    }
+
+    void LogLimiter::roll(uint64_t now)
+    {
+        uint64_t start = m_windowStart.load(std::memory_order_relaxed);
+        if (now - start < 1000 || !m_windowStart.compare_exchange_strong(start, now, std::memory_order_relaxed))
+        {
+            return;
+        }
+        m_passed.store(0, std::memory_order_relaxed);
+        uint64_t suppressed = m_suppressed.exchange(0, std::memory_order_relaxed);
+        if (suppressed && m_logger->getLevel() <= m_level)
+        {
+            LogEvent::ptr event(new LogEvent(m_logger, m_level, m_file, m_line, 0, GetThreadId(),
+                                             Thread::GetName(), GetFiberId(), GetCurrentUS(), ""));
+            event->getSS() << "suppressed " << suppressed << " messages in the last " << (now - start) << " ms";
+            m_logger->log(m_level, event);
+        }
+    }
+
+    void LogLimiter::FlushAll()
+    {
+        uint64_t now = GetCoarseMS();
+        LimiterState &st = GetLimiterState();
+        // held while logging so a site destroyed at exit is not flushed halfway
+        Mutex::Lock lock(st.mutex);
+        for (LogLimiter *i : st.sites)
+        {
+            if (i->m_suppressed.load(std::memory_order_relaxed))
+            {
+                i->roll(now);
+            }
+        }
+    }
+
+    ////////////////////////////////////////////////////////////////
+
     const char *LogLevel::ToString(LogLevel::Level level)
     {
         switch (level)
@@ -93,9 +249,9 @@ namespace sylar
     {
     public:
         MessageFormatItem(const std::string &str = "") {}
-        void format(std::ostream &os, Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event) override
+        void format(std::string &out, Logger *logger, LogLevel::Level level, const LogEvent::ptr &event) override
         {
-            os << event->getContent();
+            out += event->getContent();
         }
     };
 
@@ -103,9 +259,9 @@ namespace sylar
     {
     public:
         LevelFormatItem(const std::string &str = "") {}
-        void format(std::ostream &os, Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event) override
+        void format(std::string &out, Logger *logger, LogLevel::Level level, const LogEvent::ptr &event) override
         {
-            os << LogLevel::ToString(level);
+            out += LogLevel::ToString(level);
         }
     };
 
@@ -113,9 +269,9 @@ namespace sylar
     {
     public:
         ElapseFormatItem(const std::string &str = "") {}
-        void format(std::ostream &os, Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event) override
+        void format(std::string &out, Logger *logger, LogLevel::Level level, const LogEvent::ptr &event) override
         {
-            os << event->getElapse();
+            logfmt::AppendInt(out, event->getElapse());
         }
     };
 
@@ -123,9 +279,9 @@ namespace sylar
     {
     public:
         ThreadIdFormatItem(const std::string &str = "") {}
-        void format(std::ostream &os, Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event) override
+        void format(std::string &out, Logger *logger, LogLevel::Level level, const LogEvent::ptr &event) override
         {
-            os << event->getThreadId();
+            logfmt::AppendInt(out, event->getThreadId());
         }
     };
 
@@ -133,9 +289,9 @@ namespace sylar
     {
     public:
         ThreadNameFormatItem(const std::string &str = "") {}
-        void format(std::ostream &os, Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event) override
+        void format(std::string &out, Logger *logger, LogLevel::Level level, const LogEvent::ptr &event) override
         {
-            os << event->getThreadName();
+            out += event->getThreadName();
         }
     };
 
@@ -143,9 +299,9 @@ namespace sylar
     {
     public:
         FiberIdFormatItem(const std::string &str = "") {}
-        void format(std::ostream &os, Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event) override
+        void format(std::string &out, Logger *logger, LogLevel::Level level, const LogEvent::ptr &event) override
         {
-            os << event->getFiberId();
+            logfmt::AppendInt(out, event->getFiberId());
         }
     };
 
@@ -153,44 +309,137 @@ namespace sylar
     {
     public:
         NameFormatItem(const std::string &str = "") {}
-        void format(std::ostream &os, Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event) override
+        void format(std::string &out, Logger *logger, LogLevel::Level level, const LogEvent::ptr &event) override
         {
-            os << event->getLogger()->getName();
+            out += event->getLogger()->getName();
         }
     };
 
+    // %d{...} takes a strftime pattern plus %L (milliseconds) and %f (microseconds).
+    // the text for the current second is cached per thread, only the sub-second digits change per line
     class DateTimeFormatItem : public LogFormatter::FormatItem
     {
     public:
         DateTimeFormatItem(const std::string &str = "%Y-%m-%d %H:%M:%S")
-            : m_format(str)
+            : m_format(str), m_id(++s_id)
         {
             if (m_format.empty())
             {
                 m_format = "%Y-%m-%d %H:%M:%S";
             }
+
+            std::string part;
+            for (size_t i = 0; i < m_format.size(); ++i)
+            {
+                if (m_format[i] == '%' && i + 1 < m_format.size())
+                {
+                    char c = m_format[i + 1];
+                    if (c == 'L' || c == 'f')
+                    {
+                        m_parts.push_back(std::make_pair(0, part));
+                        m_parts.push_back(std::make_pair(c == 'L' ? 3 : 6, std::string()));
+                        part.clear();
+                        ++i;
+                        continue;
+                    }
+                    part.append(m_format, i, 2);
+                    ++i;
+                    continue;
+                }
+                part.push_back(m_format[i]);
+            }
+            m_parts.push_back(std::make_pair(0, part));
+        }
+
+        void format(std::string &out, Logger *logger, LogLevel::Level level, const LogEvent::ptr &event) override
+        {
+            uint64_t us = event->getTimeUs();
+            time_t sec = us / 1000000;
+            Cache &cache = t_cache[m_id % CACHE_SLOTS];
+            if (cache.id != m_id || cache.sec != sec)
+            {
+                update(cache, sec);
+            }
+            if (cache.fields.empty())
+            {
+                out += cache.text;
+                return;
+            }
+
+            char buf[256];
+            size_t len = std::min(cache.text.size(), sizeof(buf));
+            memcpy(buf, cache.text.data(), len);
+            for (auto &field : cache.fields)
+            {
+                uint32_t v = field.second == 3 ? (us % 1000000) / 1000 : us % 1000000;
+                for (int i = field.second - 1; i >= 0; --i)
+                {
+                    if (field.first + i < len)
+                    {
+                        buf[field.first + i] = '0' + v % 10;
+                    }
+                    v /= 10;
+                }
+            }
+            out.append(buf, len);
         }
-        void format(std::ostream &os, Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event) override
+
+    private:
+        static const size_t CACHE_SLOTS = 4;
+
+        struct Cache
+        {
+            uint64_t id = 0;
+            time_t sec = -1;
+            std::string text;
+            // offset and width of each sub-second field in text
+            std::vector<std::pair<size_t, int>> fields;
+        };
+
+        void update(Cache &cache, time_t sec)
         {
             struct tm tm;
-            time_t time = event->getTime();
-            localtime_r(&time, &tm);
-            char buf[64];
-            strftime(buf, sizeof(buf), m_format.c_str(), &tm);
-            os << buf;
+            localtime_r(&sec, &tm);
+            cache.id = m_id;
+            cache.sec = sec;
+            cache.text.clear();
+            cache.fields.clear();
+            char buf[128];
+            for (auto &part : m_parts)
+            {
+                if (part.first)
+                {
+                    cache.fields.push_back(std::make_pair(cache.text.size(), part.first));
+                    cache.text.append(part.first, '0');
+                }
+                else if (!part.second.empty())
+                {
+                    size_t n = strftime(buf, sizeof(buf), part.second.c_str(), &tm);
+                    cache.text.append(buf, n);
+                }
+            }
         }
 
     private:
         std::string m_format;
+        uint64_t m_id;
+        // width 0: strftime text, width 3 or 6: sub-second digits
+        std::vector<std::pair<int, std::string>> m_parts;
+
+        static std::atomic<uint64_t> s_id;
+        static thread_local Cache t_cache[CACHE_SLOTS];
     };
 
+    std::atomic<uint64_t> DateTimeFormatItem::s_id{0};
+    thread_local DateTimeFormatItem::Cache DateTimeFormatItem::t_cache[DateTimeFormatItem::CACHE_SLOTS];
+
     class FilenameFormatItem : public LogFormatter::FormatItem
     {
     public:
         FilenameFormatItem(const std::string &str = "") {}
-        void format(std::ostream &os, Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event) override
+        void format(std::string &out, Logger *logger, LogLevel::Level level, const LogEvent::ptr &event) override
         {
-            os << event->getFile();
+            out += event->getFile();
         }
     };
 
@@ -198,9 +447,9 @@ namespace sylar
     {
     public:
         LineFormatItem(const std::string &str = "") {}
-        void format(std::ostream &os, Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event) override
+        void format(std::string &out, Logger *logger, LogLevel::Level level, const LogEvent::ptr &event) override
         {
-            os << event->getLine();
+            logfmt::AppendInt(out, event->getLine());
         }
     };
 
@@ -208,9 +457,9 @@ namespace sylar
     {
     public:
         NewLineFormatItem(const std::string &str = "") {}
-        void format(std::ostream &os, Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event) override
+        void format(std::string &out, Logger *logger, LogLevel::Level level, const LogEvent::ptr &event) override
         {
-            os << std::endl;
+            out.push_back('\n');
         }
     };
 
@@ -219,9 +468,9 @@ namespace sylar
     public:
         StringFormatItem(const std::string &str = "")
             : m_string(str) {}
-        void format(std::ostream &os, Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event) override
+        void format(std::string &out, Logger *logger, LogLevel::Level level, const LogEvent::ptr &event) override
         {
-            os << m_string;
+            out += m_string;
         }
 
     private:
@@ -232,9 +481,9 @@ namespace sylar
     {
     public:
         TabFormatItem(const std::string &str = "") {}
-        void format(std::ostream &os, Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event) override
+        void format(std::string &out, Logger *logger, LogLevel::Level level, const LogEvent::ptr &event) override
         {
-            os << "\t";
+            out.push_back('\t');
         }
 
     private:
@@ -243,23 +492,25 @@ namespace sylar
 
     ////////////////////////////////////////////////////////////////////
 
+    LOG_STATIC_PATTERN(s_default_pattern, "%d%T%t%T%N%T%F%T[%p]%T[%c]%T%f:%l%T%m%n");
+
     Logger::Logger(const std::string &name)
-        : m_name(name), m_level(LogLevel::DEBUG)
+        : m_name(name), m_level(LogLevel::DEBUG), m_appenders(new AppenderList)
     {
-        m_formatter.reset(new LogFormatter("%d%T%t%T%N%T%F%T[%p]%T[%c]%T%f:%l%T%m%n"));
+        m_formatter.reset(new StaticLogFormatter<s_default_pattern>);
     }
 
-    void Logger::log(LogLevel::Level level, LogEvent::ptr event)
+    void Logger::log(LogLevel::Level level, const LogEvent::ptr &event)
     {
-        if (level >= m_level)
+        if (level >= getLevel())
         {
-            auto self = shared_from_this();
-            MutexType::Lock lock(m_mutex);
-            if (!m_appender.empty())
+            Rcu::ReadLock lock;
+            const AppenderList *appenders = m_appenders.get();
+            if (!appenders->empty())
             {
-                for (auto &appender : m_appender)
+                for (auto &appender : *appenders)
                 {
-                    appender->log(self, level, event);
+                    appender->log(this, level, event);
                 }
             }
             else if (m_root)
@@ -268,23 +519,23 @@ namespace sylar
             }
         }
     }
-    void Logger::debug(LogEvent::ptr event)
+    void Logger::debug(const LogEvent::ptr &event)
     {
         log(LogLevel::DEBUG, event);
     }
-    void Logger::info(LogEvent::ptr event)
+    void Logger::info(const LogEvent::ptr &event)
     {
         log(LogLevel::INFO, event);
     }
-    void Logger::warn(LogEvent::ptr event)
+    void Logger::warn(const LogEvent::ptr &event)
     {
         log(LogLevel::WARN, event);
     }
-    void Logger::error(LogEvent::ptr event)
+    void Logger::error(const LogEvent::ptr &event)
     {
         log(LogLevel::ERROR, event);
     }
-    void Logger::fatal(LogEvent::ptr event)
+    void Logger::fatal(const LogEvent::ptr &event)
     {
         log(LogLevel::FATAL, event);
     }
@@ -296,43 +547,37 @@ namespace sylar
         {
             appender->setFormatter(m_formatter);
         }
-        m_appender.push_back(appender);
+        AppenderList *appenders = new AppenderList(*m_appenders.get());
+        appenders->push_back(appender);
+        m_appenders.publish(appenders);
     }
 
     void Logger::delAppender(LogAppender::ptr appender)
     {
         MutexType::Lock lock(m_mutex);
-        for (auto it = m_appender.begin(); it != m_appender.end(); ++it)
+        AppenderList *appenders = new AppenderList(*m_appenders.get());
+        for (auto it = appenders->begin(); it != appenders->end(); ++it)
         {
             if (*it == appender)
             {
-                m_appender.erase(it);
+                appenders->erase(it);
                 break;
             }
         }
+        m_appenders.publish(appenders);
     }
 
     void Logger::clearAppenders()
     {
         MutexType::Lock lock(m_mutex);
-        m_appender.clear();
-    }
-
-    LogLevel::Level Logger::getLevel() const
-    {
-        return m_level;
-    }
-
-    void Logger::setLevel(LogLevel::Level level)
-    {
-        m_level = level;
+        m_appenders.publish(new AppenderList);
     }
 
     void Logger::setFormatter(LogFormatter::ptr val)
     {
         MutexType::Lock lock(m_mutex);
         m_formatter = val;
-        for (auto &i : m_appender)
+        for (auto &i : *m_appenders.get())
         {
             i->setFormatter(val);
         }
@@ -340,7 +585,7 @@ namespace sylar
 
     void Logger::setFormatter(const std::string &val)
     {
-        LogFormatter::ptr new_formatter(new LogFormatter(val));
+        LogFormatter::ptr new_formatter = LogFormatter::Create(val);
         if (new_formatter->isError())
         {
             std::cout << "Logger formatter name=" << m_name << " value=" << val
@@ -355,16 +600,16 @@ namespace sylar
         MutexType::Lock lock(m_mutex);
         YAML::Node node;
         node["name"] = m_name;
-        if (m_level != LogLevel::UNKNOWN)
+        if (getLevel() != LogLevel::UNKNOWN)
         {
-            node["level"] = LogLevel::ToString(m_level);
+            node["level"] = LogLevel::ToString(getLevel());
         }
         if (m_formatter)
         {
             node["formatter"] = m_formatter->getPattern();
         }
 
-        for (auto &i : m_appender)
+        for (auto &i : *m_appenders.get())
         {
             node["appenders"].push_back(YAML::Load(i->toYamlString()));
         }
@@ -424,18 +669,10 @@ namespace sylar
         return ss.str();
     }
 
-    void FileLogAppender::log(Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event)
+    void FileLogAppender::log(Logger *logger, LogLevel::Level level, const LogEvent::ptr &event)
     {
         if (level >= m_level)
         {
-
-            uint64_t now = time(0);
-            if (now >= m_lastOpenTime + 3)
-            {
-                reopen();
-                m_lastOpenTime = now;
-            }
-
             MutexType::Lock lock(m_mutex);
             if (!(m_filestream << m_formatter->format(logger, level, event)))
             {
@@ -444,166 +681,982 @@ namespace sylar
         }
     }
 
-    void StdoutLogAppender::log(Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event)
+    // compresses and prunes rotated files so the writer never waits for it
+    class LogRotateWorker
     {
-        if (level >= m_level)
-        {
-            MutexType::Lock lock(m_mutex);
-            std::cout << m_formatter->format(logger, level, event) << std::endl;
-        }
-    }
+    public:
+        typedef Mutex MutexType;
 
-    std::string StdoutLogAppender::toYamlString()
-    {
-        MutexType::Lock lock(m_mutex);
-        YAML::Node node;
-        node["type"] = "StdoutLogAppender";
-        if (m_level != LogLevel::UNKNOWN)
-        {
-            node["level"] = LogLevel::ToString(m_level);
-        }
-        if (m_formatter)
+        static LogRotateWorker &GetInstance()
         {
-            node["formatter"] = m_formatter->getPattern();
+            // never destroyed, the worker thread may outlive static destruction
+            static LogRotateWorker *s_worker = new LogRotateWorker;
+            return *s_worker;
         }
-        std::stringstream ss;
-        ss << node;
-        return ss.str();
-    }
-    ////////////////////////////////////////////////////////////////////
-
-    LogFormatter::LogFormatter(const std::string pattern)
-        : m_pattern(pattern)
-    {
-        init();
-    }
 
-    // %xxx %xxx{xxx} %%
-    void LogFormatter::init()
-    {
-        // str, format, type
-        std::vector<std::tuple<std::string, std::string, int>> vec;
-        std::string nstr;
-        for (size_t i = 0; i < m_pattern.size(); ++i)
+        // rotated may be empty when only pruning is needed
+        void submit(const std::string &rotated, const std::string &filename, uint32_t max_files, bool compress)
         {
-            if (m_pattern[i] != '%')
-            {
-                nstr.append(1, m_pattern[i]);
-                continue;
-            }
-
-            if ((i + 1) < m_pattern.size() && m_pattern[i + 1] == '%')
             {
-                nstr.append(1, '%');
-                continue;
+                MutexType::Lock lock(m_mutex);
+                m_jobs.push_back(Job{rotated, filename, max_files, compress});
+                if (!m_thread)
+                {
+                    m_thread.reset(new Thread(std::bind(&LogRotateWorker::run, this), "log_rotate"));
+                }
             }
+            m_sem.notify();
+        }
 
-            size_t n = i + 1;
-            int fmt_status = 0;
-            size_t fmt_begin = 0;
+    private:
+        struct Job
+        {
+            std::string rotated;
+            std::string filename;
+            uint32_t maxFiles;
+            bool compress;
+        };
 
-            std::string str;
-            std::string fmt;
-            while (n < m_pattern.size())
+        void run()
+        {
+            while (true)
             {
-                if (!fmt_status && (!isalpha(m_pattern[n]) && m_pattern[n] != '{' && m_pattern[n] != '}'))
-                {
-                    str = m_pattern.substr(i + 1, n - i - 1);
-                    break;
-                }
-                if (fmt_status == 0)
+                m_sem.wait();
+                Job job;
                 {
-                    if (m_pattern[n] == '{')
-                    {
-                        str = m_pattern.substr(i + 1, n - i - 1);
-                        // std::cout << "*" << str << std::endl;
-                        fmt_status = 1; // 解析格式
-                        fmt_begin = n;
-                        ++n;
-                        continue;
-                    }
+                    MutexType::Lock lock(m_mutex);
+                    job = m_jobs.front();
+                    m_jobs.pop_front();
                 }
-                else if (fmt_status == 1)
+                if (!job.rotated.empty() && job.compress)
                 {
-                    if (m_pattern[n] == '}')
-                    {
-                        fmt = m_pattern.substr(fmt_begin + 1, n - fmt_begin - 1);
-                        // std::cout << "#" << fmt << std::endl;
-                        fmt_status = 0;
-                        ++n;
-                        break;
-                    }
+                    Compress(job.rotated);
                 }
-                ++n;
-                if (n == m_pattern.size())
+                if (job.maxFiles)
                 {
-                    if (str.empty())
-                    {
-                        str = m_pattern.substr(i + 1);
-                    }
+                    Prune(job.filename, job.maxFiles);
                 }
             }
+        }
 
-            if (fmt_status == 0)
+        static bool Compress(const std::string &path)
+        {
+            std::string tmp = path + ".gz.tmp";
+            FILE *in = fopen(path.c_str(), "rb");
+            if (!in)
             {
-                if (!nstr.empty())
+                return false;
+            }
+            gzFile out = gzopen(tmp.c_str(), "wb");
+            if (!out)
+            {
+                fclose(in);
+                return false;
+            }
+            char buf[64 * 1024];
+            size_t n = 0;
+            bool ok = true;
+            while ((n = fread(buf, 1, sizeof(buf), in)) > 0)
+            {
+                if (gzwrite(out, buf, n) != (int)n)
                 {
-                    vec.push_back(std::make_tuple(nstr, std::string(), 0));
-                    nstr.clear();
+                    ok = false;
+                    break;
                 }
-                vec.push_back(std::make_tuple(str, fmt, 1));
-                i = n - 1;
             }
-            else if (fmt_status == 1)
+            fclose(in);
+            ok = (gzclose(out) == Z_OK) && ok;
+            if (!ok || rename(tmp.c_str(), (path + ".gz").c_str()))
             {
-                std::cout << "pattern parse error: " << m_pattern << " - " << m_pattern.substr(i) << std::endl;
-                m_error = true;
-                vec.push_back(std::make_tuple("<<pattern_error>>", fmt, 0));
+                std::cout << "log rotate: compress " << path << " failed" << std::endl;
+                unlink(tmp.c_str());
+                return false;
             }
+            unlink(path.c_str());
+            return true;
         }
 
-        if (!nstr.empty())
+        // keep the newest max_files rotated files of filename, names sort by rotation time
+        static void Prune(const std::string &filename, uint32_t max_files)
         {
-            vec.push_back(std::make_tuple(nstr, "", 0));
-        }
-        static std::map<std::string, std::function<FormatItem::ptr(const std::string &str)>> s_format_items = {
-#define XX(str, C)                                                               \
-    {                                                                            \
-        #str, [](const std::string &fmt) { return FormatItem::ptr(new C(fmt)); } \
-    }
-
-            XX(m, MessageFormatItem),    // m:消息
-            XX(p, LevelFormatItem),      // p:日志级别
-            XX(r, ElapseFormatItem),     // r:累计毫秒数
-            XX(c, NameFormatItem),       // c:日志名称
-            XX(t, ThreadIdFormatItem),   // t:线程id
-            XX(n, NewLineFormatItem),    // n:换行
-            XX(d, DateTimeFormatItem),   // d:时间
-            XX(f, FilenameFormatItem),   // f:文件名
-            XX(l, LineFormatItem),       // l:行号
-            XX(F, FiberIdFormatItem),    // F:协程id
-            XX(T, TabFormatItem),        // T:Tab
-            XX(N, ThreadNameFormatItem), // N:线程名称
-#undef XX
-        };
+            size_t pos = filename.rfind('/');
+            std::string dir = pos == std::string::npos ? "." : filename.substr(0, pos + 1);
+            std::string prefix = (pos == std::string::npos ? filename : filename.substr(pos + 1)) + ".";
 
-        for (auto &i : vec)
-        {
-            if (std::get<2>(i) == 0)
+            std::vector<std::string> files;
+            DIR *d = opendir(dir.c_str());
+            if (!d)
             {
-                m_items.push_back(FormatItem::ptr(new StringFormatItem(std::get<0>(i))));
+                return;
             }
-            else
+            while (struct dirent *ent = readdir(d))
             {
-                auto it = s_format_items.find(std::get<0>(i));
-                if (it == s_format_items.end())
-                {
-                    m_items.push_back(FormatItem::ptr(new StringFormatItem("<<error_format %" + std::get<0>(i) + ">>")));
-                    m_error = true;
-                }
-                else
+                std::string name = ent->d_name;
+                if (name.size() > prefix.size() && name.compare(0, prefix.size(), prefix) == 0 && isdigit(name[prefix.size()]) && name.find(".tmp") == std::string::npos)
                 {
-                    m_items.push_back(it->second(std::get<1>(i)));
+                    files.push_back(name);
+                }
+            }
+            closedir(d);
+
+            if (files.size() <= max_files)
+            {
+                return;
+            }
+            // <prefix><YYYYmmdd-HHMMSS>[.seq][.gz], order by time then seq
+            auto key = [&prefix](const std::string &name)
+            {
+                std::string ts = name.substr(prefix.size(), 15);
+                return std::make_pair(ts, atoi(name.c_str() + std::min(name.size(), prefix.size() + 16)));
+            };
+            std::sort(files.begin(), files.end(), [&key](const std::string &a, const std::string &b)
+                      { return key(a) < key(b); });
+            for (size_t i = 0; i < files.size() - max_files; ++i)
+            {
+                unlink((pos == std::string::npos ? files[i] : dir + files[i]).c_str());
+            }
+        }
+
+    private:
+        MutexType m_mutex;
+        Semaphore m_sem;
+        std::list<Job> m_jobs;
+        Thread::ptr m_thread;
+    };
+
+    RollingFileLogAppender::RollingFileLogAppender(const std::string &filename, uint64_t max_size, Interval interval,
+                                                   uint32_t max_files, bool compress)
+        : m_filename(filename), m_maxSize(max_size), m_interval(interval), m_maxFiles(max_files), m_compress(compress)
+    {
+        MutexType::Lock lock(m_mutex);
+        open();
+        m_nextRollTime = nextRollTime(time(0));
+        if (m_maxFiles)
+        {
+            LogRotateWorker::GetInstance().submit("", m_filename, m_maxFiles, m_compress);
+        }
+    }
+
+    const char *RollingFileLogAppender::ToString(Interval interval)
+    {
+        switch (interval)
+        {
+        case HOUR:
+            return "hour";
+        case DAY:
+            return "day";
+        default:
+            return "none";
+        }
+    }
+
+    RollingFileLogAppender::Interval RollingFileLogAppender::FromString(const std::string &str)
+    {
+        if (str == "hour" || str == "HOUR")
+        {
+            return HOUR;
+        }
+        if (str == "day" || str == "DAY")
+        {
+            return DAY;
+        }
+        return NONE;
+    }
+
+    bool RollingFileLogAppender::open()
+    {
+        if (m_filestream.is_open())
+        {
+            m_filestream.close();
+        }
+        m_filestream.clear();
+        m_filestream.open(m_filename, std::ios::app);
+        struct stat st;
+        m_size = stat(m_filename.c_str(), &st) == 0 ? st.st_size : 0;
+        return !!m_filestream;
+    }
+
+    uint64_t RollingFileLogAppender::nextRollTime(uint64_t now) const
+    {
+        if (m_interval == NONE)
+        {
+            return ~0ull;
+        }
+        time_t t = now;
+        struct tm tm;
+        localtime_r(&t, &tm);
+        tm.tm_min = 0;
+        tm.tm_sec = 0;
+        if (m_interval == HOUR)
+        {
+            tm.tm_hour += 1;
+        }
+        else
+        {
+            tm.tm_hour = 0;
+            tm.tm_mday += 1;
+        }
+        tm.tm_isdst = -1;
+        return mktime(&tm);
+    }
+
+    void RollingFileLogAppender::rotate(uint64_t now)
+    {
+        m_filestream.close();
+
+        time_t t = now;
+        struct tm tm;
+        localtime_r(&t, &tm);
+        char buf[32];
+        strftime(buf, sizeof(buf), "%Y%m%d-%H%M%S", &tm);
+        // several rotations within one second get increasing sequence numbers
+        m_rotateSeq = (now == m_lastRotateTime) ? m_rotateSeq + 1 : 0;
+        m_lastRotateTime = now;
+        std::string rotated;
+        struct stat st;
+        do
+        {
+            rotated = m_filename + "." + buf;
+            if (m_rotateSeq)
+            {
+                rotated += "." + std::to_string(m_rotateSeq);
+            }
+        } while ((stat(rotated.c_str(), &st) == 0 || stat((rotated + ".gz").c_str(), &st) == 0) && ++m_rotateSeq);
+        if (rename(m_filename.c_str(), rotated.c_str()))
+        {
+            std::cout << "log rotate: rename " << m_filename << " failed" << std::endl;
+            rotated.clear();
+        }
+
+        open();
+        m_nextRollTime = nextRollTime(now);
+        if (!rotated.empty() && (m_compress || m_maxFiles))
+        {
+            LogRotateWorker::GetInstance().submit(rotated, m_filename, m_maxFiles, m_compress);
+        }
+    }
+
+    void RollingFileLogAppender::log(Logger *logger, LogLevel::Level level, const LogEvent::ptr &event)
+    {
+        if (level >= m_level)
+        {
+            MutexType::Lock lock(m_mutex);
+            std::string str = m_formatter->format(logger, level, event);
+            if (event->getTime() >= m_nextRollTime || (m_maxSize && m_size > 0 && m_size + str.size() > m_maxSize))
+            {
+                rotate(event->getTime());
+            }
+            if (!(m_filestream << str))
+            {
+                std::cout << "error" << std::endl;
+            }
+            m_size += str.size();
+        }
+    }
+
+    std::string RollingFileLogAppender::toYamlString()
+    {
+        MutexType::Lock lock(m_mutex);
+        YAML::Node node;
+        node["type"] = "RollingFileLogAppender";
+        node["file"] = m_filename;
+        if (m_maxSize)
+        {
+            node["max_size"] = m_maxSize;
+        }
+        if (m_interval != NONE)
+        {
+            node["rotate"] = ToString(m_interval);
+        }
+        if (m_maxFiles)
+        {
+            node["max_files"] = m_maxFiles;
+        }
+        node["compress"] = m_compress;
+        if (m_level != LogLevel::UNKNOWN)
+        {
+            node["level"] = LogLevel::ToString(m_level);
+        }
+        if (m_formatter)
+        {
+            node["formatter"] = m_formatter->getPattern();
+        }
+        std::stringstream ss;
+        ss << node;
+        return ss.str();
+    }
+
+    BinaryLogAppender::BinaryLogAppender(const std::string &filename)
+        : m_filename(filename)
+    {
+        reopen();
+    }
+
+    bool BinaryLogAppender::reopen()
+    {
+        MutexType::Lock lock(m_mutex);
+        if (m_filestream)
+        {
+            m_filestream.close();
+        }
+
+        m_filestream.open(m_filename, std::ios::app | std::ios::binary);
+        // ids are only valid inside one stream, start a new one on every open
+        m_buffer.clear();
+        m_encoder.reset(m_buffer);
+        m_filestream.write(m_buffer.data(), m_buffer.size());
+        return !!m_filestream;
+    }
+
+    std::string BinaryLogAppender::toYamlString()
+    {
+        MutexType::Lock lock(m_mutex);
+        YAML::Node node;
+        node["type"] = "BinaryLogAppender";
+        node["file"] = m_filename;
+        if (m_level != LogLevel::UNKNOWN)
+        {
+            node["level"] = LogLevel::ToString(m_level);
+        }
+        std::stringstream ss;
+        ss << node;
+        return ss.str();
+    }
+
+    void BinaryLogAppender::log(Logger *logger, LogLevel::Level level, const LogEvent::ptr &event)
+    {
+        if (level >= m_level)
+        {
+            MutexType::Lock lock(m_mutex);
+            m_buffer.clear();
+            m_encoder.encode(m_buffer, *event);
+            if (!m_filestream.write(m_buffer.data(), m_buffer.size()))
+            {
+                std::cout << "error" << std::endl;
+            }
+        }
+    }
+
+    void StdoutLogAppender::log(Logger *logger, LogLevel::Level level, const LogEvent::ptr &event)
+    {
+        if (level >= m_level)
+        {
+            MutexType::Lock lock(m_mutex);
+            std::cout << m_formatter->format(logger, level, event) << std::endl;
+        }
+    }
+
+    std::string StdoutLogAppender::toYamlString()
+    {
+        MutexType::Lock lock(m_mutex);
+        YAML::Node node;
+        node["type"] = "StdoutLogAppender";
+        if (m_level != LogLevel::UNKNOWN)
+        {
+            node["level"] = LogLevel::ToString(m_level);
+        }
+        if (m_formatter)
+        {
+            node["formatter"] = m_formatter->getPattern();
+        }
+        std::stringstream ss;
+        ss << node;
+        return ss.str();
+    }
+
+    MmapFileLogAppender::MmapFileLogAppender(const std::string &filename, uint64_t window_size)
+        : m_filename(filename)
+    {
+        uint64_t page = sysconf(_SC_PAGESIZE);
+        m_windowSize = std::max<uint64_t>((window_size + page - 1) / page * page, page);
+        if (!open())
+        {
+            m_error = true;
+            return;
+        }
+        m_thread.reset(new Thread(std::bind(&MmapFileLogAppender::run, this), "log_mmap"));
+    }
+
+    MmapFileLogAppender::~MmapFileLogAppender()
+    {
+        if (m_thread)
+        {
+            m_stop = true;
+            m_sem.notify();
+            m_thread->join();
+        }
+        close();
+    }
+
+    bool MmapFileLogAppender::open()
+    {
+        m_fd = ::open(m_filename.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (m_fd < 0)
+        {
+            std::cout << "MmapFileLogAppender open " << m_filename << " failed: " << strerror(errno) << std::endl;
+            return false;
+        }
+
+        // resume after the last byte written, a crashed run leaves a zero filled tail
+        struct stat st;
+        uint64_t size = fstat(m_fd, &st) == 0 ? st.st_size : 0;
+        char buf[64 * 1024];
+        while (size > 0)
+        {
+            uint64_t begin = size > sizeof(buf) ? size - sizeof(buf) : 0;
+            ssize_t n = pread(m_fd, buf, size - begin, begin);
+            if (n != (ssize_t)(size - begin))
+            {
+                break;
+            }
+            while (n > 0 && buf[n - 1] == '\0')
+            {
+                --n;
+            }
+            if (n > 0)
+            {
+                size = begin + n;
+                break;
+            }
+            size = begin;
+        }
+        m_offset = size;
+
+        uint64_t base = size / m_windowSize;
+        for (uint64_t i = base; i < base + WINDOWS; ++i)
+        {
+            if (!map(m_windows[i % WINDOWS], i))
+            {
+                return false;
+            }
+        }
+        m_windows[base % WINDOWS].committed = size % m_windowSize;
+        return true;
+    }
+
+    void MmapFileLogAppender::close()
+    {
+        for (auto &window : m_windows)
+        {
+            if (window.addr)
+            {
+                munmap(window.addr, m_windowSize);
+                window.addr = nullptr;
+            }
+        }
+        if (m_fd >= 0)
+        {
+            if (ftruncate(m_fd, m_offset))
+            {
+                std::cout << "MmapFileLogAppender truncate " << m_filename << " failed: " << strerror(errno) << std::endl;
+            }
+            ::close(m_fd);
+            m_fd = -1;
+        }
+    }
+
+    bool MmapFileLogAppender::map(Window &window, uint64_t index)
+    {
+        // allocate the blocks now, a store into a hole of a full disk would be a SIGBUS
+        int rt = posix_fallocate(m_fd, index * m_windowSize, m_windowSize);
+        if (rt)
+        {
+            std::cout << "MmapFileLogAppender fallocate " << m_filename << " failed: " << strerror(rt) << std::endl;
+            return false;
+        }
+        // prefault here so writers never take the page faults
+        void *addr = mmap(nullptr, m_windowSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, index * m_windowSize);
+        if (addr == MAP_FAILED)
+        {
+            std::cout << "MmapFileLogAppender mmap " << m_filename << " failed: " << strerror(errno) << std::endl;
+            return false;
+        }
+        window.addr = (char *)addr;
+        window.index.store(index, std::memory_order_release);
+        return true;
+    }
+
+    void MmapFileLogAppender::write(const char *data, size_t len)
+    {
+        len = std::min<size_t>(len, m_windowSize);
+        uint64_t offset = m_offset.fetch_add(len, std::memory_order_relaxed);
+        while (len > 0)
+        {
+            uint64_t index = offset / m_windowSize;
+            uint64_t pos = offset % m_windowSize;
+            size_t n = std::min<uint64_t>(len, m_windowSize - pos);
+            Window &window = m_windows[index % WINDOWS];
+            // only waits when writers got a whole ring ahead of the background thread
+            while (window.index.load(std::memory_order_acquire) != index)
+            {
+                if (m_error.load(std::memory_order_relaxed))
+                {
+                    return;
+                }
+                sched_yield();
+            }
+            memcpy(window.addr + pos, data, n);
+            if (window.committed.fetch_add(n, std::memory_order_acq_rel) + n == m_windowSize)
+            {
+                m_sem.notify();
+            }
+            data += n;
+            offset += n;
+            len -= n;
+        }
+    }
+
+    void MmapFileLogAppender::run()
+    {
+        while (true)
+        {
+            m_sem.wait();
+            if (m_stop)
+            {
+                break;
+            }
+            for (auto &window : m_windows)
+            {
+                if (window.committed.load(std::memory_order_acquire) != m_windowSize)
+                {
+                    continue;
+                }
+                uint64_t next = window.index.load(std::memory_order_relaxed) + WINDOWS;
+                munmap(window.addr, m_windowSize);
+                window.addr = nullptr;
+                window.committed.store(0, std::memory_order_relaxed);
+                if (!map(window, next))
+                {
+                    // writers waiting for this window drop their records
+                    m_error = true;
+                }
+            }
+        }
+    }
+
+    void MmapFileLogAppender::log(Logger *logger, LogLevel::Level level, const LogEvent::ptr &event)
+    {
+        if (level < m_level || m_error.load(std::memory_order_relaxed))
+        {
+            return;
+        }
+        LogFormatter::ptr formatter = getFormatter();
+        std::string str = formatter->format(logger, level, event);
+        write(str.data(), str.size());
+    }
+
+    std::string MmapFileLogAppender::toYamlString()
+    {
+        MutexType::Lock lock(m_mutex);
+        YAML::Node node;
+        node["type"] = "MmapFileLogAppender";
+        node["file"] = m_filename;
+        node["window_size"] = m_windowSize;
+        if (m_level != LogLevel::UNKNOWN)
+        {
+            node["level"] = LogLevel::ToString(m_level);
+        }
+        if (m_formatter)
+        {
+            node["formatter"] = m_formatter->getPattern();
+        }
+        std::stringstream ss;
+        ss << node;
+        return ss.str();
+    }
+
+    JsonLogAppender::JsonLogAppender(const std::string &filename, Encoding encoding)
+        : m_filename(filename), m_encoding(encoding)
+    {
+        reopen();
+    }
+
+    bool JsonLogAppender::reopen()
+    {
+        MutexType::Lock lock(m_mutex);
+        if (m_filename.empty())
+        {
+            return true;
+        }
+        if (m_filestream)
+        {
+            m_filestream.close();
+        }
+        m_filestream.open(m_filename, std::ios::app);
+        return !!m_filestream;
+    }
+
+    const char *JsonLogAppender::ToString(Encoding encoding)
+    {
+        return encoding == LOGFMT ? "logfmt" : "json";
+    }
+
+    JsonLogAppender::Encoding JsonLogAppender::FromString(const std::string &str)
+    {
+        return strcasecmp(str.c_str(), "logfmt") == 0 ? LOGFMT : JSON;
+    }
+
+    void JsonLogAppender::appendTime(uint64_t us)
+    {
+        time_t sec = us / 1000000;
+        if (sec != m_lastSec)
+        {
+            struct tm tm;
+            localtime_r(&sec, &tm);
+            char buf[64];
+            m_timeText.assign(buf, strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%S", &tm));
+            // +0800 -> +08:00
+            m_zoneText.assign(buf, strftime(buf, sizeof(buf), "%z", &tm));
+            if (m_zoneText.size() == 5)
+            {
+                m_zoneText.insert(3, 1, ':');
+            }
+            m_lastSec = sec;
+        }
+        char frac[8];
+        frac[0] = '.';
+        uint32_t v = us % 1000000;
+        for (int i = 6; i > 0; --i)
+        {
+            frac[i] = '0' + v % 10;
+            v /= 10;
+        }
+        m_buffer.append(m_timeText).append(frac, 7).append(m_zoneText);
+    }
+
+    template <class T>
+    void JsonLogAppender::appendInt(T v)
+    {
+        logfmt::AppendInt(m_buffer, v);
+    }
+
+    void JsonLogAppender::appendKey(const char *key, size_t len)
+    {
+        if (m_encoding == JSON)
+        {
+            if (m_buffer.back() != '{')
+            {
+                m_buffer.push_back(',');
+            }
+            appendString(key, len);
+            m_buffer.push_back(':');
+            return;
+        }
+
+        if (!m_buffer.empty())
+        {
+            m_buffer.push_back(' ');
+        }
+        for (size_t i = 0; i < len; ++i)
+        {
+            char c = key[i];
+            m_buffer.push_back((unsigned char)c <= ' ' || c == '=' || c == '"' ? '_' : c);
+        }
+        m_buffer.push_back('=');
+    }
+
+    void JsonLogAppender::appendString(const char *str, size_t len)
+    {
+        static const char *s_hex = "0123456789abcdef";
+        if (m_encoding == LOGFMT)
+        {
+            bool quote = len == 0;
+            for (size_t i = 0; i < len && !quote; ++i)
+            {
+                unsigned char c = str[i];
+                quote = c <= ' ' || c == '=' || c == '"' || c == '\\';
+            }
+            if (!quote)
+            {
+                m_buffer.append(str, len);
+                return;
+            }
+        }
+
+        m_buffer.push_back('"');
+        size_t begin = 0;
+        for (size_t i = 0; i < len; ++i)
+        {
+            unsigned char c = str[i];
+            if (c >= 0x20 && c != '"' && c != '\\')
+            {
+                continue;
+            }
+            // copy the clean run in one go
+            m_buffer.append(str + begin, i - begin);
+            begin = i + 1;
+            switch (c)
+            {
+            case '"':
+                m_buffer.append("\\\"");
+                break;
+            case '\\':
+                m_buffer.append("\\\\");
+                break;
+            case '\n':
+                m_buffer.append("\\n");
+                break;
+            case '\r':
+                m_buffer.append("\\r");
+                break;
+            case '\t':
+                m_buffer.append("\\t");
+                break;
+            default:
+                m_buffer.append("\\u00");
+                m_buffer.push_back(s_hex[c >> 4]);
+                m_buffer.push_back(s_hex[c & 0xf]);
+                break;
+            }
+        }
+        m_buffer.append(str + begin, len - begin);
+        m_buffer.push_back('"');
+    }
+
+    void JsonLogAppender::appendValue(const binlog::ArgView &v)
+    {
+        switch (v.type)
+        {
+        case binlog::ARG_INT:
+            appendInt(v.i);
+            break;
+        case binlog::ARG_UINT:
+            appendInt(v.u);
+            break;
+        case binlog::ARG_DOUBLE:
+            if (std::isfinite(v.d))
+            {
+                char buf[32];
+                auto rt = std::to_chars(buf, buf + sizeof(buf), v.d);
+                m_buffer.append(buf, rt.ptr - buf);
+            }
+            else if (m_encoding == JSON)
+            {
+                m_buffer.append("null");
+            }
+            else
+            {
+                m_buffer.append(std::isnan(v.d) ? "NaN" : (v.d > 0 ? "+Inf" : "-Inf"));
+            }
+            break;
+        case binlog::ARG_POINTER:
+        {
+            char buf[24];
+            int len = snprintf(buf, sizeof(buf), "0x%llx", (unsigned long long)v.u);
+            appendString(buf, len);
+            break;
+        }
+        case binlog::ARG_STRING:
+            appendString(v.str, v.len);
+            break;
+        }
+    }
+
+    void JsonLogAppender::log(Logger *logger, LogLevel::Level level, const LogEvent::ptr &event)
+    {
+        if (level < m_level)
+        {
+            return;
+        }
+        // the message may render binary args, do it before taking the lock
+        std::string content = event->getContent();
+
+        MutexType::Lock lock(m_mutex);
+        m_buffer.clear();
+        if (m_encoding == JSON)
+        {
+            m_buffer.push_back('{');
+        }
+#define XX(key) appendKey(key, sizeof(key) - 1)
+        XX("time");
+        if (m_encoding == JSON)
+        {
+            m_buffer.push_back('"');
+            appendTime(event->getTimeUs());
+            m_buffer.push_back('"');
+        }
+        else
+        {
+            appendTime(event->getTimeUs());
+        }
+        XX("level");
+        const char *level_str = LogLevel::ToString(level);
+        appendString(level_str, strlen(level_str));
+        XX("logger");
+        appendString(event->getLogger()->getName());
+        XX("file");
+        appendString(event->getFile(), strlen(event->getFile()));
+        XX("line");
+        appendInt(event->getLine());
+        XX("thread");
+        appendInt(event->getThreadId());
+        XX("thread_name");
+        appendString(event->getThreadName());
+        XX("fiber");
+        appendInt(event->getFiberId());
+        XX("msg");
+        appendString(content);
+#undef XX
+
+        const std::string &fields = event->getFields();
+        size_t pos = 0;
+        binlog::ArgView key;
+        binlog::ArgView value;
+        while (binlog::NextArg(fields, pos, key) && binlog::NextArg(fields, pos, value))
+        {
+            appendKey(key.str, key.len);
+            appendValue(value);
+        }
+
+        if (m_encoding == JSON)
+        {
+            m_buffer.push_back('}');
+        }
+        m_buffer.push_back('\n');
+
+        std::ostream &os = m_filename.empty() ? std::cout : m_filestream;
+        if (!os.write(m_buffer.data(), m_buffer.size()))
+        {
+            std::cout << "error" << std::endl;
+        }
+        if (m_filename.empty())
+        {
+            os.flush();
+        }
+    }
+
+    std::string JsonLogAppender::toYamlString()
+    {
+        MutexType::Lock lock(m_mutex);
+        YAML::Node node;
+        node["type"] = "JsonLogAppender";
+        if (!m_filename.empty())
+        {
+            node["file"] = m_filename;
+        }
+        node["encoding"] = ToString(m_encoding);
+        if (m_level != LogLevel::UNKNOWN)
+        {
+            node["level"] = LogLevel::ToString(m_level);
+        }
+        std::stringstream ss;
+        ss << node;
+        return ss.str();
+    }
+    ////////////////////////////////////////////////////////////////////
+
+    LogFormatter::LogFormatter(const std::string pattern)
+        : m_pattern(pattern)
+    {
+        init();
+    }
+
+    // %xxx %xxx{xxx} %%
+    void LogFormatter::init()
+    {
+        // str, format, type
+        std::vector<std::tuple<std::string, std::string, int>> vec;
+        std::string nstr;
+        for (size_t i = 0; i < m_pattern.size(); ++i)
+        {
+            if (m_pattern[i] != '%')
+            {
+                nstr.append(1, m_pattern[i]);
+                continue;
+            }
+
+            if ((i + 1) < m_pattern.size() && m_pattern[i + 1] == '%')
+            {
+                nstr.append(1, '%');
+                ++i;
+                continue;
+            }
+
+            size_t n = i + 1;
+            int fmt_status = 0;
+            size_t fmt_begin = 0;
+
+            std::string str;
+            std::string fmt;
+            while (n < m_pattern.size())
+            {
+                if (!fmt_status && (!isalpha(m_pattern[n]) && m_pattern[n] != '{' && m_pattern[n] != '}'))
+                {
+                    str = m_pattern.substr(i + 1, n - i - 1);
+                    break;
+                }
+                if (fmt_status == 0)
+                {
+                    if (m_pattern[n] == '{')
+                    {
+                        str = m_pattern.substr(i + 1, n - i - 1);
+                        // std::cout << "*" << str << std::endl;
+                        fmt_status = 1; // 解析格式
+                        fmt_begin = n;
+                        ++n;
+                        continue;
+                    }
+                }
+                else if (fmt_status == 1)
+                {
+                    if (m_pattern[n] == '}')
+                    {
+                        fmt = m_pattern.substr(fmt_begin + 1, n - fmt_begin - 1);
+                        // std::cout << "#" << fmt << std::endl;
+                        fmt_status = 0;
+                        ++n;
+                        break;
+                    }
+                }
+                ++n;
+                if (n == m_pattern.size())
+                {
+                    if (str.empty())
+                    {
+                        str = m_pattern.substr(i + 1);
+                    }
+                }
+            }
+
+            if (fmt_status == 0)
+            {
+                if (!nstr.empty())
+                {
+                    vec.push_back(std::make_tuple(nstr, std::string(), 0));
+                    nstr.clear();
+                }
+                vec.push_back(std::make_tuple(str, fmt, 1));
+                i = n - 1;
+            }
+            else if (fmt_status == 1)
+            {
+                std::cout << "pattern parse error: " << m_pattern << " - " << m_pattern.substr(i) << std::endl;
+                m_error = true;
+                vec.push_back(std::make_tuple("<<pattern_error>>", fmt, 0));
+            }
+        }
+
+        if (!nstr.empty())
+        {
+            vec.push_back(std::make_tuple(nstr, "", 0));
+        }
+        for (auto &i : vec)
+        {
+            if (std::get<2>(i) == 0)
+            {
+                m_items.push_back(FormatItem::ptr(new StringFormatItem(std::get<0>(i))));
+            }
+            else
+            {
+                FormatItem::ptr item = CreateItem(std::get<0>(i), std::get<1>(i));
+                if (!item)
+                {
+                    m_items.push_back(FormatItem::ptr(new StringFormatItem("<<error_format %" + std::get<0>(i) + ">>")));
+                    m_error = true;
+                }
+                else
+                {
+                    m_items.push_back(item);
                 }
             }
 
@@ -612,14 +1665,75 @@ namespace sylar
         // std::cout << m_items.size() << std::endl;
     }
 
-    std::string LogFormatter::format(Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event)
+    LogFormatter::FormatItem::ptr LogFormatter::CreateItem(const std::string &name, const std::string &fmt)
     {
-        std::stringstream ss;
+        static std::map<std::string, std::function<FormatItem::ptr(const std::string &str)>> s_format_items = {
+#define XX(str, C)                                                               \
+    {                                                                            \
+        #str, [](const std::string &fmt) { return FormatItem::ptr(new C(fmt)); } \
+    }
+
+            XX(m, MessageFormatItem),    // m:消息
+            XX(p, LevelFormatItem),      // p:日志级别
+            XX(r, ElapseFormatItem),     // r:累计毫秒数
+            XX(c, NameFormatItem),       // c:日志名称
+            XX(t, ThreadIdFormatItem),   // t:线程id
+            XX(n, NewLineFormatItem),    // n:换行
+            XX(d, DateTimeFormatItem),   // d:时间
+            XX(f, FilenameFormatItem),   // f:文件名
+            XX(l, LineFormatItem),       // l:行号
+            XX(F, FiberIdFormatItem),    // F:协程id
+            XX(T, TabFormatItem),        // T:Tab
+            XX(N, ThreadNameFormatItem), // N:线程名称
+#undef XX
+        };
+
+        auto it = s_format_items.find(name);
+        return it == s_format_items.end() ? nullptr : it->second(fmt);
+    }
+
+    typedef RWMutex StaticFormatterMutexType;
+
+    static StaticFormatterMutexType &GetStaticFormatterMutex()
+    {
+        static StaticFormatterMutexType s_mutex;
+        return s_mutex;
+    }
+
+    static std::map<std::string, std::function<LogFormatter::ptr()>> &GetStaticFormatters()
+    {
+        static std::map<std::string, std::function<LogFormatter::ptr()>> s_formatters;
+        return s_formatters;
+    }
+
+    void LogFormatter::RegisterStatic(const std::string &pattern, std::function<LogFormatter::ptr()> factory)
+    {
+        StaticFormatterMutexType::WriteLock lock(GetStaticFormatterMutex());
+        GetStaticFormatters()[pattern] = factory;
+    }
+
+    LogFormatter::ptr LogFormatter::Create(const std::string &pattern)
+    {
+        {
+            StaticFormatterMutexType::ReadLock lock(GetStaticFormatterMutex());
+            auto it = GetStaticFormatters().find(pattern);
+            if (it != GetStaticFormatters().end())
+            {
+                return it->second();
+            }
+        }
+        return LogFormatter::ptr(new LogFormatter(pattern));
+    }
+
+    std::string LogFormatter::format(Logger *logger, LogLevel::Level level, const LogEvent::ptr &event)
+    {
+        std::string out;
+        out.reserve(128);
         for (auto &item : m_items)
         {
-            item->format(ss, logger, level, event);
+            item->format(out, logger, level, event);
         }
-        return ss.str();
+        return out;
     }
 
     ////////////////////////////////////////////////////////////////////
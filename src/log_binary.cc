@@ -0,0 +1,521 @@
+#include "log_binary.h"
+#include "log.h"
+
+#include <deque>
+#include <map>
+
+namespace sylar
+{
+    typedef RWMutex SiteMutexType;
+
+    static SiteMutexType &GetSiteMutex()
+    {
+        static SiteMutexType s_mutex;
+        return s_mutex;
+    }
+
+    // index 0 is reserved for "no site"
+    static std::deque<LogSite> &GetSites()
+    {
+        static std::deque<LogSite> s_sites(1);
+        return s_sites;
+    }
+
+    uint32_t LogSiteRegistry::Register(const char *file, int32_t line, const char *fmt)
+    {
+        SiteMutexType::WriteLock lock(GetSiteMutex());
+        auto &sites = GetSites();
+        LogSite site;
+        site.id = sites.size();
+        site.file = file;
+        site.line = line;
+        site.fmt = fmt;
+        sites.push_back(site);
+        return site.id;
+    }
+
+    uint32_t LogSiteRegistry::Intern(const char *file, int32_t line)
+    {
+        static std::map<std::pair<const char *, int32_t>, uint32_t> s_text_sites;
+        auto key = std::make_pair(file, line);
+        {
+            SiteMutexType::ReadLock lock(GetSiteMutex());
+            auto it = s_text_sites.find(key);
+            if (it != s_text_sites.end())
+            {
+                return it->second;
+            }
+        }
+        SiteMutexType::WriteLock lock(GetSiteMutex());
+        auto it = s_text_sites.find(key);
+        if (it != s_text_sites.end())
+        {
+            return it->second;
+        }
+        auto &sites = GetSites();
+        LogSite site;
+        site.id = sites.size();
+        site.file = file;
+        site.line = line;
+        site.fmt = "%s";
+        sites.push_back(site);
+        s_text_sites[key] = site.id;
+        return site.id;
+    }
+
+    bool LogSiteRegistry::Get(uint32_t id, LogSite &site)
+    {
+        SiteMutexType::ReadLock lock(GetSiteMutex());
+        auto &sites = GetSites();
+        if (id == 0 || id >= sites.size())
+        {
+            return false;
+        }
+        site = sites[id];
+        return true;
+    }
+
+    namespace binlog
+    {
+        template <class T>
+        static bool GetPod(const std::string &buf, size_t &pos, T &v)
+        {
+            if (pos + sizeof(v) > buf.size())
+            {
+                return false;
+            }
+            memcpy(&v, buf.data() + pos, sizeof(v));
+            pos += sizeof(v);
+            return true;
+        }
+
+        bool NextArg(const std::string &buf, size_t &pos, ArgView &v)
+        {
+            if (pos >= buf.size())
+            {
+                return false;
+            }
+            v.type = (ArgType)buf[pos++];
+            switch (v.type)
+            {
+            case ARG_INT:
+                return GetPod(buf, pos, v.i);
+            case ARG_UINT:
+            case ARG_POINTER:
+                return GetPod(buf, pos, v.u);
+            case ARG_DOUBLE:
+                return GetPod(buf, pos, v.d);
+            case ARG_STRING:
+                if (!GetPod(buf, pos, v.len) || pos + v.len > buf.size())
+                {
+                    pos = buf.size();
+                    return false;
+                }
+                v.str = buf.data() + pos;
+                pos += v.len;
+                return true;
+            default:
+                pos = buf.size();
+                return false;
+            }
+        }
+
+        struct ArgValue
+        {
+            uint8_t type = 0;
+            int64_t i = 0;
+            uint64_t u = 0;
+            double d = 0;
+            std::string s;
+        };
+
+        class ArgReader
+        {
+        public:
+            ArgReader(const std::string &buf) : m_buf(buf) {}
+
+            bool next(ArgValue &v)
+            {
+                ArgView view;
+                if (!NextArg(m_buf, m_pos, view))
+                {
+                    return false;
+                }
+                v.type = view.type;
+                v.i = view.i;
+                v.u = view.u;
+                v.d = view.d;
+                v.s.assign(view.str, view.len);
+                return true;
+            }
+
+        private:
+            const std::string &m_buf;
+            size_t m_pos = 0;
+        };
+
+        static int64_t AsInt(const ArgValue &v)
+        {
+            switch (v.type)
+            {
+            case ARG_INT:
+                return v.i;
+            case ARG_DOUBLE:
+                return (int64_t)v.d;
+            default:
+                return (int64_t)v.u;
+            }
+        }
+
+        static double AsDouble(const ArgValue &v)
+        {
+            switch (v.type)
+            {
+            case ARG_INT:
+                return v.i;
+            case ARG_DOUBLE:
+                return v.d;
+            default:
+                return v.u;
+            }
+        }
+
+        static void AppendFormat(std::string &out, const std::string &spec, const ArgValue &v)
+        {
+            char conv = spec.back();
+            std::string f = spec.substr(0, spec.size() - 1);
+            char buf[512];
+            int len = -1;
+            switch (conv)
+            {
+            case 'd':
+            case 'i':
+                len = snprintf(buf, sizeof(buf), (f + "lld").c_str(), (long long)AsInt(v));
+                break;
+            case 'o':
+            case 'u':
+            case 'x':
+            case 'X':
+                len = snprintf(buf, sizeof(buf), (f + "ll" + conv).c_str(), (unsigned long long)AsInt(v));
+                break;
+            case 'c':
+                len = snprintf(buf, sizeof(buf), spec.c_str(), (int)AsInt(v));
+                break;
+            case 'e':
+            case 'E':
+            case 'f':
+            case 'F':
+            case 'g':
+            case 'G':
+            case 'a':
+            case 'A':
+                len = snprintf(buf, sizeof(buf), spec.c_str(), AsDouble(v));
+                break;
+            case 'p':
+                len = snprintf(buf, sizeof(buf), spec.c_str(), (void *)(uintptr_t)v.u);
+                break;
+            case 's':
+                if (v.type == ARG_STRING)
+                {
+                    if (f == "%")
+                    {
+                        out.append(v.s);
+                        return;
+                    }
+                    len = snprintf(buf, sizeof(buf), spec.c_str(), v.s.c_str());
+                }
+                else
+                {
+                    out.append("<<bad_arg>>");
+                    return;
+                }
+                break;
+            default:
+                out.append("<<bad_conversion %").append(1, conv).append(">>");
+                return;
+            }
+            if (len > 0)
+            {
+                out.append(buf, std::min<size_t>(len, sizeof(buf) - 1));
+            }
+        }
+
+        std::string Render(const char *fmt, const std::string &args)
+        {
+            std::string out;
+            ArgReader reader(args);
+            ArgValue v;
+            for (const char *p = fmt; *p; ++p)
+            {
+                if (*p != '%')
+                {
+                    out.push_back(*p);
+                    continue;
+                }
+                if (p[1] == '%')
+                {
+                    out.push_back('%');
+                    ++p;
+                    continue;
+                }
+
+                // %[flags][width][.precision][length]conversion, length is dropped
+                std::string spec = "%";
+                ++p;
+                while (*p && strchr("-+ #0", *p))
+                {
+                    spec.push_back(*p++);
+                }
+                for (int part = 0; part < 2; ++part)
+                {
+                    if (part == 1)
+                    {
+                        if (*p != '.')
+                        {
+                            break;
+                        }
+                        spec.push_back(*p++);
+                    }
+                    if (*p == '*')
+                    {
+                        ++p;
+                        spec.append(reader.next(v) ? std::to_string(AsInt(v)) : "0");
+                    }
+                    while (*p >= '0' && *p <= '9')
+                    {
+                        spec.push_back(*p++);
+                    }
+                }
+                while (*p && strchr("hlLqjzt", *p))
+                {
+                    ++p;
+                }
+                if (!*p)
+                {
+                    break;
+                }
+                if (*p == 'n')
+                {
+                    continue;
+                }
+                spec.push_back(*p);
+                if (!reader.next(v))
+                {
+                    out.append("<<missing_arg>>");
+                    continue;
+                }
+                AppendFormat(out, spec, v);
+            }
+            return out;
+        }
+
+        static void PutStr16(std::string &out, const std::string &str)
+        {
+            uint16_t len = std::min<size_t>(str.size(), UINT16_MAX);
+            PutPod(out, len);
+            out.append(str.data(), len);
+        }
+
+        static void PutStr32(std::string &out, const char *str, uint32_t len)
+        {
+            PutPod(out, len);
+            out.append(str, len);
+        }
+    }
+
+    void BinaryLogEncoder::reset(std::string &out)
+    {
+        m_sites.clear();
+        m_loggers.clear();
+        m_nextLoggerId = 0;
+        m_threads.clear();
+        out.push_back('H');
+        out.append(binlog::kMagic, sizeof(binlog::kMagic));
+        binlog::PutPod(out, binlog::kVersion);
+    }
+
+    uint32_t BinaryLogEncoder::loggerId(std::string &out, const LogEvent &event)
+    {
+        auto logger = event.getLogger().get();
+        auto it = m_loggers.find(logger);
+        if (it != m_loggers.end() && it->second.second == logger->getName())
+        {
+            return it->second.first;
+        }
+        uint32_t id = ++m_nextLoggerId;
+        m_loggers[logger] = std::make_pair(id, logger->getName());
+        out.push_back('L');
+        binlog::PutPod(out, id);
+        binlog::PutStr16(out, logger->getName());
+        return id;
+    }
+
+    void BinaryLogEncoder::encode(std::string &out, const LogEvent &event)
+    {
+        uint32_t site = event.getSite();
+        if (!site)
+        {
+            site = LogSiteRegistry::Intern(event.getFile(), event.getLine());
+        }
+        if (site >= m_sites.size() || !m_sites[site])
+        {
+            LogSite s;
+            if (!LogSiteRegistry::Get(site, s))
+            {
+                return;
+            }
+            if (site >= m_sites.size())
+            {
+                m_sites.resize(site + 1);
+            }
+            m_sites[site] = true;
+            std::string file = s.file ? s.file : "";
+            out.push_back('S');
+            binlog::PutPod(out, site);
+            binlog::PutPod(out, s.line);
+            binlog::PutStr16(out, file);
+            binlog::PutStr32(out, s.fmt, strlen(s.fmt));
+        }
+
+        uint32_t logger = loggerId(out, event);
+
+        auto it = m_threads.find(event.getThreadId());
+        if (it == m_threads.end() || it->second != event.getThreadName())
+        {
+            m_threads[event.getThreadId()] = event.getThreadName();
+            out.push_back('T');
+            binlog::PutPod(out, event.getThreadId());
+            binlog::PutStr16(out, event.getThreadName());
+        }
+
+        out.push_back('E');
+        binlog::PutPod(out, site);
+        binlog::PutPod(out, logger);
+        binlog::PutPod(out, (uint8_t)event.getLevel());
+        binlog::PutPod(out, event.getTimeUs());
+        binlog::PutPod(out, event.getThreadId());
+        binlog::PutPod(out, event.getFiberId());
+        binlog::PutPod(out, event.getElapse());
+        if (event.getSite())
+        {
+            binlog::PutStr32(out, event.getArgs().data(), event.getArgs().size());
+        }
+        else
+        {
+            // text events carry their message as the single %s argument
+            std::string args;
+            binlog::EncodeArg(args, event.getContent());
+            binlog::PutStr32(out, args.data(), args.size());
+        }
+    }
+
+    bool BinaryLogReader::readString16(std::string &str)
+    {
+        uint16_t len = 0;
+        if (!read(len))
+        {
+            return false;
+        }
+        str.resize(len);
+        return len == 0 || (bool)m_is.read(&str[0], len);
+    }
+
+    bool BinaryLogReader::readString32(std::string &str)
+    {
+        uint32_t len = 0;
+        if (!read(len))
+        {
+            return false;
+        }
+        str.resize(len);
+        return len == 0 || (bool)m_is.read(&str[0], len);
+    }
+
+    bool BinaryLogReader::next(BinaryLogRecord &record)
+    {
+        char type = 0;
+        while (m_is.get(type))
+        {
+            switch (type)
+            {
+            case 'H':
+            {
+                char magic[sizeof(binlog::kMagic)];
+                uint16_t version = 0;
+                if (!m_is.read(magic, sizeof(magic)) || !read(version) || memcmp(magic, binlog::kMagic, sizeof(magic)) || version != binlog::kVersion)
+                {
+                    m_error = true;
+                    return false;
+                }
+                m_sites.clear();
+                m_loggers.clear();
+                m_threads.clear();
+                break;
+            }
+            case 'S':
+            {
+                uint32_t id = 0;
+                Site site;
+                if (!read(id) || !read(site.line) || !readString16(site.file) || !readString32(site.fmt))
+                {
+                    m_error = true;
+                    return false;
+                }
+                m_sites[id] = std::move(site);
+                break;
+            }
+            case 'L':
+            {
+                uint32_t id = 0;
+                std::string name;
+                if (!read(id) || !readString16(name))
+                {
+                    m_error = true;
+                    return false;
+                }
+                m_loggers[id] = std::move(name);
+                break;
+            }
+            case 'T':
+            {
+                int32_t tid = 0;
+                std::string name;
+                if (!read(tid) || !readString16(name))
+                {
+                    m_error = true;
+                    return false;
+                }
+                m_threads[tid] = std::move(name);
+                break;
+            }
+            case 'E':
+            {
+                uint32_t site_id = 0;
+                uint32_t logger_id = 0;
+                std::string args;
+                if (!read(site_id) || !read(logger_id) || !read(record.level) || !read(record.timeUs) || !read(record.threadId) || !read(record.fiberId) || !read(record.elapse) || !readString32(args))
+                {
+                    m_error = true;
+                    return false;
+                }
+                auto site = m_sites.find(site_id);
+                if (site == m_sites.end())
+                {
+                    m_error = true;
+                    return false;
+                }
+                record.file = site->second.file;
+                record.line = site->second.line;
+                record.logger = m_loggers[logger_id];
+                record.threadName = m_threads[record.threadId];
+                record.message = binlog::Render(site->second.fmt.c_str(), args);
+                return true;
+            }
+            default:
+                m_error = true;
+                return false;
+            }
+        }
+        return false;
+    }
+}
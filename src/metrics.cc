@@ -0,0 +1,253 @@
+#include "metrics.h"
+#include "config.h"
+#include "log.h"
+#include "thread.h"
+#include "util.h"
+#include <algorithm>
+#include <list>
+#include <sstream>
+#include <vector>
+
+namespace sylar
+{
+    static Logger::ptr g_logger = LOG_NAME("system");
+
+    static ConfigVar<uint32_t>::ptr g_dump_interval = Config::Lookup<uint32_t>("metrics.dump_interval_ms", 0, "log a metrics snapshot this often, 0 is off");
+
+    namespace
+    {
+        struct MetricsState
+        {
+            Mutex mutex;
+            std::vector<std::string> names;
+            // every block ever handed out, in use or free
+            std::list<Metrics::Block *> blocks;
+            std::list<Metrics::Block *> free;
+            uint64_t gaugeId = 0;
+            std::map<uint64_t, std::pair<std::string, Metrics::Gauge>> gauges;
+            // read while gauges run outside mutex, written by DelGauge so a removed
+            // gauge is never called after DelGauge returns
+            RWMutex gaugeMutex;
+            Thread::ptr dumper;
+            std::atomic<bool> dumping{false};
+            std::atomic<uint32_t> interval{0};
+        };
+
+        MetricsState &GetState()
+        {
+            static MetricsState *s_state = new MetricsState;
+            return *s_state;
+        }
+
+        // returns the block of an exiting thread to the free list, its values stay counted
+        struct BlockReleaser
+        {
+            Metrics::Block *block = nullptr;
+            ~BlockReleaser()
+            {
+                if (block)
+                {
+                    MetricsState &st = GetState();
+                    Mutex::Lock lock(st.mutex);
+                    st.free.push_back(block);
+                }
+            }
+        };
+
+        thread_local BlockReleaser t_releaser;
+
+        // logs a snapshot every interval, counters with their rate since the last one
+        void DumpMain()
+        {
+            MetricsState &st = GetState();
+            Logger::ptr logger = LOG_NAME("metrics");
+            std::map<std::string, int64_t> last = Metrics::GetSnapshot();
+            uint64_t last_ms = GetCurrentMS();
+            while (st.dumping)
+            {
+                // short sleeps so StopDump does not wait a whole interval
+                usleep(10 * 1000);
+                uint64_t now_ms = GetCurrentMS();
+                if (now_ms < last_ms + st.interval)
+                {
+                    continue;
+                }
+                std::map<std::string, int64_t> now = Metrics::GetSnapshot();
+                std::vector<std::string> counters;
+                {
+                    Mutex::Lock lock(st.mutex);
+                    counters = st.names;
+                }
+                std::stringstream ss;
+                for (auto &i : now)
+                {
+                    ss << " " << i.first << "=" << i.second;
+                    if (std::find(counters.begin(), counters.end(), i.first) != counters.end())
+                    {
+                        ss << "(" << (i.second - last[i.first]) * 1000 / (int64_t)(now_ms - last_ms) << "/s)";
+                    }
+                }
+                LOG_INFO(logger) << "metrics" << ss.str();
+                last.swap(now);
+                last_ms = now_ms;
+            }
+        }
+
+        struct MetricsIniter
+        {
+            MetricsIniter()
+            {
+                g_dump_interval->addListener([](const uint32_t &old_value, const uint32_t &new_value)
+                                             {
+                                                 Metrics::StopDump();
+                                                 if (new_value)
+                                                 {
+                                                     Metrics::StartDump(new_value);
+                                                 } });
+            }
+        };
+
+        static MetricsIniter s_initer;
+    }
+
+    Metrics::Block *Metrics::AcquireBlock()
+    {
+        MetricsState &st = GetState();
+        Block *block = nullptr;
+        {
+            Mutex::Lock lock(st.mutex);
+            if (!st.free.empty())
+            {
+                block = st.free.front();
+                st.free.pop_front();
+            }
+            else
+            {
+                block = new Block;
+                for (auto &v : block->values)
+                {
+                    v.store(0, std::memory_order_relaxed);
+                }
+                st.blocks.push_back(block);
+            }
+        }
+        t_releaser.block = block;
+        return block;
+    }
+
+    size_t Metrics::Register(const std::string &name)
+    {
+        MetricsState &st = GetState();
+        Mutex::Lock lock(st.mutex);
+        for (size_t i = 0; i < st.names.size(); ++i)
+        {
+            if (st.names[i] == name)
+            {
+                return i;
+            }
+        }
+        if (st.names.size() == MAX_COUNTERS)
+        {
+            throw std::logic_error("too many metrics counters, raise Metrics::MAX_COUNTERS");
+        }
+        st.names.push_back(name);
+        return st.names.size() - 1;
+    }
+
+    uint64_t Metrics::Sum(size_t index)
+    {
+        MetricsState &st = GetState();
+        Mutex::Lock lock(st.mutex);
+        uint64_t sum = 0;
+        for (auto block : st.blocks)
+        {
+            sum += block->values[index].load(std::memory_order_relaxed);
+        }
+        return sum;
+    }
+
+    uint64_t Metrics::AddGauge(const std::string &name, Gauge gauge)
+    {
+        MetricsState &st = GetState();
+        Mutex::Lock lock(st.mutex);
+        st.gauges[++st.gaugeId] = std::make_pair(name, std::move(gauge));
+        return st.gaugeId;
+    }
+
+    void Metrics::DelGauge(uint64_t key)
+    {
+        MetricsState &st = GetState();
+        // waits for the snapshots calling the gauge, its owner may be going away
+        RWMutex::WriteLock gauge_lock(st.gaugeMutex);
+        Mutex::Lock lock(st.mutex);
+        st.gauges.erase(key);
+    }
+
+    std::map<std::string, int64_t> Metrics::GetSnapshot()
+    {
+        MetricsState &st = GetState();
+        std::map<std::string, int64_t> snapshot;
+        std::vector<std::pair<std::string, Gauge>> gauges;
+        RWMutex::ReadLock gauge_lock(st.gaugeMutex);
+        {
+            Mutex::Lock lock(st.mutex);
+            for (size_t i = 0; i < st.names.size(); ++i)
+            {
+                uint64_t sum = 0;
+                for (auto block : st.blocks)
+                {
+                    sum += block->values[i].load(std::memory_order_relaxed);
+                }
+                snapshot[st.names[i]] = sum;
+            }
+            for (auto &i : st.gauges)
+            {
+                gauges.push_back(i.second);
+            }
+        }
+        // gauges take their owners' locks, not under ours
+        for (auto &i : gauges)
+        {
+            snapshot[i.first] = i.second();
+        }
+        return snapshot;
+    }
+
+    std::string Metrics::ToString(const std::map<std::string, int64_t> &snapshot)
+    {
+        std::stringstream ss;
+        for (auto &i : snapshot)
+        {
+            ss << i.first << "=" << i.second << "\n";
+        }
+        return ss.str();
+    }
+
+    void Metrics::StartDump(uint32_t interval_ms)
+    {
+        MetricsState &st = GetState();
+        Mutex::Lock lock(st.mutex);
+        if (st.dumping)
+        {
+            return;
+        }
+        st.interval = std::max<uint32_t>(interval_ms, 10);
+        st.dumping = true;
+        st.dumper.reset(new Thread(&DumpMain, "metrics"));
+    }
+
+    void Metrics::StopDump()
+    {
+        MetricsState &st = GetState();
+        Thread::ptr dumper;
+        {
+            Mutex::Lock lock(st.mutex);
+            st.dumping = false;
+            dumper.swap(st.dumper);
+        }
+        if (dumper)
+        {
+            dumper->join();
+        }
+    }
+}
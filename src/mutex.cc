@@ -1 +1,100 @@
 #include "mutex.h"
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <thread>
+
+namespace sylar
+{
+    // addr is the 32 bit atomic the waiters sleep on
+    static long Futex(void *addr, int op, uint32_t val)
+    {
+        return syscall(SYS_futex, addr, op | FUTEX_PRIVATE_FLAG, val, nullptr, nullptr, 0);
+    }
+
+    // spinning only pays off when the owner can run at the same time
+    static uint32_t SpinLimit()
+    {
+        static const uint32_t s_limit = std::thread::hardware_concurrency() > 1 ? 100 : 0;
+        return s_limit;
+    }
+
+    // pauses 1, 2, 4 .. 64 times per try, a few microseconds in total
+    static void Backoff(uint32_t &backoff)
+    {
+        for (uint32_t i = 0; i < backoff; ++i)
+        {
+            CpuRelax();
+        }
+        if (backoff < 64)
+        {
+            backoff <<= 1;
+        }
+    }
+
+    void FutexMutex::lockSlow()
+    {
+        uint32_t backoff = 1;
+        for (uint32_t spin = 0; spin < SpinLimit(); ++spin)
+        {
+            uint32_t c = m_state.load(std::memory_order_relaxed);
+            if (c == 0 && m_state.compare_exchange_weak(c, 1, std::memory_order_acquire, std::memory_order_relaxed))
+            {
+                return;
+            }
+            // somebody already sleeps, the owner will go through the kernel anyway
+            if (c == 2)
+            {
+                break;
+            }
+            Backoff(backoff);
+        }
+
+        // mark the lock contended, whoever unlocks it now has to wake us
+        while (m_state.exchange(2, std::memory_order_acquire) != 0)
+        {
+            Futex(&m_state, FUTEX_WAIT, 2);
+        }
+    }
+
+    void FutexMutex::wake()
+    {
+        Futex(&m_state, FUTEX_WAKE, 1);
+    }
+
+    void FutexSemaphore::waitSlow()
+    {
+        uint32_t backoff = 1;
+        for (uint32_t spin = 0; spin < SpinLimit(); ++spin)
+        {
+            int32_t c = m_count.load(std::memory_order_relaxed);
+            if (c > 0 && m_count.compare_exchange_weak(c, c - 1, std::memory_order_acquire, std::memory_order_relaxed))
+            {
+                return;
+            }
+            Backoff(backoff);
+        }
+
+        m_waiters.fetch_add(1, std::memory_order_seq_cst);
+        for (;;)
+        {
+            int32_t c = m_count.load(std::memory_order_seq_cst);
+            if (c > 0)
+            {
+                if (m_count.compare_exchange_weak(c, c - 1, std::memory_order_acquire, std::memory_order_relaxed))
+                {
+                    break;
+                }
+                continue;
+            }
+            Futex(&m_count, FUTEX_WAIT, 0);
+        }
+        m_waiters.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    void FutexSemaphore::wake()
+    {
+        Futex(&m_count, FUTEX_WAKE, 1);
+    }
+}
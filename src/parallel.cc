@@ -0,0 +1,124 @@
+#include "parallel.h"
+#include "fiber_sync.h"
+
+namespace sylar
+{
+    namespace
+    {
+        // one loop, shared with the helper tasks that may start after it has finished
+        struct ParallelState
+        {
+            typedef std::shared_ptr<ParallelState> ptr;
+            typedef SpinLock MutexType;
+
+            size_t begin;
+            size_t end;
+            size_t grain;
+            size_t chunks;
+            // only touched for a claimed chunk, the caller outlives every claimed chunk
+            const std::function<void(size_t, size_t, size_t)> *fn;
+
+            std::atomic<size_t> next{0};
+            std::atomic<size_t> done{0};
+            std::atomic<bool> failed{false};
+            MutexType mutex;
+            std::exception_ptr error;
+            FiberSemaphore finished;
+        };
+
+        void Work(const ParallelState::ptr &st)
+        {
+            while (true)
+            {
+                size_t chunk = st->next.fetch_add(1, std::memory_order_relaxed);
+                if (chunk >= st->chunks)
+                {
+                    return;
+                }
+                if (!st->failed.load(std::memory_order_relaxed))
+                {
+                    size_t b = st->begin + chunk * st->grain;
+                    try
+                    {
+                        (*st->fn)(chunk, b, std::min(b + st->grain, st->end));
+                    }
+                    catch (...)
+                    {
+                        ParallelState::MutexType::Lock lock(st->mutex);
+                        if (!st->error)
+                        {
+                            st->error = std::current_exception();
+                        }
+                        st->failed.store(true, std::memory_order_relaxed);
+                    }
+                }
+                if (st->done.fetch_add(1, std::memory_order_acq_rel) + 1 == st->chunks)
+                {
+                    st->finished.notify();
+                }
+            }
+        }
+
+        Scheduler *Resolve(Scheduler *scheduler)
+        {
+            return scheduler ? scheduler : Scheduler::GetThis();
+        }
+
+        size_t Grain(size_t n, size_t grain, Scheduler *scheduler)
+        {
+            if (grain)
+            {
+                return grain;
+            }
+            size_t workers = scheduler ? std::max<size_t>(1, scheduler->getThreadCount()) : 1;
+            return std::max<size_t>(1, n / (workers * 8));
+        }
+    }
+
+    size_t ParallelGrain(size_t begin, size_t end, size_t grain, Scheduler *scheduler)
+    {
+        return Grain(end > begin ? end - begin : 0, grain, Resolve(scheduler));
+    }
+
+    void ParallelChunks(size_t begin, size_t end, size_t grain,
+                        const std::function<void(size_t chunk, size_t b, size_t e)> &fn,
+                        Scheduler *scheduler)
+    {
+        if (end <= begin)
+        {
+            return;
+        }
+        scheduler = Resolve(scheduler);
+        grain = Grain(end - begin, grain, scheduler);
+        size_t chunks = (end - begin + grain - 1) / grain;
+        if (!scheduler || chunks == 1)
+        {
+            for (size_t i = 0; i < chunks; ++i)
+            {
+                size_t b = begin + i * grain;
+                fn(i, b, std::min(b + grain, end));
+            }
+            return;
+        }
+
+        ParallelState::ptr st(new ParallelState);
+        st->begin = begin;
+        st->end = end;
+        st->grain = grain;
+        st->chunks = chunks;
+        st->fn = &fn;
+        size_t helpers = std::min(std::max<size_t>(1, scheduler->getThreadCount()), chunks - 1);
+        for (size_t i = 0; i < helpers; ++i)
+        {
+            scheduler->schedule(std::function<void()>([st]()
+                                                      { Work(st); }));
+        }
+        // the caller takes chunks too instead of idling
+        Work(st);
+        st->finished.wait();
+        if (st->error)
+        {
+            std::rethrow_exception(st->error);
+        }
+    }
+}
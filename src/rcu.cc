@@ -0,0 +1,160 @@
+#include "rcu.h"
+#include "mutex.h"
+
+#include <sched.h>
+#include <vector>
+#include <list>
+
+namespace sylar
+{
+    // one per thread, on its own cache line. seq is odd while the thread is inside a read section
+    struct alignas(64) RcuReader
+    {
+        std::atomic<uint64_t> seq{0};
+        uint32_t nesting = 0;
+        bool inUse = false;
+    };
+
+    typedef Mutex RcuMutexType;
+
+    static RcuMutexType &GetReaderMutex()
+    {
+        static RcuMutexType s_mutex;
+        return s_mutex;
+    }
+
+    // readers are never freed, slots of exited threads are reused
+    static std::vector<RcuReader *> &GetReaders()
+    {
+        static std::vector<RcuReader *> *s_readers = new std::vector<RcuReader *>;
+        return *s_readers;
+    }
+
+    static RcuMutexType &GetRetireMutex()
+    {
+        static RcuMutexType s_mutex;
+        return s_mutex;
+    }
+
+    static std::list<std::function<void()>> &GetDeferred()
+    {
+        static std::list<std::function<void()>> *s_deferred = new std::list<std::function<void()>>;
+        return *s_deferred;
+    }
+
+    struct RcuReaderHolder
+    {
+        RcuReader *reader = nullptr;
+
+        RcuReader *get()
+        {
+            if (reader)
+            {
+                return reader;
+            }
+            RcuMutexType::Lock lock(GetReaderMutex());
+            for (auto r : GetReaders())
+            {
+                if (!r->inUse)
+                {
+                    reader = r;
+                    break;
+                }
+            }
+            if (!reader)
+            {
+                reader = new RcuReader;
+                GetReaders().push_back(reader);
+            }
+            reader->inUse = true;
+            return reader;
+        }
+
+        ~RcuReaderHolder()
+        {
+            if (reader)
+            {
+                RcuMutexType::Lock lock(GetReaderMutex());
+                reader->inUse = false;
+                reader = nullptr;
+            }
+        }
+    };
+
+    static thread_local RcuReaderHolder t_reader;
+
+    void Rcu::ReadLockEnter()
+    {
+        RcuReader *r = t_reader.get();
+        if (r->nesting++ == 0)
+        {
+            r->seq.store(r->seq.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            // order the odd seq before any load of published pointers
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+        }
+    }
+
+    void Rcu::ReadLockLeave()
+    {
+        RcuReader *r = t_reader.reader;
+        if (--r->nesting == 0)
+        {
+            r->seq.store(r->seq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+    }
+
+    bool Rcu::InReadSection()
+    {
+        return t_reader.reader && t_reader.reader->nesting > 0;
+    }
+
+    void Rcu::Synchronize()
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        RcuReader *self = t_reader.reader;
+        std::vector<std::pair<RcuReader *, uint64_t>> active;
+        {
+            RcuMutexType::Lock lock(GetReaderMutex());
+            for (auto r : GetReaders())
+            {
+                uint64_t seq = r->seq.load(std::memory_order_acquire);
+                if ((seq & 1) && r != self)
+                {
+                    active.push_back(std::make_pair(r, seq));
+                }
+            }
+        }
+        for (auto &i : active)
+        {
+            for (int spin = 0; i.first->seq.load(std::memory_order_acquire) == i.second; ++spin)
+            {
+                if (spin > 64)
+                {
+                    sched_yield();
+                }
+            }
+        }
+    }
+
+    void Rcu::Retire(std::function<void()> cb)
+    {
+        if (InReadSection())
+        {
+            RcuMutexType::Lock lock(GetRetireMutex());
+            GetDeferred().push_back(std::move(cb));
+            return;
+        }
+
+        std::list<std::function<void()>> cbs;
+        {
+            RcuMutexType::Lock lock(GetRetireMutex());
+            cbs.swap(GetDeferred());
+        }
+        cbs.push_back(std::move(cb));
+        Synchronize();
+        for (auto &i : cbs)
+        {
+            i();
+        }
+    }
+}
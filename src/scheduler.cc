@@ -1,14 +1,31 @@
 #include "scheduler.h"
+#include "config.h"
 #include "log.h"
 #include "macro.h"
+#include "metrics.h"
 #include "hook.h"
+#include "util.h"
+#include "watchdog.h"
+#include <algorithm>
 
 namespace sylar
 {
     static Logger::ptr g_logger = LOG_NAME("system");
 
+    static ConfigVar<std::string>::ptr g_cpu_affinity = Config::Lookup<std::string>("scheduler.cpu_affinity", "",
+                                                                                    "cpus scheduler workers are pinned to: \"0,2,4-7\", \"physical\" (one per physical core) or empty");
+
+    static Counter s_tasks("scheduler.tasks");
+    static Counter s_tickles("scheduler.tickles");
+    static Counter s_idle_us("scheduler.idle_us");
+
     static thread_local Scheduler *t_scheduler = nullptr;
     static thread_local Fiber *t_fiber = nullptr;
+    // index of the worker thread in m_threads, -1 on the use_caller thread
+    static thread_local int t_worker = -1;
+    static thread_local std::atomic<bool> *t_retire = nullptr;
+    static thread_local std::atomic<bool> *t_exited = nullptr;
+    static thread_local std::atomic<bool> *t_idle = nullptr;
 
     Scheduler::Scheduler(size_t threadCount, bool use_caller, const std::string &name)
         : m_name(name)
@@ -38,11 +55,28 @@ namespace sylar
             m_rootThread = -1;
         }
         m_threadCount = threadCount;
+        if (!g_cpu_affinity->getValue().empty())
+        {
+            setCpuAffinity(ParseCpuList(g_cpu_affinity->getValue()));
+        }
+        addGauge("scheduler", "queued", [this]()
+                 {
+                     MutexType::Lock lock(m_mutex);
+                     return (int64_t)m_queued; });
+        addGauge("scheduler", "threads", [this]()
+                 { return (int64_t)m_threadCount; });
+        addGauge("scheduler", "active_threads", [this]()
+                 { return (int64_t)m_activeThreads; });
+        addGauge("scheduler", "idle_threads", [this]()
+                 { return (int64_t)m_idleThreads; });
+        addGauge("scheduler", "parked_fibers", [this]()
+                 { return (int64_t)m_parkedFibers; });
     }
 
     Scheduler::~Scheduler()
     {
         _ASSERT(m_stopping);
+        delGauges();
         if (GetThis() == this)
         {
             t_scheduler = nullptr;
@@ -70,12 +104,9 @@ namespace sylar
         m_stopping = false;
         _ASSERT(m_threads.empty());
 
-        m_threads.resize(m_threadCount);
         for (size_t i = 0; i < m_threadCount; ++i)
         {
-            m_threads[i].reset(new Thread(std::bind(&Scheduler::run, this),
-                                          m_name + "_" + std::to_string(i)));
-            m_threadIds.push_back(m_threads[i]->getId());
+            startWorkerNoLock();
         }
         // lock.unlock();
         // if (m_rootFiber)
@@ -111,7 +142,13 @@ namespace sylar
         }
 
         m_stopping = true;
-        for (size_t i = 0; i < m_threadCount; ++i)
+        size_t tickles = 0;
+        {
+            // reapRetired on a worker may be erasing from m_retired
+            MutexType::Lock lock(m_mutex);
+            tickles = m_threadCount + m_retired.size();
+        }
+        for (size_t i = 0; i < tickles; ++i)
         {
             tickle();
         }
@@ -133,6 +170,12 @@ namespace sylar
         {
             MutexType::Lock lock(m_mutex);
             thrs.swap(m_threads);
+            for (auto &i : m_retired)
+            {
+                thrs.push_back(i.first);
+            }
+            m_retired.clear();
+            m_workers.clear();
         }
         for (auto &i : thrs)
         {
@@ -155,6 +198,11 @@ namespace sylar
             t_fiber = Fiber::GetThis().get();
         }
 
+        // pinned before the idle fiber so its stack comes from the local node
+        uint32_t pinned = 0;
+        applyAffinity(pinned);
+        Watchdog::RegisterThread();
+
         // if all tasks are finished, idle_fiber kicks in to do the idle operation
         Fiber::ptr idle_fiber(new Fiber(std::bind(&Scheduler::idle, this)));
         // cb_fiber is used to handle the cb function if it is not wrapped in existing fiber
@@ -163,37 +211,23 @@ namespace sylar
         FiberAndThread ft;
         while (true)
         {
+            applyAffinity(pinned);
             ft.reset();
             bool tickle_me = false;
             bool is_active = false;
             {
                 MutexType::Lock lock(m_mutex);
-                auto it = m_fibers.begin();
-                while (it != m_fibers.end())
+                if (takeNoLock(ft, tickle_me))
                 {
-                    // if a fiber task is assigned to a specific thread, skip it
-                    if (it->thread != -1 && it->thread != GetThreadId())
-                    {
-                        ++it;
-                        // tell other threads to work on this task
-                        tickle_me = true;
-                        continue;
-                    }
-                    // for a given task, at least a fiber instance or a call back fun should be provided
-                    _ASSERT(it->fiber || it->cb);
-                    if (it->fiber && it->fiber->getState() == Fiber::EXEC)
-                    {
-                        ++it;
-                        continue;
-                    }
                     ++m_activeThreads;
                     is_active = true;
-                    ft = *it;
-                    // tickle_me = true;
-                    m_fibers.erase(it);
-                    break;
                 }
-                tickle_me |= it != m_fibers.end();
+            }
+            // a worker that found nothing is about to idle, it counts as idle
+            autoScale(!is_active);
+            if (is_active)
+            {
+                s_tasks.inc();
             }
 
             if (tickle_me)
@@ -204,23 +238,27 @@ namespace sylar
             if (ft.fiber && ft.fiber->getState() != Fiber::TERM && ft.fiber->getState() != Fiber::EXCEPT)
             {
                 // start the task
+                ft.fiber->m_priority = ft.priority;
+                Watchdog::RunBegin(ft.fiber->getId());
                 ft.fiber->swapIn();
+                Watchdog::RunEnd();
                 --m_activeThreads;
 
                 if (ft.fiber->getState() == Fiber::READY)
                 {
-                    // put back to the task queue
-                    schedule(ft.fiber);
+                    // put back to the task queue, handing over ft's reference
+                    schedule(std::move(ft.fiber), -1, ft.priority);
                 }
                 else if (ft.fiber->getState() != Fiber::TERM && ft.fiber->getState() != Fiber::EXCEPT)
                 {
                     // what to do with HOLD next?
-                    ft.fiber->m_state = Fiber::HOLD;
+                    ft.fiber->m_state.store(Fiber::HOLD, std::memory_order_release);
                 }
                 ft.reset();
             }
             else if (ft.cb)
             {
+                Priority priority = ft.priority;
                 if (cb_fiber)
                 {
                     // push call back function to cb_fiber
@@ -233,14 +271,16 @@ namespace sylar
                 ft.reset();
                 // start task
                 // LOG_INFO(g_logger) << "Thread start to run cb";
+                cb_fiber->m_priority = priority;
+                Watchdog::RunBegin(cb_fiber->getId());
                 cb_fiber->swapIn();
+                Watchdog::RunEnd();
                 // LOG_INFO(g_logger) << "Thread finish to run cb";
                 --m_activeThreads;
 
                 if (cb_fiber->getState() == Fiber::READY)
                 {
-                    schedule(cb_fiber);
-                    cb_fiber.reset();
+                    schedule(std::move(cb_fiber), -1, priority);
                 }
                 else if (cb_fiber->getState() == Fiber::TERM || cb_fiber->getState() == Fiber::EXCEPT)
                 {
@@ -248,7 +288,7 @@ namespace sylar
                 }
                 else
                 {
-                    cb_fiber->m_state = Fiber::HOLD;
+                    cb_fiber->m_state.store(Fiber::HOLD, std::memory_order_release);
                     cb_fiber.reset();
                 }
             }
@@ -263,23 +303,343 @@ namespace sylar
                 {
                     LOG_INFO(g_logger) << "idle fiber terminated.";
                     tickle();
+                    Watchdog::UnregisterThread();
+                    if (t_retire && *t_retire)
+                    {
+                        retireWorker();
+                    }
                     break;
                 }
 
                 ++m_idleThreads;
+                if (t_idle)
+                {
+                    t_idle->store(true, std::memory_order_relaxed);
+                }
+                uint64_t idle_start = GetCurrentUS();
                 idle_fiber->swapIn();
+                s_idle_us.inc(GetCurrentUS() - idle_start);
+                if (t_idle)
+                {
+                    t_idle->store(false, std::memory_order_relaxed);
+                }
                 --m_idleThreads;
                 if (idle_fiber->getState() != Fiber::TERM && idle_fiber->getState() != Fiber::EXCEPT)
                 {
                     // next iteration will continue to execute hold logic
-                    idle_fiber->m_state = Fiber::HOLD;
+                    idle_fiber->m_state.store(Fiber::HOLD, std::memory_order_release);
+                }
+            }
+        }
+    }
+
+    bool Scheduler::takeNoLock(FiberAndThread &ft, bool &tickle)
+    {
+        bool weighted = m_weights[HIGH] || m_weights[NORMAL] || m_weights[LOW];
+        // a level out of credits lets the lower levels run. the weighted round ends when
+        // nothing with credits is runnable, the second pass runs with refilled credits
+        for (int pass = 0; pass < 2; ++pass)
+        {
+            bool out_of_credits = false;
+            for (int p = 0; p < PRIORITY_COUNT; ++p)
+            {
+                auto &queue = m_fibers[p];
+                for (auto it = queue.begin(); it != queue.end(); ++it)
+                {
+                    // if a fiber task is assigned to a specific thread, skip it
+                    if (it->thread != -1 && it->thread != GetThreadId())
+                    {
+                        // tell other threads to work on this task
+                        tickle = true;
+                        continue;
+                    }
+                    // for a given task, at least a fiber instance or a call back fun should be provided
+                    _ASSERT(it->fiber || it->cb);
+                    // acquire, the context saved by the worker that stored HOLD is visible
+                    if (it->fiber && it->fiber->m_state.load(std::memory_order_acquire) == Fiber::EXEC)
+                    {
+                        continue;
+                    }
+                    if (weighted && m_credits[p] == 0)
+                    {
+                        out_of_credits = true;
+                        break;
+                    }
+                    if (weighted)
+                    {
+                        --m_credits[p];
+                    }
+                    ft = std::move(*it);
+                    queue.erase(it);
+                    --m_queued;
+                    tickle |= m_queued > 0;
+                    return true;
                 }
             }
+            if (!out_of_credits)
+            {
+                return false;
+            }
+            m_credits = m_weights;
+        }
+        return false;
+    }
+
+    void Scheduler::setPriorityWeights(uint32_t high, uint32_t normal, uint32_t low)
+    {
+        MutexType::Lock lock(m_mutex);
+        if (high || normal || low)
+        {
+            // a zero weight level would never run
+            m_weights = {std::max(high, 1u), std::max(normal, 1u), std::max(low, 1u)};
+        }
+        else
+        {
+            m_weights = {0, 0, 0};
+        }
+        m_credits = m_weights;
+    }
+
+    void Scheduler::setCpuAffinity(const std::vector<int> &cpus)
+    {
+        {
+            MutexType::Lock lock(m_mutex);
+            m_cpus = cpus;
+        }
+        ++m_affinityVersion;
+        if (!m_stopping)
+        {
+            // idle workers pick it up when woken
+            for (size_t i = 0; i < m_threadCount; ++i)
+            {
+                tickle();
+            }
         }
     }
 
+    std::vector<int> Scheduler::getCpuAffinity()
+    {
+        MutexType::Lock lock(m_mutex);
+        return m_cpus;
+    }
+
+    void Scheduler::applyAffinity(uint32_t &pinned)
+    {
+        uint32_t version = m_affinityVersion.load(std::memory_order_relaxed);
+        if (t_worker == -1 || pinned == version)
+        {
+            return;
+        }
+        pinned = version;
+        int cpu = -1;
+        {
+            MutexType::Lock lock(m_mutex);
+            if (!m_cpus.empty())
+            {
+                cpu = m_cpus[t_worker % m_cpus.size()];
+            }
+        }
+        if (cpu != -1)
+        {
+            SetThreadAffinity(cpu);
+        }
+    }
+
+    void Scheduler::startWorkerNoLock()
+    {
+        size_t i = m_threads.size();
+        std::shared_ptr<WorkerFlags> flags(new WorkerFlags);
+        m_threads.push_back(Thread::ptr(new Thread([this, i, flags]()
+                                                   {
+                                                       t_worker = i;
+                                                       t_retire = &flags->retire;
+                                                       t_exited = &flags->exited;
+                                                       t_idle = &flags->idle;
+                                                       run(); },
+                                                   m_name + "_" + std::to_string(i))));
+        m_workers.push_back(flags);
+        m_threadIds.push_back(m_threads.back()->getId());
+    }
+
+    void Scheduler::setThreadCount(size_t count)
+    {
+        reapRetired();
+        size_t tickles = 0;
+        {
+            MutexType::Lock lock(m_mutex);
+            if (m_stopping)
+            {
+                // not started, or stopped
+                m_threadCount = count;
+                return;
+            }
+            while (m_threads.size() < count)
+            {
+                startWorkerNoLock();
+            }
+            while (m_threads.size() > count)
+            {
+                m_workers.back()->retire = true;
+                m_retired.push_back(std::make_pair(m_threads.back(), m_workers.back()));
+                m_threads.pop_back();
+                m_workers.pop_back();
+                ++tickles;
+            }
+            m_threadCount = count;
+        }
+        LOG_INFO(g_logger) << m_name << " thread count " << count;
+        // wake the idle workers so the retired ones leave
+        for (size_t i = 0; i < tickles + m_idleThreads; ++i)
+        {
+            tickle();
+        }
+    }
+
+    void Scheduler::setAutoScale(size_t min, size_t max)
+    {
+        MutexType::Lock lock(m_mutex);
+        m_autoMin = std::max<size_t>(min, 1);
+        m_autoMax = max;
+        m_idleSince = 0;
+    }
+
+    void Scheduler::autoScale(bool idle)
+    {
+        if (!m_autoMax || t_worker == -1)
+        {
+            return;
+        }
+        uint64_t now = GetCurrentMS();
+        uint64_t last = m_lastScale.load(std::memory_order_relaxed);
+        if (now < last + 100 || !m_lastScale.compare_exchange_strong(last, now))
+        {
+            return;
+        }
+        reapRetired();
+        size_t threads = m_threadCount;
+        size_t target = threads;
+        {
+            MutexType::Lock lock(m_mutex);
+            if (m_stopping)
+            {
+                return;
+            }
+            size_t idle_threads = m_idleThreads + (idle ? 1 : 0);
+            if (m_queued > threads && idle_threads == 0 && threads < m_autoMax)
+            {
+                target = threads + 1;
+                m_idleSince = 0;
+            }
+            else if (idle_threads * 2 > threads && threads > m_autoMin)
+            {
+                if (!m_idleSince)
+                {
+                    m_idleSince = now;
+                }
+                else if (now >= m_idleSince + 1000)
+                {
+                    target = threads - 1;
+                    m_idleSince = 0;
+                }
+            }
+            else
+            {
+                m_idleSince = 0;
+            }
+        }
+        if (target != threads)
+        {
+            setThreadCount(target);
+        }
+    }
+
+    bool Scheduler::retiring()
+    {
+        return t_retire && *t_retire;
+    }
+
+    bool Scheduler::hasIdleRetired()
+    {
+        MutexType::Lock lock(m_mutex);
+        for (auto &i : m_retired)
+        {
+            if (i.second->idle.load(std::memory_order_relaxed) && !i.second->exited.load(std::memory_order_relaxed))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void Scheduler::retireWorker()
+    {
+        int id = GetThreadId();
+        bool unpinned = false;
+        {
+            MutexType::Lock lock(m_mutex);
+            m_threadIds.erase(std::remove(m_threadIds.begin(), m_threadIds.end(), id), m_threadIds.end());
+            // tasks pinned here would never run, any worker may take them now
+            for (auto &queue : m_fibers)
+            {
+                for (auto &i : queue)
+                {
+                    if (i.thread == id)
+                    {
+                        i.thread = -1;
+                        unpinned = true;
+                    }
+                }
+            }
+        }
+        if (unpinned)
+        {
+            tickle();
+        }
+        t_exited->store(true, std::memory_order_release);
+    }
+
+    void Scheduler::reapRetired()
+    {
+        std::vector<Thread::ptr> exited;
+        {
+            MutexType::Lock lock(m_mutex);
+            for (auto it = m_retired.begin(); it != m_retired.end();)
+            {
+                if (it->second->exited.load(std::memory_order_acquire))
+                {
+                    exited.push_back(it->first);
+                    it = m_retired.erase(it);
+                }
+                else
+                {
+                    ++it;
+                }
+            }
+        }
+        // they are past run(), the joins only wait for the thread to unwind
+        for (auto &i : exited)
+        {
+            i->join();
+        }
+    }
+
+    void Scheduler::addGauge(const std::string &prefix, const std::string &name, std::function<int64_t()> gauge)
+    {
+        m_gauges.push_back(Metrics::AddGauge(prefix + "." + m_name + "." + name, std::move(gauge)));
+    }
+
+    void Scheduler::delGauges()
+    {
+        for (auto key : m_gauges)
+        {
+            Metrics::DelGauge(key);
+        }
+        m_gauges.clear();
+    }
+
     void Scheduler::tickle()
     {
+        s_tickles.inc();
         LOG_INFO(g_logger) << "tickle";
     }
 
@@ -287,7 +647,7 @@ namespace sylar
     {
         LOG_INFO(g_logger) << "idle";
 
-        while (!stopping())
+        while (!stopping() && !retiring())
         {
             Fiber::YieldToHold();
         }
@@ -295,7 +655,12 @@ namespace sylar
 
     bool Scheduler::stopping()
     {
+        // checked before m_fibers, a woken fiber is queued before it stops counting as parked
+        if (m_parkedFibers)
+        {
+            return false;
+        }
         MutexType::Lock lock(m_mutex);
-        return m_autoStop && m_stopping && m_fibers.empty() && m_activeThreads == 0;
+        return m_autoStop && m_stopping && m_queued == 0 && m_activeThreads == 0;
     }
 }
\ No newline at end of file
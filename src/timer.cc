@@ -1,8 +1,11 @@
 #include "timer.h"
+#include "metrics.h"
 #include "util.h"
 
 namespace sylar
 {
+    static Counter s_expired("timer.expired");
+
     bool Timer::Comparator::operator()(const Timer::ptr &lhs, const Timer::ptr &rhs) const
     {
         if (!lhs && !rhs)
@@ -44,7 +47,7 @@ namespace sylar
         if (m_cb)
         {
             m_cb = nullptr;
-            auto it = m_manager->m_timers.find(shared_from_this());
+            auto it = m_manager->m_timers.find(Timer::ptr(this));
             m_manager->m_timers.erase(it);
             return true;
         }
@@ -58,14 +61,14 @@ namespace sylar
         {
             return false;
         }
-        auto it = m_manager->m_timers.find(shared_from_this());
+        auto it = m_manager->m_timers.find(Timer::ptr(this));
         if (it == m_manager->m_timers.end())
         {
             return false;
         }
         m_manager->m_timers.erase(it);
         m_next = GetCurrentMS() + m_ms;
-        m_manager->m_timers.insert(shared_from_this());
+        m_manager->m_timers.insert(Timer::ptr(this));
         return true;
     }
 
@@ -80,7 +83,7 @@ namespace sylar
         {
             return false;
         }
-        auto it = m_manager->m_timers.find(shared_from_this());
+        auto it = m_manager->m_timers.find(Timer::ptr(this));
         if (it == m_manager->m_timers.end())
         {
             return false;
@@ -97,7 +100,7 @@ namespace sylar
         }
         m_ms = ms;
         m_next = start + m_ms;
-        m_manager->addTimer(shared_from_this(), lock);
+        m_manager->addTimer(Timer::ptr(this), lock);
         return true;
     }
 
@@ -181,6 +184,11 @@ namespace sylar
             }
         }
         RWMutexType::WriteLock lock(m_mutex);
+        // another idle thread may have taken them between the two locks
+        if (m_timers.empty())
+        {
+            return;
+        }
         bool rollover = detectClockRollover(now_ms);
         if (!rollover && ((*m_timers.begin())->m_next > now_ms))
         {
@@ -196,6 +204,7 @@ namespace sylar
         expired.insert(expired.begin(), m_timers.begin(), it);
         m_timers.erase(m_timers.begin(), it);
 
+        s_expired.inc(expired.size());
         cbs.reserve(expired.size());
         for (auto &timer : expired)
         {
@@ -228,4 +237,10 @@ namespace sylar
         RWMutexType::ReadLock lock(m_mutex);
         return !m_timers.empty();
     }
+
+    size_t TimerManager::getTimerCount()
+    {
+        RWMutexType::ReadLock lock(m_mutex);
+        return m_timers.size();
+    }
 }
\ No newline at end of file
@@ -2,7 +2,11 @@
 #include "log.h"
 #include "fiber.h"
 
+#include <dirent.h>
 #include <execinfo.h>
+#include <fstream>
+#include <set>
+#include <sched.h>
 #include <sys/time.h>
 namespace sylar
 {
@@ -38,6 +42,23 @@ namespace sylar
         free(array);
     }
 
+    std::string BacktraceToString(void *const *frames, int size, int skip, const std::string &prefix)
+    {
+        char **strings = backtrace_symbols(frames, size);
+        if (strings == NULL)
+        {
+            LOG_ERROR(g_logger) << "backtrace_symbols error";
+            return "";
+        }
+        std::stringstream ss;
+        for (int i = skip; i < size; ++i)
+        {
+            ss << prefix << strings[i] << "\n";
+        }
+        free(strings);
+        return ss.str();
+    }
+
     std::string BacktraceToString(int size, int skip, const std::string &prefix)
     {
         std::vector<std::string> bt;
@@ -63,4 +84,143 @@ namespace sylar
         gettimeofday(&tv, NULL);
         return tv.tv_sec * 1000 * 1000ul + tv.tv_usec;
     }
+
+    static thread_local int t_numa_node = -1;
+
+    static int ReadCpuTopology(int cpu, const char *name)
+    {
+        std::ifstream in("/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/" + name);
+        int v = -1;
+        in >> v;
+        return v;
+    }
+
+    std::vector<int> GetOnlineCpus()
+    {
+        std::vector<int> cpus;
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if (sched_getaffinity(0, sizeof(set), &set))
+        {
+            LOG_ERROR(g_logger) << "sched_getaffinity errno=" << errno;
+            return cpus;
+        }
+        for (int i = 0; i < CPU_SETSIZE; ++i)
+        {
+            if (CPU_ISSET(i, &set))
+            {
+                cpus.push_back(i);
+            }
+        }
+        return cpus;
+    }
+
+    std::vector<int> GetPhysicalCoreCpus()
+    {
+        std::vector<int> cpus;
+        std::set<std::pair<int, int>> cores;
+        for (int cpu : GetOnlineCpus())
+        {
+            // cpus without topology info count as a core of their own
+            int package = ReadCpuTopology(cpu, "physical_package_id");
+            int core = ReadCpuTopology(cpu, "core_id");
+            if (core == -1 || cores.insert(std::make_pair(package, core)).second)
+            {
+                cpus.push_back(cpu);
+            }
+        }
+        return cpus;
+    }
+
+    int GetCpuNode(int cpu)
+    {
+        std::string path = "/sys/devices/system/cpu/cpu" + std::to_string(cpu);
+        DIR *dir = opendir(path.c_str());
+        if (!dir)
+        {
+            return 0;
+        }
+        int node = 0;
+        while (dirent *ent = readdir(dir))
+        {
+            if (strncmp(ent->d_name, "node", 4) == 0 && isdigit(ent->d_name[4]))
+            {
+                node = atoi(ent->d_name + 4);
+                break;
+            }
+        }
+        closedir(dir);
+        return node;
+    }
+
+    int GetNumaNodeCount()
+    {
+        static int s_count = []()
+        {
+            std::set<int> nodes;
+            for (int cpu : GetOnlineCpus())
+            {
+                nodes.insert(GetCpuNode(cpu));
+            }
+            return std::max<int>(1, nodes.size());
+        }();
+        return s_count;
+    }
+
+    std::vector<int> ParseCpuList(const std::string &str)
+    {
+        if (str == "physical")
+        {
+            return GetPhysicalCoreCpus();
+        }
+        std::vector<int> cpus;
+        std::stringstream ss(str);
+        std::string item;
+        while (std::getline(ss, item, ','))
+        {
+            int first = -1, last = -1;
+            char dash = 0;
+            std::stringstream is(item);
+            // a failed >> stores 0, so "cpu0" has to be caught by the stream state
+            bool ok = (bool)(is >> first);
+            if (ok && is >> dash)
+            {
+                ok = dash == '-' && is >> last && (is >> std::ws).eof();
+            }
+            else
+            {
+                last = first;
+            }
+            if (!ok || first < 0 || last < first || last >= CPU_SETSIZE)
+            {
+                LOG_ERROR(g_logger) << "invalid cpu list: " << str;
+                return std::vector<int>();
+            }
+            for (int i = first; i <= last; ++i)
+            {
+                cpus.push_back(i);
+            }
+        }
+        return cpus;
+    }
+
+    bool SetThreadAffinity(int cpu)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        int rt = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if (rt)
+        {
+            LOG_ERROR(g_logger) << "pthread_setaffinity_np cpu=" << cpu << " rt=" << rt;
+            return false;
+        }
+        t_numa_node = GetCpuNode(cpu);
+        return true;
+    }
+
+    int GetThreadNumaNode()
+    {
+        return t_numa_node;
+    }
 } // namespace sylar
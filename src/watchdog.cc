@@ -0,0 +1,257 @@
+#include "watchdog.h"
+#include "config.h"
+#include "fiber.h"
+#include "log.h"
+#include "scheduler.h"
+#include "thread.h"
+#include "util.h"
+#include <execinfo.h>
+#include <sched.h>
+#include <signal.h>
+#include <list>
+#include <vector>
+
+namespace sylar
+{
+    static Logger::ptr g_logger = LOG_NAME("system");
+
+    static ConfigVar<uint32_t>::ptr g_run_budget = Config::Lookup<uint32_t>("fiber.run_budget_ms", 10, "time a fiber may run without yielding");
+    static ConfigVar<bool>::ptr g_watchdog = Config::Lookup<bool>("fiber.watchdog", false, "log fibers running over fiber.run_budget_ms");
+
+    namespace
+    {
+        // the stamp of one worker thread
+        struct WatchSlot
+        {
+            pthread_t thread;
+            std::string name;
+            std::atomic<uint64_t> start{0};
+            std::atomic<uint64_t> fiber{0};
+            // start of the run already reported
+            uint64_t reported = 0;
+            void *frames[64];
+            std::atomic<int> frameCount{0};
+            // being signalled outside the state mutex, UnregisterThread waits for it
+            bool signalling = false;
+        };
+
+        struct WatchdogState
+        {
+            Mutex mutex;
+            std::list<WatchSlot *> slots;
+            Thread::ptr thread;
+            std::atomic<bool> running{false};
+        };
+
+        WatchdogState &GetState()
+        {
+            static WatchdogState s_state;
+            return s_state;
+        }
+
+        thread_local WatchSlot *t_slot = nullptr;
+        thread_local uint64_t t_run_start = 0;
+
+        const int WATCHDOG_SIGNAL = SIGRTMIN + 3;
+
+        // on the stuck worker, ::backtrace into its slot, the watchdog formats it
+        void OnSignal(int)
+        {
+            WatchSlot *slot = t_slot;
+            if (slot)
+            {
+                slot->frameCount.store(::backtrace(slot->frames, 64), std::memory_order_release);
+            }
+        }
+
+        // under the state mutex, whether the run on slot is over budget and not reported yet
+        bool IsStuck(WatchSlot *slot, uint64_t budget_us)
+        {
+            uint64_t start = slot->start.load(std::memory_order_acquire);
+            if (!start || start == slot->reported || GetCurrentUS() < start + budget_us)
+            {
+                return false;
+            }
+            slot->reported = start;
+            return true;
+        }
+
+        // outside the state mutex, the slot is kept alive by its signalling flag
+        void Report(WatchSlot *slot)
+        {
+            uint64_t start = slot->reported;
+            slot->frameCount.store(0, std::memory_order_relaxed);
+            pthread_kill(slot->thread, WATCHDOG_SIGNAL);
+            for (int i = 0; i < 100 && !slot->frameCount.load(std::memory_order_acquire); ++i)
+            {
+                usleep(100);
+            }
+            int n = slot->frameCount.load(std::memory_order_acquire);
+            // skip the signal handler frames
+            LOG_WARN(g_logger) << "fiber " << slot->fiber << " has been running for " << (GetCurrentUS() - start) / 1000
+                               << "ms on " << slot->name << " without yielding\n"
+                               << (n ? BacktraceToString(slot->frames, n, 2, "    ") : "    no backtrace\n");
+        }
+
+        void WatchdogMain()
+        {
+            WatchdogState &st = GetState();
+            std::vector<WatchSlot *> stuck;
+            while (st.running)
+            {
+                uint64_t budget_ms = std::max<uint32_t>(1, g_run_budget->getValue());
+                {
+                    Mutex::Lock lock(st.mutex);
+                    for (auto slot : st.slots)
+                    {
+                        if (IsStuck(slot, budget_ms * 1000))
+                        {
+                            slot->signalling = true;
+                            stuck.push_back(slot);
+                        }
+                    }
+                }
+                // workers register and unregister while the stuck ones are signalled
+                for (auto slot : stuck)
+                {
+                    Report(slot);
+                }
+                if (!stuck.empty())
+                {
+                    Mutex::Lock lock(st.mutex);
+                    for (auto slot : stuck)
+                    {
+                        slot->signalling = false;
+                    }
+                    stuck.clear();
+                }
+                usleep(std::max<uint64_t>(budget_ms / 2, 1) * 1000);
+            }
+        }
+
+        struct WatchdogIniter
+        {
+            WatchdogIniter()
+            {
+                g_watchdog->addListener([](const bool &old_value, const bool &new_value)
+                                        {
+                                            if (new_value)
+                                            {
+                                                Watchdog::Start();
+                                            }
+                                            else
+                                            {
+                                                Watchdog::Stop();
+                                            } });
+            }
+        };
+
+        static WatchdogIniter s_initer;
+    }
+
+    void Watchdog::Start()
+    {
+        WatchdogState &st = GetState();
+        Mutex::Lock lock(st.mutex);
+        if (st.running)
+        {
+            return;
+        }
+        struct sigaction sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = OnSignal;
+        sa.sa_flags = SA_RESTART;
+        sigaction(WATCHDOG_SIGNAL, &sa, nullptr);
+        // the first backtrace() loads libgcc, not something to do in a signal handler
+        void *warm[1];
+        ::backtrace(warm, 1);
+
+        st.running = true;
+        st.thread.reset(new Thread(&WatchdogMain, "watchdog"));
+    }
+
+    void Watchdog::Stop()
+    {
+        WatchdogState &st = GetState();
+        Thread::ptr thread;
+        {
+            Mutex::Lock lock(st.mutex);
+            st.running = false;
+            thread.swap(st.thread);
+        }
+        if (thread)
+        {
+            thread->join();
+        }
+    }
+
+    void Watchdog::RegisterThread()
+    {
+        WatchSlot *slot = new WatchSlot;
+        slot->thread = pthread_self();
+        slot->name = Thread::GetName();
+        t_slot = slot;
+        WatchdogState &st = GetState();
+        Mutex::Lock lock(st.mutex);
+        st.slots.push_back(slot);
+    }
+
+    void Watchdog::UnregisterThread()
+    {
+        WatchSlot *slot = t_slot;
+        if (!slot)
+        {
+            return;
+        }
+        {
+            WatchdogState &st = GetState();
+            Mutex::Lock lock(st.mutex);
+            st.slots.remove(slot);
+            // the watchdog is about to signal this thread or waiting for its backtrace.
+            // sched_yield, usleep is hooked on worker threads
+            while (slot->signalling)
+            {
+                lock.unlock();
+                sched_yield();
+                lock.lock();
+            }
+        }
+        t_slot = nullptr;
+        delete slot;
+    }
+
+    void Watchdog::RunBegin(uint64_t fiber_id)
+    {
+        t_run_start = GetCurrentUS();
+        if (t_slot)
+        {
+            t_slot->fiber.store(fiber_id, std::memory_order_relaxed);
+            t_slot->start.store(t_run_start, std::memory_order_release);
+        }
+    }
+
+    void Watchdog::RunEnd()
+    {
+        t_run_start = 0;
+        if (t_slot)
+        {
+            t_slot->start.store(0, std::memory_order_release);
+        }
+    }
+
+    uint64_t Watchdog::GetRunTime()
+    {
+        return t_run_start ? GetCurrentUS() - t_run_start : 0;
+    }
+
+    bool MaybeYield()
+    {
+        uint64_t run = Watchdog::GetRunTime();
+        if (!run || run < g_run_budget->getValue() * 1000ull)
+        {
+            return false;
+        }
+        Fiber::YieldToReady();
+        return true;
+    }
+}
@@ -0,0 +1,58 @@
+#include "channel.h"
+#include "iomanager.h"
+#include "log.h"
+#include "util.h"
+
+using namespace sylar;
+
+// a producer fiber sends count ints to a consumer fiber, both on one IOManager thread
+// or on two IOManagers. reports messages per second for a bounded and an unbounded channel
+static void bench(const char *name, size_t capacity, bool cross_thread, int count)
+{
+    Channel<int> ch(capacity);
+    uint64_t sum = 0;
+    IOManager producer(1, false, "producer");
+    std::unique_ptr<IOManager> other;
+    IOManager *consumer = &producer;
+    if (cross_thread)
+    {
+        other.reset(new IOManager(1, false, "consumer"));
+        consumer = other.get();
+    }
+
+    uint64_t start = GetCurrentUS();
+    consumer->schedule([&ch, &sum]()
+                       {
+                           int v;
+                           while (ch.pop(v))
+                           {
+                               sum += v;
+                           } });
+    producer.schedule([&ch, count]()
+                      {
+                          for (int i = 0; i < count; ++i)
+                          {
+                              ch.push(i);
+                          }
+                          ch.close(); });
+    producer.stop();
+    if (other)
+    {
+        other->stop();
+    }
+    uint64_t used = GetCurrentUS() - start;
+    std::cout << name << ": " << count << " messages in " << used / 1000 << " ms, "
+              << (used ? (uint64_t)count * 1000000 / used : 0) << " msg/s"
+              << (sum == (uint64_t)count * (count - 1) / 2 ? "" : " WRONG SUM") << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+    int count = argc > 1 ? atoi(argv[1]) : 1000000;
+    LOG_NAME("system")->setLevel(LogLevel::WARN);
+    bench("same thread, capacity 64", 64, false, count);
+    bench("same thread, unbounded", 0, false, count);
+    bench("cross thread, capacity 64", 64, true, count);
+    bench("cross thread, unbounded", 0, true, count);
+    return 0;
+}
@@ -0,0 +1,76 @@
+#include "config.h"
+#include "thread.h"
+#include "util.h"
+
+#include <unistd.h>
+
+using namespace sylar;
+
+static ConfigVar<int>::ptr g_int = Config::Lookup("bench.int", (int)1, "bench int");
+static ConfigVar<std::vector<int>>::ptr g_vec = Config::Lookup("bench.vec", std::vector<int>(1024, 1), "bench vec");
+
+// readers hammer the values while one thread keeps reloading them.
+// reports reads per second for scalar copies, container copies and container handles
+static void bench(const std::string &name, int threads, int ms, std::function<uint64_t()> read)
+{
+    std::atomic<bool> stop{false};
+    std::atomic<uint64_t> reads{0};
+    std::atomic<uint64_t> reloads{0};
+    std::vector<Thread::ptr> thrs;
+    for (int i = 0; i < threads; ++i)
+    {
+        thrs.push_back(Thread::ptr(new Thread([&]()
+                                              {
+                                                  uint64_t n = 0;
+                                                  uint64_t sum = 0;
+                                                  while (!stop.load(std::memory_order_relaxed))
+                                                  {
+                                                      sum += read();
+                                                      ++n;
+                                                  }
+                                                  reads += n;
+                                                  // keep the reads alive
+                                                  if (sum == 42)
+                                                  {
+                                                      std::cout << sum << std::endl;
+                                                  } },
+                                              "reader_" + std::to_string(i))));
+    }
+    Thread::ptr writer(new Thread([&]()
+                                  {
+                                      for (int i = 0; !stop.load(std::memory_order_relaxed); ++i)
+                                      {
+                                          g_int->setValue(i);
+                                          g_vec->setValue(std::vector<int>(1024, i));
+                                          ++reloads;
+                                          usleep(1000);
+                                      } },
+                                  "writer"));
+
+    uint64_t start = GetCurrentUS();
+    usleep(ms * 1000);
+    stop = true;
+    for (auto &t : thrs)
+    {
+        t->join();
+    }
+    writer->join();
+    uint64_t used = GetCurrentUS() - start;
+    std::cout << name << " " << threads << " readers: " << reads << " reads, "
+              << (used ? reads * 1000000ull / used : 0) << " reads/s, " << reloads << " reloads" << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+    int ms = argc > 1 ? atoi(argv[1]) : 1000;
+    for (int threads = 1; threads <= 8; threads *= 2)
+    {
+        bench("int getValue", threads, ms, []()
+              { return (uint64_t)g_int->getValue(); });
+        bench("vec getValue", threads, ms, []()
+              { return (uint64_t)g_vec->getValue().size(); });
+        bench("vec read    ", threads, ms, []()
+              { return (uint64_t)g_vec->read()->size(); });
+    }
+    return 0;
+}
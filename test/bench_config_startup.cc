@@ -0,0 +1,85 @@
+#include "config.h"
+#include "util.h"
+
+using namespace sylar;
+
+// registers ~10k config vars the way modules do at static init, then times
+// typed lookups, a yaml load that touches most of them and incremental reloads
+int main(int argc, char **argv)
+{
+    int count = argc > 1 ? atoi(argv[1]) : 10000;
+    std::vector<std::string> names;
+    for (int i = 0; i < count; ++i)
+    {
+        names.push_back("service" + std::to_string(i % 50) + ".module" + std::to_string(i / 50 % 20) + ".key" + std::to_string(i));
+    }
+
+    uint64_t start = GetCurrentUS();
+    for (int i = 0; i < count; ++i)
+    {
+        switch (i % 3)
+        {
+        case 0:
+            Config::Lookup(names[i], (int)i, "int var");
+            break;
+        case 1:
+            Config::Lookup(names[i], std::string("value"), "string var");
+            break;
+        default:
+            Config::Lookup(names[i], std::vector<int>{1, 2, 3}, "vector var");
+            break;
+        }
+    }
+    uint64_t used = GetCurrentUS() - start;
+    std::cout << "register " << count << " vars: " << used / 1000 << " ms, " << (count ? used * 1000 / count : 0) << " ns/var" << std::endl;
+
+    size_t found = 0;
+    start = GetCurrentUS();
+    for (int round = 0; round < 10; ++round)
+    {
+        for (int i = 0; i < count; i += 3)
+        {
+            found += !!Config::Lookup<int>(names[i]);
+        }
+        for (int i = 1; i < count; i += 3)
+        {
+            // wrong type, must miss
+            found += !!Config::Lookup<int>(names[i]);
+        }
+    }
+    used = GetCurrentUS() - start;
+    uint64_t lookups = (uint64_t)count * 10 * 2 / 3;
+    std::cout << "typed lookup: " << lookups << " in " << used / 1000 << " ms, " << (lookups ? used * 1000 / lookups : 0)
+              << " ns/lookup, " << found << " hits" << std::endl;
+
+    YAML::Node root;
+    for (int i = 0; i < count; i += 3)
+    {
+        root["service" + std::to_string(i % 50)]["module" + std::to_string(i / 50 % 20)]["key" + std::to_string(i)] = i + 1;
+    }
+    for (int i = 2; i < count; i += 3)
+    {
+        YAML::Node seq;
+        seq.push_back(i);
+        seq.push_back(i + 1);
+        root["service" + std::to_string(i % 50)]["module" + std::to_string(i / 50 % 20)]["key" + std::to_string(i)] = seq;
+    }
+    start = GetCurrentUS();
+    size_t applied = Config::LoadFromYaml(root);
+    used = GetCurrentUS() - start;
+    std::cout << "load yaml: " << applied << " vars applied in " << used / 1000 << " ms" << std::endl;
+
+    // a reload of the same file only hashes it
+    start = GetCurrentUS();
+    applied = Config::LoadFromYaml(root);
+    used = GetCurrentUS() - start;
+    std::cout << "reload unchanged yaml: " << applied << " vars applied in " << used / 1000 << " ms" << std::endl;
+
+    root["service0"]["module0"]["key0"] = -1;
+    start = GetCurrentUS();
+    applied = Config::LoadFromYaml(root);
+    used = GetCurrentUS() - start;
+    std::cout << "reload with one key changed: " << applied << " vars applied in " << used / 1000 << " ms, key0="
+              << Config::Lookup<int>(names[0])->getValue() << std::endl;
+    return 0;
+}
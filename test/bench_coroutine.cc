@@ -0,0 +1,115 @@
+#include <fstream>
+#include <iostream>
+#include <unistd.h>
+#include "config.h"
+#include "coroutine.h"
+#include "iomanager.h"
+#include "log.h"
+#include "util.h"
+
+using namespace sylar;
+
+static uint64_t rss_bytes()
+{
+    std::ifstream in("/proc/self/statm");
+    uint64_t size = 0, resident = 0;
+    in >> size >> resident;
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+static Task<void> park_task(Channel<int> &ch)
+{
+    int v;
+    co_await CoPop(ch, v);
+}
+
+// spawns count tasks parked on an unbuffered channel, measures rss once every one of
+// them is parked (the measuring task is queued behind them), then releases them
+static uint64_t parked_bytes(int count, Channel<int> &ch, std::function<void()> spawn)
+{
+    uint64_t base = 0, parked = 0;
+    IOManager iom(1, false, "memory");
+    iom.schedule([&]()
+                 {
+                     base = rss_bytes();
+                     for (int i = 0; i < count; ++i)
+                     {
+                         spawn();
+                     }
+                     IOManager::GetThis()->schedule([&]()
+                                                    {
+                                                        parked = rss_bytes();
+                                                        for (int i = 0; i < count; ++i)
+                                                        {
+                                                            ch.push(i);
+                                                        } }); });
+    iom.stop();
+    return (parked - base) / count;
+}
+
+// memory held by a suspended task, coroutines vs fibers
+static void bench_memory(int count, uint32_t stack_size)
+{
+    Channel<int> ch(0);
+    uint64_t co = parked_bytes(count, ch, [&ch]()
+                               { CoSpawn(park_task(ch)); });
+    std::cout << "coroutine: " << count << " parked, rss " << co << " bytes/task" << std::endl;
+
+    Channel<int> ch2(0);
+    uint64_t fiber = parked_bytes(count, ch2, [&ch2]()
+                                  { IOManager::GetThis()->schedule([&ch2]()
+                                                                   {
+                                                                       int v;
+                                                                       ch2.pop(v); }); });
+    std::cout << "fiber:     " << count << " parked, rss " << fiber << " bytes/task, "
+              << stack_size << " bytes stack reserved/task" << std::endl;
+}
+
+static Task<void> yield_task(int count)
+{
+    for (int i = 0; i < count; ++i)
+    {
+        co_await Yield();
+    }
+}
+
+// cost of one suspend + resume through the scheduler queue
+static void bench_resume(int count)
+{
+    uint64_t start = 0, used = 0;
+    {
+        IOManager iom(1, false, "resume");
+        iom.schedule([&]()
+                     {
+                         start = GetCurrentUS();
+                         CoSpawn(yield_task(count)).get();
+                         used = GetCurrentUS() - start; });
+        iom.stop();
+    }
+    std::cout << "coroutine resume: " << (used ? used * 1000 / count : 0) << " ns" << std::endl;
+
+    {
+        IOManager iom(1, false, "resume");
+        iom.schedule([&]()
+                     {
+                         start = GetCurrentUS();
+                         for (int i = 0; i < count; ++i)
+                         {
+                             Fiber::YieldToReady();
+                         }
+                         used = GetCurrentUS() - start; });
+        iom.stop();
+    }
+    std::cout << "fiber resume:     " << (used ? used * 1000 / count : 0) << " ns" << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+    int count = argc > 1 ? atoi(argv[1]) : 10000;
+    uint32_t stack_size = argc > 2 ? atoi(argv[2]) : 128 * 1024;
+    LOG_NAME("system")->setLevel(LogLevel::WARN);
+    Config::Lookup<uint32_t>("fiber.stack_size")->setValue(stack_size);
+    bench_memory(count, stack_size);
+    bench_resume(count * 100);
+    return 0;
+}
@@ -0,0 +1,88 @@
+#include "fiber_sync.h"
+#include "scheduler.h"
+#include "log.h"
+#include "util.h"
+
+using namespace sylar;
+
+// refcount operations this thread made so far, 0 unless built with -DSYLAR_REF_STATS=ON
+static uint64_t ref_ops()
+{
+#ifdef SYLAR_REF_STATS
+    return t_ref_ops;
+#else
+    return 0;
+#endif
+}
+
+static void report(const char *name, int count, uint64_t used_us, uint64_t ops)
+{
+    std::cout << name << ": " << count << " switches in " << used_us / 1000 << " ms, "
+              << (count ? used_us * 1000 / count : 0) << " ns/switch";
+#ifdef SYLAR_REF_STATS
+    std::cout << ", " << (double)ops / count << " refcount ops/switch";
+#endif
+    std::cout << std::endl;
+}
+
+// one fiber yields count times on a single worker: swap out, requeue, take, swap in
+static void bench_yield(int count)
+{
+    Scheduler sc(1, false, "yield");
+    sc.start();
+    uint64_t used = 0;
+    uint64_t ops = 0;
+    sc.schedule([count, &used, &ops]()
+                {
+                    uint64_t ops0 = ref_ops();
+                    uint64_t start = GetCurrentUS();
+                    for (int i = 0; i < count; ++i)
+                    {
+                        Fiber::YieldToReady();
+                    }
+                    used = GetCurrentUS() - start;
+                    ops = ref_ops() - ops0; });
+    sc.stop();
+    report("yield to ready", count, used, ops);
+}
+
+// two fibers on one worker hand a token back and forth through FiberSemaphores:
+// every round parks one fiber and schedules the other
+static void bench_pingpong(int count)
+{
+    Scheduler sc(1, false, "pingpong");
+    sc.start();
+    FiberSemaphore ping;
+    FiberSemaphore pong;
+    uint64_t used = 0;
+    uint64_t ops = 0;
+    sc.schedule([&ping, &pong, count]()
+                {
+                    for (int i = 0; i < count; ++i)
+                    {
+                        ping.wait();
+                        pong.notify();
+                    } });
+    sc.schedule([&ping, &pong, count, &used, &ops]()
+                {
+                    uint64_t ops0 = ref_ops();
+                    uint64_t start = GetCurrentUS();
+                    for (int i = 0; i < count; ++i)
+                    {
+                        ping.notify();
+                        pong.wait();
+                    }
+                    used = GetCurrentUS() - start;
+                    ops = ref_ops() - ops0; });
+    sc.stop();
+    report("semaphore ping-pong", count * 2, used, ops);
+}
+
+int main(int argc, char **argv)
+{
+    int count = argc > 1 ? atoi(argv[1]) : 1000000;
+    LOG_NAME("system")->setLevel(LogLevel::WARN);
+    bench_yield(count);
+    bench_pingpong(count);
+    return 0;
+}
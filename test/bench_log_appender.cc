@@ -0,0 +1,50 @@
+#include "log.h"
+#include "thread.h"
+#include "util.h"
+
+#include <unistd.h>
+
+using namespace sylar;
+
+// several threads log through one appender, reports lines per second and output size
+static void bench(const std::string &name, LogAppender::ptr appender, int threads, int count)
+{
+    Logger::ptr logger(new Logger("bench"));
+    logger->addAppender(appender);
+
+    std::vector<Thread::ptr> thrs;
+    uint64_t start = GetCurrentUS();
+    for (int i = 0; i < threads; ++i)
+    {
+        thrs.push_back(Thread::ptr(new Thread([logger, count]()
+                                              {
+                                                  for (int j = 0; j < count; ++j)
+                                                  {
+                                                      LOG_INFO(logger) << "appender benchmark line " << j;
+                                                  } },
+                                              "bench_" + std::to_string(i))));
+    }
+    for (auto &t : thrs)
+    {
+        t->join();
+    }
+    uint64_t used = GetCurrentUS() - start;
+    uint64_t total = (uint64_t)threads * count;
+    std::cout << name << " " << threads << " threads: " << total << " lines in " << used / 1000 << " ms, "
+              << (used ? total * 1000000ull / used : 0) << " lines/s" << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+    int count = argc > 1 ? atoi(argv[1]) : 200000;
+    for (int threads = 1; threads <= 8; threads *= 2)
+    {
+        unlink("./bench_file.log");
+        unlink("./bench_mmap.log");
+        bench("file", LogAppender::ptr(new FileLogAppender("./bench_file.log")), threads, count);
+        bench("mmap", LogAppender::ptr(new MmapFileLogAppender("./bench_mmap.log")), threads, count);
+    }
+    unlink("./bench_file.log");
+    unlink("./bench_mmap.log");
+    return 0;
+}
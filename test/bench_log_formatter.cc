@@ -0,0 +1,42 @@
+#include "log.h"
+#include "log_static.h"
+#include "util.h"
+
+using namespace sylar;
+
+LOG_STATIC_PATTERN(s_full, "%d%T%t%T%N%T%F%T[%p]%T[%c]%T%f:%l%T%m%n");
+LOG_STATIC_PATTERN(s_millis, "%d{%Y-%m-%d %H:%M:%S.%L}%T[%p]%T%m%n");
+LOG_STATIC_PATTERN(s_micros, "%d{%H:%M:%S.%f}%T[%p]%T%m%n");
+LOG_STATIC_PATTERN(s_short, "[%p]%T%m%n");
+
+// formats the same event repeatedly and reports lines per second for each pattern
+static void bench(const std::string &name, LogFormatter::ptr fmt, int count)
+{
+    Logger::ptr logger(new Logger("bench"));
+    LogEvent::ptr event(new LogEvent(logger, LogLevel::INFO, __FILE__, __LINE__, 0, GetThreadId(),
+                                     Thread::GetName(), GetFiberId(), GetCurrentUS(), ""));
+    event->getSS() << "formatter benchmark message";
+
+    size_t bytes = 0;
+    uint64_t start = GetCurrentUS();
+    for (int i = 0; i < count; ++i)
+    {
+        bytes += fmt->format(logger.get(), LogLevel::INFO, event).size();
+    }
+    uint64_t used = GetCurrentUS() - start;
+    std::cout << name << " " << fmt->getPattern() << std::endl
+              << "    " << count << " lines in " << used / 1000 << " ms, "
+              << (used ? count * 1000000ull / used : 0) << " lines/s, "
+              << (count ? used * 1000 / count : 0) << " ns/line, " << bytes << " bytes" << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+    int count = argc > 1 ? atoi(argv[1]) : 1000000;
+    for (const char *pattern : {s_full, s_millis, s_micros, s_short})
+    {
+        bench("runtime", LogFormatter::ptr(new LogFormatter(pattern)), count);
+        bench("static ", LogFormatter::Create(pattern), count);
+    }
+    return 0;
+}
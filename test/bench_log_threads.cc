@@ -0,0 +1,63 @@
+#include "log.h"
+#include "thread.h"
+#include "util.h"
+
+using namespace sylar;
+
+// swallows every event, so only the logger dispatch path is measured
+class NullLogAppender : public LogAppender
+{
+public:
+    void log(Logger *logger, LogLevel::Level level, const LogEvent::ptr &event) override
+    {
+        if (level >= m_level)
+        {
+            ++m_count;
+        }
+    }
+
+    std::string toYamlString() override { return ""; }
+
+private:
+    std::atomic<uint64_t> m_count{0};
+};
+
+// every thread hammers the same logger, half the calls are filtered out by level.
+// reports events per second for each thread count
+static void bench(Logger::ptr logger, int threads, int count)
+{
+    std::vector<Thread::ptr> thrs;
+    uint64_t start = GetCurrentUS();
+    for (int i = 0; i < threads; ++i)
+    {
+        thrs.push_back(Thread::ptr(new Thread([logger, count]()
+                                              {
+                                                  for (int j = 0; j < count; ++j)
+                                                  {
+                                                      LOG_INFO(logger) << j;
+                                                      LOG_DEBUG(logger) << j;
+                                                  } },
+                                              "bench_" + std::to_string(i))));
+    }
+    for (auto &t : thrs)
+    {
+        t->join();
+    }
+    uint64_t used = GetCurrentUS() - start;
+    uint64_t total = (uint64_t)threads * count * 2;
+    std::cout << threads << " threads: " << total << " calls in " << used / 1000 << " ms, "
+              << (used ? total * 1000000ull / used : 0) << " calls/s" << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+    int count = argc > 1 ? atoi(argv[1]) : 200000;
+    Logger::ptr logger(new Logger("bench"));
+    logger->setLevel(LogLevel::INFO);
+    logger->addAppender(LogAppender::ptr(new NullLogAppender));
+    for (int threads = 1; threads <= 32; threads *= 2)
+    {
+        bench(logger, threads, count);
+    }
+    return 0;
+}
@@ -0,0 +1,83 @@
+#include "mutex.h"
+#include "thread.h"
+#include "util.h"
+#include <iostream>
+
+using namespace sylar;
+
+// every thread increments one shared counter under the lock, the critical section
+// is a few cache misses long like the scheduler's queue push/pop
+template <class MutexType>
+static void bench(const char *name, int threads, int count)
+{
+    MutexType mutex;
+    uint64_t counter = 0;
+    uint64_t slots[8] = {0};
+    std::vector<Thread::ptr> thrs;
+    uint64_t start = GetCurrentUS();
+    for (int i = 0; i < threads; ++i)
+    {
+        thrs.push_back(Thread::ptr(new Thread([&mutex, &counter, &slots, count]()
+                                              {
+                                                  for (int j = 0; j < count; ++j)
+                                                  {
+                                                      typename MutexType::Lock lock(mutex);
+                                                      ++counter;
+                                                      ++slots[counter & 7];
+                                                  } },
+                                              "bench_" + std::to_string(i))));
+    }
+    for (auto &t : thrs)
+    {
+        t->join();
+    }
+    uint64_t used = GetCurrentUS() - start;
+    uint64_t total = (uint64_t)threads * count;
+    if (counter != total)
+    {
+        std::cout << name << " lost updates: " << counter << " != " << total << std::endl;
+    }
+    std::cout << name << " " << threads << " threads: " << total << " locks in " << used / 1000 << " ms, "
+              << (total ? used * 1000 / total : 0) << " ns/lock" << std::endl;
+}
+
+// two threads hand a token back and forth, measures the wake up path
+template <class SemaphoreType>
+static void bench_pingpong(const char *name, int count)
+{
+    SemaphoreType ping;
+    SemaphoreType pong;
+    uint64_t start = GetCurrentUS();
+    Thread::ptr thr(new Thread([&ping, &pong, count]()
+                               {
+                                   for (int i = 0; i < count; ++i)
+                                   {
+                                       ping.wait();
+                                       pong.notify();
+                                   } },
+                               "bench_pong"));
+    for (int i = 0; i < count; ++i)
+    {
+        ping.notify();
+        pong.wait();
+    }
+    thr->join();
+    uint64_t used = GetCurrentUS() - start;
+    std::cout << name << " ping-pong: " << count << " round trips in " << used / 1000 << " ms, "
+              << (count ? used * 1000 / count : 0) << " ns/round trip" << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+    int count = argc > 1 ? atoi(argv[1]) : 200000;
+    for (int threads = 1; threads <= 8; threads *= 2)
+    {
+        bench<Mutex>("Mutex", threads, count);
+        bench<SpinLock>("SpinLock", threads, count);
+        bench<CASLock>("CASLock", threads, count);
+        bench<FutexMutex>("FutexMutex", threads, count);
+    }
+    bench_pingpong<Semaphore>("Semaphore", count / 4);
+    bench_pingpong<FutexSemaphore>("FutexSemaphore", count / 4);
+    return 0;
+}
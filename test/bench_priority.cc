@@ -0,0 +1,93 @@
+#include <algorithm>
+#include <iostream>
+#include <unistd.h>
+#include "iomanager.h"
+#include "log.h"
+#include "util.h"
+
+using namespace sylar;
+
+// one worker is kept saturated by self-rescheduling NORMAL and bulk tasks that burn
+// about 50us each, while the main thread injects a probe every 2ms and measures how
+// long it waits in the queue
+struct Run
+{
+    const char *name;
+    Scheduler::Priority probe;
+    Scheduler::Priority bulk;
+    uint32_t weights[3];
+};
+
+static void burn(uint64_t us)
+{
+    uint64_t end = GetCurrentUS() + us;
+    while (GetCurrentUS() < end)
+    {
+    }
+}
+
+static void bench(const Run &run, int ms)
+{
+    IOManager iom(1, false, "priority");
+    iom.setPriorityWeights(run.weights[0], run.weights[1], run.weights[2]);
+    std::atomic<bool> stop{false};
+    std::atomic<uint64_t> done[3] = {{0}, {0}, {0}};
+    std::vector<uint64_t> latency;
+
+    std::function<void(Scheduler::Priority)> work = [&](Scheduler::Priority p)
+    {
+        burn(50);
+        ++done[p];
+        if (!stop)
+        {
+            iom.schedule([&work, p]()
+                         { work(p); },
+                         -1, p);
+        }
+    };
+    for (int i = 0; i < 32; ++i)
+    {
+        iom.schedule([&work]()
+                     { work(Scheduler::NORMAL); });
+        iom.schedule([&work, &run]()
+                     { work(run.bulk); },
+                     -1, run.bulk);
+    }
+
+    for (int i = 0; i < ms / 2; ++i)
+    {
+        uint64_t queued = GetCurrentUS();
+        iom.schedule([&latency, queued]()
+                     { latency.push_back(GetCurrentUS() - queued); },
+                     -1, run.probe);
+        usleep(2000);
+    }
+    stop = true;
+    iom.stop();
+
+    std::sort(latency.begin(), latency.end());
+    uint64_t sum = 0;
+    for (auto i : latency)
+    {
+        sum += i;
+    }
+    std::cout << run.name << ": probe avg " << (latency.empty() ? 0 : sum / latency.size())
+              << "us p99 " << (latency.empty() ? 0 : latency[latency.size() * 99 / 100])
+              << "us, normal tasks " << done[Scheduler::NORMAL] << ", bulk LOW tasks " << done[Scheduler::LOW] << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+    int ms = argc > 1 ? atoi(argv[1]) : 1000;
+    LOG_NAME("system")->setLevel(LogLevel::WARN);
+    Run runs[] = {
+        {"no priorities (all NORMAL)", Scheduler::NORMAL, Scheduler::NORMAL, {0, 0, 0}},
+        {"strict (probe HIGH, bulk LOW)", Scheduler::HIGH, Scheduler::LOW, {0, 0, 0}},
+        {"weighted 8:4:1 (probe HIGH, bulk LOW)", Scheduler::HIGH, Scheduler::LOW, {8, 4, 1}},
+    };
+    for (auto &run : runs)
+    {
+        bench(run, ms);
+    }
+    return 0;
+}
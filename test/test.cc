@@ -17,5 +17,24 @@ int main(int argc, char **argv)
 
     LOG_INFO(logger) << "Hello World";
     LOG_FMT_ERROR(logger, "Hello %s Error", "World");
+
+    // decode with: log_decode ./log.bin
+    logger->addAppender(LogAppender::ptr(new BinaryLogAppender("./log.bin")));
+    LOG_BIN_INFO(logger, "Hello %s binary id=%d ratio=%.2f", "World", 42, 0.5);
+    LOG_INFO(logger) << "text event through the binary appender";
+
+    // 3 lines per second pass, the rest are counted and summarized once the window ends
+    for (int i = 0; i < 1000; ++i)
+    {
+        LOG_WARN_PER_SEC(logger, 3) << "flapping i=" << i;
+        LOG_INFO_EVERY_N(logger, 400) << "sampled i=" << i;
+    }
+    // the sites are quiet now, the flusher thread reports what they dropped
+    sleep(2);
+
+    // structured fields, one json object per line
+    logger->addAppender(LogAppender::ptr(new JsonLogAppender));
+    logger->addAppender(LogAppender::ptr(new JsonLogAppender("", JsonLogAppender::LOGFMT)));
+    LOG_KV_WARN(logger).kv("fd", 12).kv("cost_ms", 1.5).kv("peer", "10.0.0.1:80") << "connect \"timeout\"\n";
     return 0;
 }
\ No newline at end of file
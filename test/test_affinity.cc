@@ -0,0 +1,51 @@
+#include <algorithm>
+#include <sched.h>
+#include <sstream>
+#include "iomanager.h"
+#include "log.h"
+#include "macro.h"
+#include "util.h"
+
+using namespace sylar;
+
+static Logger::ptr g_logger = LOG_ROOT();
+
+static std::string join(const std::vector<int> &v)
+{
+    std::stringstream ss;
+    for (size_t i = 0; i < v.size(); ++i)
+    {
+        ss << (i ? "," : "") << v[i];
+    }
+    return ss.str();
+}
+
+int main(int argc, char **argv)
+{
+    g_logger->setLevel(LogLevel::INFO);
+    LOG_NAME("system")->setLevel(LogLevel::WARN);
+    LOG_INFO(g_logger) << "online cpus=" << join(GetOnlineCpus())
+                       << " physical=" << join(GetPhysicalCoreCpus())
+                       << " numa nodes=" << GetNumaNodeCount();
+    LOG_INFO(g_logger) << "parse 0,2,4-6 => " << join(ParseCpuList("0,2,4-6"));
+    _ASSERT(ParseCpuList("0,2,4-6") == std::vector<int>({0, 2, 4, 5, 6}));
+    _ASSERT(ParseCpuList("3-1").empty());
+    _ASSERT(ParseCpuList("cpu0").empty());
+
+    std::vector<int> cpus = argc > 1 ? ParseCpuList(argv[1]) : GetPhysicalCoreCpus();
+    IOManager iom(4, false, "pinned");
+    // workers already running move before their next task
+    iom.setCpuAffinity(cpus);
+    for (int i = 0; i < 8; ++i)
+    {
+        iom.schedule([&cpus]()
+                     {
+                         usleep(10 * 1000);
+                         int cpu = sched_getcpu();
+                         LOG_INFO(g_logger) << Thread::GetName() << " on cpu " << cpu
+                                            << " node " << GetThreadNumaNode();
+                         _ASSERT(cpus.empty() || std::find(cpus.begin(), cpus.end(), cpu) != cpus.end()); });
+    }
+    iom.stop();
+    return 0;
+}
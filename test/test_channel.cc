@@ -0,0 +1,90 @@
+#include "channel.h"
+#include "iomanager.h"
+#include "log.h"
+#include "macro.h"
+#include "util.h"
+
+using namespace sylar;
+
+static Logger::ptr g_logger = LOG_ROOT();
+
+// producer/consumer through a small bounded channel, closed by the producer
+void test_pipeline()
+{
+    static Channel<int> ch(4);
+    static std::atomic<int> sum{0};
+    IOManager iom(2, false, "pipeline");
+    iom.schedule([]()
+                 {
+                     for (int i = 1; i <= 1000; ++i)
+                     {
+                         ch.push(i);
+                     }
+                     ch.close(); });
+    for (int i = 0; i < 3; ++i)
+    {
+        iom.schedule([]()
+                     {
+                         int v;
+                         while (ch.pop(v))
+                         {
+                             sum += v;
+                         } });
+    }
+    iom.stop();
+    bool pushed = ch.push(1);
+    LOG_INFO(g_logger) << "pipeline sum=" << sum << " expected=500500 push after close=" << pushed;
+    _ASSERT(sum == 500500);
+    _ASSERT(!pushed);
+}
+
+// select over two channels plus a timeout
+void test_select()
+{
+    IOManager iom(1, false, "select");
+    iom.schedule([]()
+                 {
+                     Channel<int> a;
+                     Channel<std::string> b(1);
+                     IOManager::GetThis()->addTimer(20, [&b]()
+                                                    { IOManager::GetThis()->schedule([&b]()
+                                                                                     { b.push("hello"); }); });
+                     int x = 0;
+                     std::string y;
+                     ChannelSelect sel;
+                     sel.recv(a, x).recv(b, y);
+                     int i = sel.wait(1000);
+                     LOG_INFO(g_logger) << "select fired=" << i << " ok=" << sel.ok(i) << " y=" << y;
+                     _ASSERT(i == 1 && sel.ok(i) && y == "hello");
+
+                     ChannelSelect sel2;
+                     sel2.recv(a, x).recv(b, y);
+                     uint64_t start = GetCurrentMS();
+                     i = sel2.wait(50);
+                     uint64_t used = GetCurrentMS() - start;
+                     LOG_INFO(g_logger) << "select timeout fired=" << i << " after ~" << used << "ms";
+                     _ASSERT(i == ChannelWaiter::TIMEOUT && used >= 40);
+
+                     ChannelSelect sel3;
+                     sel3.send(b, std::string("to b")).recv(a, x);
+                     i = sel3.wait();
+                     b.pop(y);
+                     LOG_INFO(g_logger) << "select send fired=" << i << " b=" << y;
+                     _ASSERT(i == 0 && y == "to b");
+
+                     start = GetCurrentMS();
+                     bool ok = a.pop(x, 30);
+                     used = GetCurrentMS() - start;
+                     LOG_INFO(g_logger) << "pop timeout ok=" << ok << " after ~" << used << "ms";
+                     _ASSERT(!ok && used >= 20); });
+    iom.stop();
+}
+
+int main(int argc, char **argv)
+{
+    g_logger->setLevel(LogLevel::INFO);
+    LOG_NAME("system")->setLevel(LogLevel::WARN);
+    test_pipeline();
+    test_select();
+    return 0;
+}
@@ -0,0 +1,114 @@
+#include "config.h"
+#include "config_watcher.h"
+#include "iomanager.h"
+#include "log.h"
+#include "macro.h"
+
+#include <fstream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace sylar;
+
+static Logger::ptr g_logger = LOG_ROOT();
+
+static ConfigVar<int>::ptr g_port = Config::Lookup("watch.port", (int)8080, "watched port");
+static ConfigVar<std::vector<int>>::ptr g_list = Config::Lookup("watch.list", std::vector<int>{1}, "watched list");
+
+// "250ms" -> 250, a custom FromStr takes the string path of fromYaml
+struct MsFromStr
+{
+    int operator()(const std::string &str) { return std::stoi(str); }
+};
+static ConfigVar<int, MsFromStr>::ptr g_timeout = Config::Lookup<int, MsFromStr>("watch.timeout", 100, "timeout in ms");
+
+static void write_file(const std::string &path, const std::string &content)
+{
+    // write aside and rename, like most editors
+    std::ofstream ofs(path + ".tmp");
+    ofs << content;
+    ofs.close();
+    rename((path + ".tmp").c_str(), path.c_str());
+}
+
+void test_watcher()
+{
+    std::string dir = "/tmp/test_config_watcher";
+    mkdir(dir.c_str(), 0755);
+    write_file(dir + "/app.yml", "watch:\n  port: 9000\n  list: [1, 2]\n");
+
+    ConfigWatcher::ptr watcher(new ConfigWatcher(IOManager::GetThis(), nullptr, 100));
+    watcher->addPath(dir);
+    watcher->start();
+    LOG_INFO(g_logger) << "initial port=" << g_port->getValue() << " list size=" << g_list->getValue().size();
+
+    static int s_port_changes = 0;
+    g_port->addListener([](const int &old_value, const int &new_value)
+                        {
+                            ++s_port_changes;
+                            LOG_INFO(g_logger) << "port changed " << old_value << " -> " << new_value; });
+    g_list->addListener([](const std::vector<int> &old_value, const std::vector<int> &new_value)
+                        { LOG_INFO(g_logger) << "list size changed to " << new_value.size(); });
+
+    // a one shot listener removes itself from inside the callback
+    static uint64_t s_once_key = 0;
+    static int s_once_calls = 0;
+    s_once_key = g_port->addListener([](const int &old_value, const int &new_value)
+                                     {
+                                         ++s_once_calls;
+                                         g_port->delListener(s_once_key); });
+
+    // only port changes, the list listener must stay quiet
+    write_file(dir + "/app.yml", "watch:\n  port: 9001\n  list: [1, 2]\n");
+    sleep(1);
+    LOG_INFO(g_logger) << "after edit port=" << g_port->getValue();
+    _ASSERT(g_port->getValue() == 9001 && s_port_changes == 1);
+    _ASSERT(s_once_calls == 1 && !g_port->getListener(s_once_key));
+
+    // a later file overrides the port, editing an unrelated key of the earlier file
+    // must not flip the port back and forth
+    write_file(dir + "/override.yml", "watch:\n  port: 9100\n");
+    sleep(1);
+    _ASSERT(g_port->getValue() == 9100 && s_port_changes == 2);
+    write_file(dir + "/app.yml", "watch:\n  port: 9001\n  list: [1, 2, 3]\n");
+    sleep(1);
+    LOG_INFO(g_logger) << "after unrelated edit port=" << g_port->getValue() << " list size=" << g_list->getValue().size();
+    _ASSERT(g_port->getValue() == 9100 && s_port_changes == 2 && g_list->getValue().size() == 3);
+
+    // a value that does not convert keeps the old one
+    write_file(dir + "/override.yml", "watch:\n  port: abc\n");
+    sleep(1);
+    _ASSERT(g_port->getValue() == 9100);
+
+    // broken yaml keeps the old values
+    write_file(dir + "/override.yml", "watch:\n  port: [9002\n");
+    sleep(1);
+    LOG_INFO(g_logger) << "after broken edit port=" << g_port->getValue();
+    _ASSERT(g_port->getValue() == 9100);
+
+    watcher->stop();
+    unlink((dir + "/app.yml").c_str());
+    unlink((dir + "/override.yml").c_str());
+    rmdir(dir.c_str());
+}
+
+// applied once and counted, then skipped as unchanged like any other var
+void test_custom_from_str()
+{
+    static int changes = 0;
+    g_timeout->addListener([](const int &old_value, const int &new_value)
+                           { ++changes; });
+    YAML::Node root = YAML::Load("watch:\n  timeout: 250ms\n");
+    size_t first = Config::LoadFromYaml(root);
+    size_t second = Config::LoadFromYaml(root);
+    LOG_INFO(g_logger) << "custom FromStr applied " << first << " then " << second << ", timeout=" << g_timeout->getValue();
+    _ASSERT(first == 1 && second == 0 && g_timeout->getValue() == 250 && changes == 1);
+}
+
+int main(int argc, char **argv)
+{
+    test_custom_from_str();
+    IOManager iom(2, true, "watcher");
+    iom.schedule(test_watcher);
+    return 0;
+}
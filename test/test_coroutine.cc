@@ -0,0 +1,103 @@
+#include "coroutine.h"
+#include "iomanager.h"
+#include "hook.h"
+#include "log.h"
+#include "util.h"
+
+using namespace sylar;
+
+static Logger::ptr g_logger = LOG_ROOT();
+
+Task<int> add(int a, int b)
+{
+    co_await Yield();
+    co_return a + b;
+}
+
+Task<void> fail()
+{
+    co_await Yield();
+    throw std::runtime_error("task failed");
+}
+
+// nested tasks, a timer, fd readiness and a Future from a fiber
+Task<int> coroutine_main(int fd)
+{
+    int v = co_await add(1, 2);
+    LOG_INFO(g_logger) << "nested task=" << v;
+
+    uint64_t start = GetCurrentMS();
+    co_await Sleep{50};
+    LOG_INFO(g_logger) << "slept " << GetCurrentMS() - start << "ms (50ms)";
+
+    bool ok = co_await WaitEvent{fd, IOManager::READ};
+    char buf[16] = {0};
+    ssize_t n = read(fd, buf, sizeof(buf) - 1);
+    LOG_INFO(g_logger) << "readable ok=" << ok << " read=" << std::string(buf, n > 0 ? n : 0);
+
+    int fiber_result = co_await Async([]()
+                                      {
+                                          // a fiber may block through the hooks
+                                          usleep(20 * 1000);
+                                          return 40; });
+    LOG_INFO(g_logger) << "future from fiber=" << fiber_result;
+
+    try
+    {
+        co_await fail();
+    }
+    catch (const std::exception &e)
+    {
+        LOG_INFO(g_logger) << "task exception: " << e.what();
+    }
+    co_return v + fiber_result;
+}
+
+// a coroutine consumes what a fiber produces and answers on a second channel
+Task<int> consumer(Channel<int> &in, Channel<int> &out)
+{
+    int sum = 0;
+    int v;
+    while (co_await CoPop(in, v))
+    {
+        sum += v;
+        co_await CoPush(out, sum);
+    }
+    out.close();
+    co_return sum;
+}
+
+void test_interop()
+{
+    int fds[2];
+    pipe(fds);
+    Future<int> main_result = CoSpawn(coroutine_main(fds[0]));
+    IOManager::GetThis()->addTimer(100, [fds]()
+                                   { write(fds[1], "ping", 4); });
+    // a fiber waits on a coroutine
+    LOG_INFO(g_logger) << "coroutine result=" << main_result.get() << " (43)";
+    close(fds[0]);
+    close(fds[1]);
+
+    Channel<int> in(1);
+    Channel<int> out(1);
+    Future<int> total = CoSpawn(consumer(in, out));
+    int last = 0;
+    for (int i = 1; i <= 100; ++i)
+    {
+        in.push(i);
+        out.pop(last);
+    }
+    in.close();
+    LOG_INFO(g_logger) << "channel sum=" << total.get() << " last=" << last << " (5050)";
+}
+
+int main(int argc, char **argv)
+{
+    g_logger->setLevel(LogLevel::INFO);
+    LOG_NAME("system")->setLevel(LogLevel::WARN);
+    IOManager iom(2, false, "coroutine");
+    iom.schedule(test_interop);
+    iom.stop();
+    return 0;
+}
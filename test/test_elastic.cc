@@ -0,0 +1,125 @@
+#include <dirent.h>
+#include "config.h"
+#include "iomanager.h"
+#include "log.h"
+#include "macro.h"
+#include "util.h"
+
+using namespace sylar;
+
+static Logger::ptr g_logger = LOG_ROOT();
+
+static ConfigVar<uint32_t>::ptr g_workers = Config::Lookup<uint32_t>("test.workers", 1, "worker count");
+
+// threads of this process, workers plus main
+static int live_threads()
+{
+    int n = 0;
+    DIR *dir = opendir("/proc/self/task");
+    while (dirent *ent = readdir(dir))
+    {
+        n += ent->d_name[0] != '.';
+    }
+    closedir(dir);
+    return n;
+}
+
+// virtual memory of this process in MB, an exited but never joined thread keeps its stack
+static uint64_t vm_size_mb()
+{
+    uint64_t pages = 0;
+    FILE *f = fopen("/proc/self/statm", "r");
+    if (f)
+    {
+        fscanf(f, "%lu", &pages);
+        fclose(f);
+    }
+    return pages * sysconf(_SC_PAGESIZE) >> 20;
+}
+
+static void burn(uint64_t ms)
+{
+    uint64_t end = GetCurrentMS() + ms;
+    while (GetCurrentMS() < end)
+    {
+    }
+}
+
+int main(int argc, char **argv)
+{
+    g_logger->setLevel(LogLevel::INFO);
+    LOG_NAME("system")->setLevel(LogLevel::WARN);
+    IOManager iom(1, false, "elastic");
+    // a config change resizes the pool
+    g_workers->addListener([&iom](const uint32_t &old_value, const uint32_t &new_value)
+                           { iom.setThreadCount(new_value); });
+
+    g_workers->setValue(4);
+    LOG_INFO(g_logger) << "grown: count=" << iom.getThreadCount() << " threads=" << live_threads();
+
+    g_workers->setValue(1);
+    usleep(100 * 1000);
+    LOG_INFO(g_logger) << "shrunk: count=" << iom.getThreadCount() << " threads=" << live_threads() << " (2 once retired)";
+
+    _ASSERT(iom.getThreadCount() == 1 && live_threads() == 2);
+
+    // grow and shrink many times, the retired workers are joined along the way
+    uint64_t vm_before = vm_size_mb();
+    for (int i = 0; i < 50; ++i)
+    {
+        iom.setThreadCount(4);
+        iom.setThreadCount(1);
+        usleep(5 * 1000);
+    }
+    iom.setThreadCount(1);
+    uint64_t vm_after = vm_size_mb();
+    LOG_INFO(g_logger) << "50 resizes: vm " << vm_before << "MB -> " << vm_after << "MB, threads=" << live_threads();
+    _ASSERT(vm_after < vm_before + 256);
+
+    // a task pinned to a worker that has retired runs on another one
+    static std::atomic<int> second_id{-1};
+    iom.setThreadCount(2);
+    while (second_id == -1)
+    {
+        iom.schedule([]()
+                     {
+                         if (Thread::GetName() == "elastic_1")
+                         {
+                             second_id = GetThreadId();
+                         } });
+        usleep(1000);
+    }
+    iom.setThreadCount(1);
+    usleep(100 * 1000);
+    static std::atomic<bool> pinned_ran{false};
+    iom.schedule([]()
+                 { pinned_ran = true; },
+                 second_id);
+    usleep(100 * 1000);
+    LOG_INFO(g_logger) << "task pinned to retired worker ran=" << pinned_ran;
+    _ASSERT(pinned_ran);
+
+    iom.setAutoScale(1, 4);
+    for (int i = 0; i < 200; ++i)
+    {
+        iom.schedule([]()
+                     { burn(10); });
+    }
+    uint64_t start = GetCurrentMS();
+    size_t peak = 1;
+    // one worker less per second or two of idling, back to min well within 15s
+    while (GetCurrentMS() - start < 15000)
+    {
+        peak = std::max(peak, iom.getThreadCount());
+        if (peak > 1 && iom.getThreadCount() == 1)
+        {
+            break;
+        }
+        usleep(50 * 1000);
+    }
+    LOG_INFO(g_logger) << "autoscale peak=" << peak << " after idle count=" << iom.getThreadCount();
+    _ASSERT(peak > 1);
+    _ASSERT(iom.getThreadCount() == 1);
+    iom.stop();
+    return 0;
+}
@@ -0,0 +1,93 @@
+#include <mutex>
+#include <unordered_map>
+#include "fiber_local.h"
+#include "iomanager.h"
+#include "log.h"
+#include "macro.h"
+#include "util.h"
+
+using namespace sylar;
+
+static Logger::ptr g_logger = LOG_ROOT();
+
+// request context a handler wants to reach without passing it down
+struct RequestContext
+{
+    static std::atomic<int> s_alive;
+    uint64_t request_id = 0;
+    std::string user;
+
+    RequestContext() { ++s_alive; }
+    ~RequestContext() { --s_alive; }
+};
+
+std::atomic<int> RequestContext::s_alive{0};
+
+static FiberLocal<RequestContext> g_context;
+static FiberLocal<int> g_counter;
+
+void handle(uint64_t id)
+{
+    g_context->request_id = id;
+    g_context->user = "user" + std::to_string(id);
+    // other fibers run in between and set their own context
+    Fiber::YieldToReady();
+    usleep(1000);
+    _ASSERT(g_context->request_id == id && g_context->user == "user" + std::to_string(id));
+}
+
+// the old way: a global map from fiber id under a mutex
+static std::mutex s_mutex;
+static std::unordered_map<uint64_t, int> s_map;
+
+void bench()
+{
+    const int N = 1000000;
+    uint64_t start = GetCurrentUS();
+    for (int i = 0; i < N; ++i)
+    {
+        ++*g_counter;
+    }
+    uint64_t local = GetCurrentUS() - start;
+    start = GetCurrentUS();
+    for (int i = 0; i < N; ++i)
+    {
+        std::lock_guard<std::mutex> lock(s_mutex);
+        ++s_map[Fiber::GetFiberId()];
+    }
+    uint64_t map = GetCurrentUS() - start;
+    LOG_INFO(g_logger) << "FiberLocal " << local * 1000 / N << " ns/access, mutex+map " << map * 1000 / N
+                       << " ns/access, counter=" << *g_counter;
+}
+
+int main(int argc, char **argv)
+{
+    g_logger->setLevel(LogLevel::INFO);
+    LOG_NAME("system")->setLevel(LogLevel::WARN);
+    {
+        IOManager iom(2, false, "local");
+        for (uint64_t i = 1; i <= 100; ++i)
+        {
+            iom.schedule([i]()
+                         { handle(i); });
+        }
+        iom.schedule(bench);
+        iom.stop();
+        // the scheduler recycles callback fibers with reset(), the contexts must be gone
+        LOG_INFO(g_logger) << "contexts alive after 100 requests: " << RequestContext::s_alive;
+        _ASSERT(RequestContext::s_alive == 0);
+    }
+
+    // a plain thread uses its main fiber
+    g_context->request_id = 7;
+    Fiber::ptr fiber(new Fiber([]()
+                               {
+                                   _ASSERT(!g_context.has());
+                                   // freed when the fiber terminates
+                                   g_context->request_id = 8; },
+                               0, true));
+    fiber->call();
+    LOG_INFO(g_logger) << "main thread context id=" << g_context->request_id << " alive=" << RequestContext::s_alive;
+    _ASSERT(g_context->request_id == 7 && RequestContext::s_alive == 1);
+    return 0;
+}
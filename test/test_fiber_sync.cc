@@ -0,0 +1,162 @@
+#include "fiber_sync.h"
+#include "iomanager.h"
+#include "log.h"
+#include "macro.h"
+
+using namespace sylar;
+
+static Logger::ptr g_logger = LOG_ROOT();
+
+// fibers on 3 threads fight over one FiberMutex and yield while holding it
+void test_mutex()
+{
+    static FiberMutex mutex;
+    static int counter = 0;
+    static std::atomic<int> done{0};
+    const int fibers = 20;
+    const int loops = 200;
+
+    IOManager iom(3, false, "mutex");
+    for (int i = 0; i < fibers; ++i)
+    {
+        iom.schedule([]()
+                     {
+                         for (int j = 0; j < loops; ++j)
+                         {
+                             FiberMutex::Lock lock(mutex);
+                             int v = counter;
+                             Fiber::YieldToReady();
+                             counter = v + 1;
+                         }
+                         ++done; });
+    }
+    iom.stop();
+    LOG_INFO(g_logger) << "FiberMutex counter=" << counter << " expected=" << fibers * loops << " fibers done=" << done;
+    _ASSERT(counter == fibers * loops && done == fibers);
+}
+
+// one producer, several consumers waiting on a condition variable
+void test_cond()
+{
+    static FiberMutex mutex;
+    static FiberConditionVariable cond;
+    static std::list<int> queue;
+    static bool closed = false;
+    static std::atomic<int> sum{0};
+    const int items = 1000;
+
+    IOManager iom(2, false, "cond");
+    for (int i = 0; i < 4; ++i)
+    {
+        iom.schedule([]()
+                     {
+                         while (true)
+                         {
+                             FiberMutex::Lock lock(mutex);
+                             cond.wait(lock, []()
+                                       { return !queue.empty() || closed; });
+                             if (queue.empty())
+                             {
+                                 break;
+                             }
+                             sum += queue.front();
+                             queue.pop_front();
+                         } });
+    }
+    iom.schedule([]()
+                 {
+                     for (int i = 1; i <= items; ++i)
+                     {
+                         {
+                             FiberMutex::Lock lock(mutex);
+                             queue.push_back(i);
+                         }
+                         cond.notifyOne();
+                         if (i % 16 == 0)
+                         {
+                             Fiber::YieldToReady();
+                         }
+                     }
+                     FiberMutex::Lock lock(mutex);
+                     closed = true;
+                     cond.notifyAll(); });
+    iom.stop();
+    LOG_INFO(g_logger) << "FiberConditionVariable sum=" << sum << " expected=" << items * (items + 1) / 2;
+    _ASSERT(sum == items * (items + 1) / 2 && queue.empty());
+}
+
+// at most 2 of 10 fibers inside at once, the last notify comes from a plain thread
+void test_semaphore()
+{
+    static FiberSemaphore sem(2);
+    static std::atomic<int> inside{0};
+    static std::atomic<int> max_inside{0};
+    static FiberSemaphore finished;
+
+    IOManager iom(2, false, "sem");
+    for (int i = 0; i < 10; ++i)
+    {
+        iom.schedule([]()
+                     {
+                         sem.wait();
+                         int n = ++inside;
+                         int m = max_inside;
+                         while (n > m && !max_inside.compare_exchange_weak(m, n))
+                             ;
+                         Fiber::YieldToReady();
+                         --inside;
+                         sem.notify();
+                         finished.notify(); });
+    }
+    // the main thread is not a fiber of iom, it blocks on the semaphore instead
+    for (int i = 0; i < 10; ++i)
+    {
+        finished.wait();
+    }
+    iom.stop();
+    LOG_INFO(g_logger) << "FiberSemaphore max inside=" << max_inside << " expected<=2";
+    _ASSERT(max_inside >= 1 && max_inside <= 2 && inside == 0);
+}
+
+// a fiber woken from a semaphore or a sleep runs again at the priority it blocked at
+void test_priority_kept()
+{
+    static std::atomic<int> after_wait[Scheduler::PRIORITY_COUNT];
+    static std::atomic<int> after_sleep[Scheduler::PRIORITY_COUNT];
+    FiberSemaphore sem;
+    IOManager iom(1, false, "priority");
+    for (int p = Scheduler::HIGH; p <= Scheduler::LOW; ++p)
+    {
+        after_wait[p] = -1;
+        after_sleep[p] = -1;
+        iom.schedule([p, &sem]()
+                     {
+                         sem.wait();
+                         after_wait[p] = Fiber::GetThisRaw()->getPriority();
+                         usleep(1000);
+                         after_sleep[p] = Fiber::GetThisRaw()->getPriority(); },
+                     -1, (Scheduler::Priority)p);
+    }
+    usleep(10 * 1000);
+    for (int p = Scheduler::HIGH; p <= Scheduler::LOW; ++p)
+    {
+        sem.notify();
+    }
+    iom.stop();
+    for (int p = Scheduler::HIGH; p <= Scheduler::LOW; ++p)
+    {
+        LOG_INFO(g_logger) << "priority " << p << " after wait " << after_wait[p] << " after sleep " << after_sleep[p];
+        _ASSERT(after_wait[p] == p && after_sleep[p] == p);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    g_logger->setLevel(LogLevel::INFO);
+    LOG_NAME("system")->setLevel(LogLevel::WARN);
+    test_mutex();
+    test_cond();
+    test_semaphore();
+    test_priority_kept();
+    return 0;
+}
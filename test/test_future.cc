@@ -0,0 +1,129 @@
+#include "future.h"
+#include "iomanager.h"
+#include "hook.h"
+#include "log.h"
+#include "macro.h"
+#include "util.h"
+
+using namespace sylar;
+
+static Logger::ptr g_logger = LOG_ROOT();
+
+// pretends to be a backend call that takes ms milliseconds
+static int backend(int id, int ms)
+{
+    usleep(ms * 1000);
+    if (id < 0)
+    {
+        throw std::runtime_error("backend " + std::to_string(id) + " failed");
+    }
+    return id * 10;
+}
+
+// fan out to 5 backends, the total should be close to the slowest one
+void test_fanout()
+{
+    uint64_t start = GetCurrentMS();
+    std::vector<Future<int>> futures;
+    for (int i = 1; i <= 5; ++i)
+    {
+        futures.push_back(Async([i]()
+                                { return backend(i, 20 * i); }));
+    }
+    int sum = 0;
+    for (auto &f : futures)
+    {
+        sum += f.get();
+    }
+    uint64_t used = GetCurrentMS() - start;
+    LOG_INFO(g_logger) << "fanout sum=" << sum << " expected=150 in " << used << "ms (slowest 100ms)";
+    // run in parallel, far from the 300ms they would take one after another
+    _ASSERT(sum == 150 && used < 250);
+
+    Future<int> slow = Async([]()
+                             { return backend(1, 200); });
+    bool ready = slow.wait(50);
+    int slow_value = slow.get();
+    LOG_INFO(g_logger) << "wait(50) ready=" << ready << " then get=" << slow_value;
+    _ASSERT(!ready && slow_value == 10);
+
+    Future<int> bad = Async([]()
+                            { return backend(-1, 1); });
+    bool thrown = false;
+    try
+    {
+        bad.get();
+    }
+    catch (const std::exception &e)
+    {
+        thrown = true;
+        LOG_INFO(g_logger) << "future exception: " << e.what();
+    }
+    _ASSERT(thrown);
+
+    Promise<void> promise;
+    Future<void> done = promise.getFuture();
+    IOManager::GetThis()->addTimer(10, [promise]()
+                                   { promise.setValue(); });
+    done.get();
+    LOG_INFO(g_logger) << "promise<void> ready=" << done.isReady();
+    _ASSERT(done.isReady());
+}
+
+// a failing task cancels its siblings and the nested group
+void test_group()
+{
+    std::atomic<int> finished{0};
+    std::atomic<int> cancelled{0};
+    uint64_t start = GetCurrentMS();
+    bool thrown = false;
+    try
+    {
+        TaskGroup group;
+        TaskGroup child(nullptr, &group);
+        group.onCancel([&cancelled]()
+                       { ++cancelled; });
+        for (int i = 0; i < 4; ++i)
+        {
+            child.spawn([&child, &finished]()
+                        {
+                            // a long job that polls for cancellation
+                            for (int j = 0; j < 100 && !child.isCancelled(); ++j)
+                            {
+                                usleep(5 * 1000);
+                            }
+                            ++finished; });
+        }
+        Future<int> ok = group.run([]()
+                                   { return backend(3, 5); });
+        group.spawn([]()
+                    { backend(-2, 30); });
+        child.join();
+        LOG_INFO(g_logger) << "child joined, cancelled=" << child.isCancelled() << " ok=" << ok.get();
+        _ASSERT(child.isCancelled() && ok.get() == 30);
+        group.join();
+    }
+    catch (const std::exception &e)
+    {
+        thrown = true;
+        uint64_t used = GetCurrentMS() - start;
+        LOG_INFO(g_logger) << "group exception: " << e.what() << " finished=" << finished
+                           << " cancel callbacks=" << cancelled << " in " << used << "ms (not 500ms)";
+        // the failure cancelled the nested group's polling tasks long before they ran out
+        _ASSERT(finished == 4 && cancelled == 1 && used < 400);
+    }
+    _ASSERT(thrown);
+}
+
+int main(int argc, char **argv)
+{
+    g_logger->setLevel(LogLevel::INFO);
+    LOG_NAME("system")->setLevel(LogLevel::WARN);
+    IOManager iom(2, false, "future");
+    iom.schedule([]()
+                 {
+                     test_fanout();
+                     test_group(); });
+    iom.stop();
+    return 0;
+}
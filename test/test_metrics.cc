@@ -0,0 +1,119 @@
+#include <iostream>
+#include <thread>
+#include "iomanager.h"
+#include "log.h"
+#include "macro.h"
+#include "metrics.h"
+#include "util.h"
+
+using namespace sylar;
+
+static Logger::ptr g_logger = LOG_ROOT();
+
+// cost of Counter::inc against a shared atomic, both bumped from 4 threads
+static void bench_inc()
+{
+    const int N = 10000000;
+    Counter counter("test.inc");
+    std::atomic<uint64_t> shared{0};
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        uint64_t start = GetCurrentUS();
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; ++t)
+        {
+            threads.emplace_back([&, pass]()
+                                 {
+                                     for (int i = 0; i < N; ++i)
+                                     {
+                                         if (pass == 0)
+                                         {
+                                             counter.inc();
+                                         }
+                                         else
+                                         {
+                                             shared.fetch_add(1, std::memory_order_relaxed);
+                                         }
+                                     } });
+        }
+        for (auto &t : threads)
+        {
+            t.join();
+        }
+        uint64_t used = GetCurrentUS() - start;
+        std::cout << (pass == 0 ? "Counter::inc" : "shared atomic") << ": " << used * 1000 / (4ull * N) << " ns/op, total "
+                  << (pass == 0 ? counter.value() : shared.load()) << std::endl;
+        _ASSERT((pass == 0 ? counter.value() : shared.load()) == 4ull * N);
+    }
+}
+
+// schedulers come and go while another thread keeps taking snapshots,
+// a snapshot must never call the gauge of a destroyed scheduler
+static void test_gauge_lifetime()
+{
+    std::atomic<bool> running{true};
+    std::atomic<int> snapshots{0};
+    std::thread reader([&]()
+                       {
+                           while (running)
+                           {
+                               Metrics::GetSnapshot();
+                               ++snapshots;
+                           } });
+    for (int i = 0; i < 50; ++i)
+    {
+        IOManager iom(1, false, "churn");
+        iom.schedule([]() {});
+        iom.stop();
+    }
+    running = false;
+    reader.join();
+    LOG_INFO(g_logger) << "50 IOManagers destroyed during " << snapshots << " snapshots";
+    _ASSERT(snapshots > 0);
+}
+
+int main(int argc, char **argv)
+{
+    g_logger->setLevel(LogLevel::INFO);
+    LOG_NAME("system")->setLevel(LogLevel::WARN);
+    bench_inc();
+
+    Metrics::StartDump(100);
+    {
+        IOManager iom(2, false, "metrics");
+        int fds[2];
+        pipe(fds);
+        for (int i = 0; i < 1000; ++i)
+        {
+            iom.schedule([]() {});
+        }
+        iom.addTimer(100, []() {});
+        iom.schedule([fds]()
+                     { IOManager::GetThis()->addEvent(fds[0], IOManager::READ, []() {}); });
+        usleep(50 * 1000);
+        std::map<std::string, int64_t> snapshot = Metrics::GetSnapshot();
+        LOG_INFO(g_logger) << "snapshot with a pending event and a timer:\n"
+                           << Metrics::ToString(snapshot);
+        _ASSERT(snapshot["iomanager.metrics.pending_events"] == 1);
+        _ASSERT(snapshot["iomanager.metrics.timers"] == 1);
+        _ASSERT(snapshot["scheduler.metrics.threads"] == 2);
+        _ASSERT(snapshot["scheduler.tasks"] >= 1000);
+        iom.schedule([fds]()
+                     {
+                         usleep(250 * 1000);
+                         write(fds[1], "x", 1); });
+        iom.stop();
+        close(fds[0]);
+        close(fds[1]);
+    }
+    Metrics::StopDump();
+    std::map<std::string, int64_t> snapshot = Metrics::GetSnapshot();
+    LOG_INFO(g_logger) << "after stop:\n"
+                       << Metrics::ToString(snapshot);
+    // the gauges went away with the IOManager, the counters stay
+    _ASSERT(!snapshot.count("iomanager.metrics.pending_events") && !snapshot.count("scheduler.metrics.threads"));
+    _ASSERT(snapshot["iomanager.events"] >= 1 && snapshot["timer.expired"] >= 1);
+
+    test_gauge_lifetime();
+    return 0;
+}
@@ -0,0 +1,168 @@
+#include <random>
+#include "parallel.h"
+#include "iomanager.h"
+#include "log.h"
+#include "macro.h"
+#include "fiber_sync.h"
+#include "util.h"
+
+using namespace sylar;
+
+static Logger::ptr g_logger = LOG_ROOT();
+
+// a cpu bound job per element, like hashing a block
+static uint64_t hash(uint64_t v)
+{
+    for (int i = 0; i < 64; ++i)
+    {
+        v ^= v >> 33;
+        v *= 0xff51afd7ed558ccdull;
+    }
+    return v;
+}
+
+void test_for_reduce()
+{
+    const size_t n = 1 << 20;
+    std::vector<uint64_t> out(n);
+    uint64_t start = GetCurrentMS();
+    ParallelFor(0, n, [&out](size_t i)
+                { out[i] = hash(i); });
+    uint64_t sum = ParallelReduce(
+        0, n, (uint64_t)0, [&out](size_t b, size_t e, uint64_t acc)
+        {
+            for (size_t i = b; i < e; ++i)
+            {
+                acc += out[i];
+            }
+            return acc; },
+        [](uint64_t a, uint64_t b)
+        { return a + b; });
+    uint64_t used = GetCurrentMS() - start;
+
+    uint64_t expected = 0;
+    start = GetCurrentMS();
+    for (size_t i = 0; i < n; ++i)
+    {
+        expected += hash(i);
+    }
+    LOG_INFO(g_logger) << "for+reduce " << (sum == expected ? "ok" : "WRONG") << " in " << used
+                       << "ms, serial " << GetCurrentMS() - start << "ms";
+}
+
+// an outer loop whose chunks run inner loops
+void test_nested()
+{
+    std::vector<std::vector<uint64_t>> rows(16, std::vector<uint64_t>(4096));
+    ParallelFor(0, rows.size(), [&rows](size_t r)
+                { ParallelFor(0, rows[r].size(), [&rows, r](size_t c)
+                              { rows[r][c] = r * 4096 + c; },
+                              256); },
+                1);
+    bool ok = true;
+    for (size_t r = 0; r < rows.size(); ++r)
+    {
+        for (size_t c = 0; c < rows[r].size(); ++c)
+        {
+            ok = ok && rows[r][c] == r * 4096 + c;
+        }
+    }
+    LOG_INFO(g_logger) << "nested " << (ok ? "ok" : "WRONG");
+
+    try
+    {
+        ParallelFor(0, 1000, [](size_t i)
+                    {
+                        if (i == 500)
+                        {
+                            throw std::runtime_error("chunk 500 failed");
+                        } });
+    }
+    catch (const std::exception &e)
+    {
+        LOG_INFO(g_logger) << "parallel exception: " << e.what();
+    }
+}
+
+void test_sort()
+{
+    std::mt19937_64 rng(42);
+    std::vector<uint64_t> v(1 << 20);
+    for (auto &i : v)
+    {
+        i = rng();
+    }
+    std::vector<uint64_t> copy = v;
+    uint64_t start = GetCurrentMS();
+    ParallelSort(v.begin(), v.end());
+    uint64_t used = GetCurrentMS() - start;
+    start = GetCurrentMS();
+    std::sort(copy.begin(), copy.end());
+    LOG_INFO(g_logger) << "sort " << (v == copy ? "ok" : "WRONG") << " in " << used
+                       << "ms, std::sort " << GetCurrentMS() - start << "ms";
+
+    std::vector<int> small = {5, 3, 9, 1};
+    ParallelSort(small.begin(), small.end(), std::greater<int>());
+    LOG_INFO(g_logger) << "small sort " << small[0] << small[1] << small[2] << small[3];
+}
+
+// reductions with the default grain while another fiber keeps resizing the pool
+void test_resize()
+{
+    IOManager *iom = IOManager::GetThis();
+    std::atomic<bool> running{true};
+    FiberSemaphore stopped;
+    iom->schedule([&running, &stopped, iom]()
+                  {
+                      for (int i = 0; running; ++i)
+                      {
+                          iom->setThreadCount(i % 2 ? 8 : 2);
+                          usleep(500);
+                      }
+                      stopped.notify(); });
+    bool ok = true;
+    for (int round = 0; round < 200; ++round)
+    {
+        uint64_t sum = ParallelReduce(
+            0, 10000, (uint64_t)0, [](size_t b, size_t e, uint64_t acc)
+            {
+                for (size_t i = b; i < e; ++i)
+                {
+                    acc += i;
+                }
+                return acc; },
+            [](uint64_t a, uint64_t b)
+            { return a + b; });
+        ok = ok && sum == 10000ull * 9999 / 2;
+    }
+    running = false;
+    stopped.wait();
+    iom->setThreadCount(4);
+    LOG_INFO(g_logger) << "reduce while resizing " << (ok ? "ok" : "WRONG");
+    _ASSERT(ok);
+}
+
+int main(int argc, char **argv)
+{
+    g_logger->setLevel(LogLevel::INFO);
+    LOG_NAME("system")->setLevel(LogLevel::WARN);
+    IOManager iom(4, false, "parallel");
+    iom.schedule([]()
+                 {
+                     test_for_reduce();
+                     test_nested();
+                     test_sort();
+                     test_resize(); });
+    iom.stop();
+
+    // a plain thread blocks while the workers run the chunks
+    std::vector<int> v(1000);
+    IOManager pool(2, false, "pool");
+    ParallelFor(
+        0, v.size(), [&v](size_t i)
+        { v[i] = i; },
+        0, &pool);
+    pool.stop();
+    LOG_INFO(g_logger) << "from thread v[999]=" << v[999];
+    return 0;
+}
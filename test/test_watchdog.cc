@@ -0,0 +1,97 @@
+#include "config.h"
+#include "iomanager.h"
+#include "log.h"
+#include "macro.h"
+#include "util.h"
+#include "watchdog.h"
+
+using namespace sylar;
+
+static Logger::ptr g_logger = LOG_ROOT();
+
+// keeps the watchdog reports logged to "system"
+class ReportAppender : public LogAppender
+{
+public:
+    void log(Logger *logger, LogLevel::Level level, const LogEvent::ptr &event) override
+    {
+        std::string content = event->getContent();
+        if (level >= LogLevel::WARN && content.find("without yielding") != std::string::npos)
+        {
+            MutexType::Lock lock(m_mutex);
+            m_reports.push_back(content);
+        }
+    }
+
+    std::string toYamlString() override { return ""; }
+
+    std::vector<std::string> getReports()
+    {
+        MutexType::Lock lock(m_mutex);
+        return m_reports;
+    }
+
+private:
+    std::vector<std::string> m_reports;
+};
+
+// spins without yielding, the watchdog should print this function in the backtrace
+void __attribute__((noinline)) spin_forever_ish(uint64_t ms)
+{
+    uint64_t end = GetCurrentMS() + ms;
+    while (GetCurrentMS() < end)
+    {
+    }
+}
+
+int main(int argc, char **argv)
+{
+    g_logger->setLevel(LogLevel::INFO);
+    LOG_NAME("system")->setLevel(LogLevel::WARN);
+    std::shared_ptr<ReportAppender> reports(new ReportAppender);
+    LOG_NAME("system")->addAppender(reports);
+    Config::Lookup<uint32_t>("fiber.run_budget_ms")->setValue(20);
+    Config::Lookup<bool>("fiber.watchdog")->setValue(true);
+
+    static std::atomic<uint64_t> spinner_wait{0};
+    static std::atomic<uint64_t> coop_start{0};
+    static std::atomic<uint64_t> coop_wait{0};
+    static std::atomic<int> yields{0};
+    IOManager iom(1, false, "watchdog");
+    uint64_t queued = GetCurrentMS();
+    iom.schedule([]()
+                 { spin_forever_ish(100); });
+    iom.schedule([queued]()
+                 {
+                     spinner_wait = GetCurrentMS() - queued;
+                     LOG_INFO(g_logger) << "behind the spinner, waited " << spinner_wait << "ms"; });
+
+    // the same loop made cooperative
+    iom.schedule([]()
+                 {
+                     coop_start = GetCurrentMS();
+                     uint64_t end = coop_start + 100;
+                     while (GetCurrentMS() < end)
+                     {
+                         yields += MaybeYield();
+                     }
+                     LOG_INFO(g_logger) << "cooperative loop yielded " << yields << " times (about 5)"; });
+    iom.schedule([]()
+                 {
+                     coop_wait = GetCurrentMS() - coop_start;
+                     LOG_INFO(g_logger) << "behind the cooperative loop, waited " << coop_wait << "ms (one 20ms slice)"; });
+    iom.stop();
+    Watchdog::Stop();
+
+    // the spinner holds the worker for all of its run, the cooperative loop for one slice
+    _ASSERT(spinner_wait >= 100);
+    _ASSERT(yields > 0);
+    _ASSERT(coop_wait < 100);
+
+    // the spinner was reported once, with the backtrace taken on its thread
+    std::vector<std::string> logged = reports->getReports();
+    _ASSERT(!logged.empty());
+    _ASSERT(logged[0].find("no backtrace") == std::string::npos);
+    LOG_NAME("system")->delAppender(reports);
+    return 0;
+}
@@ -0,0 +1,60 @@
+#include "log.h"
+#include "log_binary.h"
+
+#include <fstream>
+#include <map>
+
+using namespace sylar;
+
+// decode a BinaryLogAppender file back to text
+// usage: log_decode <file> [pattern]
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        std::cerr << "usage: " << argv[0] << " <file> [pattern]" << std::endl;
+        return 1;
+    }
+
+    std::ifstream ifs(argv[1], std::ios::binary);
+    if (!ifs)
+    {
+        std::cerr << "open " << argv[1] << " failed" << std::endl;
+        return 1;
+    }
+
+    LogFormatter::ptr formatter;
+    if (argc > 2)
+    {
+        formatter = LogFormatter::Create(argv[2]);
+        if (formatter->isError())
+        {
+            std::cerr << "invalid pattern " << argv[2] << std::endl;
+            return 1;
+        }
+    }
+
+    std::map<std::string, Logger::ptr> loggers;
+    BinaryLogReader reader(ifs);
+    BinaryLogRecord record;
+    while (reader.next(record))
+    {
+        Logger::ptr &logger = loggers[record.logger];
+        if (!logger)
+        {
+            logger.reset(new Logger(record.logger));
+        }
+        LogFormatter::ptr fmt = formatter ? formatter : logger->getFormatter();
+        LogLevel::Level level = (LogLevel::Level)record.level;
+        LogEvent::ptr event(new LogEvent(logger, level, record.file.c_str(), record.line, record.elapse,
+                                         record.threadId, record.threadName, record.fiberId, record.timeUs, record.message));
+        std::cout << fmt->format(logger.get(), level, event);
+    }
+
+    if (reader.isError())
+    {
+        std::cerr << "corrupt record in " << argv[1] << std::endl;
+        return 1;
+    }
+    return 0;
+}